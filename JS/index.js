@@ -22,261 +22,195 @@ const defaultOptions = {
 
 let client
 
-const widthFor12ptFont = [
-  0,
-  10,
-  10,
-  10,
-  10,
-  10,
-  10,
-  10,
-  10,
-  8,
-  10,
-  10,
-  10,
-  0,
-  10,
-  10,
-  10,
-  11,
-  11,
-  9,
-  11,
-  10,
-  10,
-  10,
-  10,
-  10,
-  10,
-  10,
-  10,
-  10,
-  10,
-  10,
-  4,
-  6,
-  7,
-  10,
-  7,
-  11,
-  10,
-  3,
-  5,
-  5,
-  7,
-  7,
-  4,
-  7,
-  4,
-  7,
-  8,
-  8,
-  8,
-  8,
-  8,
-  8,
-  8,
-  8,
-  8,
-  8,
-  4,
-  4,
-  6,
-  8,
-  6,
-  8,
-  11,
-  8,
-  8,
-  8,
-  8,
-  7,
-  7,
-  8,
-  8,
-  6,
-  7,
-  9,
-  7,
-  12,
-  9,
-  8,
-  8,
-  8,
-  8,
-  7,
-  6,
-  8,
-  8,
-  12,
-  8,
-  8,
-  8,
-  5,
-  7,
-  5,
-  8,
-  8,
-  6,
-  8,
-  8,
-  7,
-  8,
-  8,
-  6,
-  8,
-  8,
-  4,
-  6,
-  8,
-  4,
-  12,
-  8,
-  8,
-  8,
-  8,
-  6,
-  7,
-  6,
-  8,
-  8,
-  12,
-  8,
-  8,
-  8,
-  5,
-  5,
-  5,
-  8,
-  8
-]
+// set by the coprocessor host through iMessageClient.setEventListener, with a function that writes
+// an EVENT frame to the Mac (see coprocessor/frame.js encodeEvent)
+let eventListener
+
+// pushes a change to the Mac as soon as we notice it. returns false if nobody is listening, in
+// which case the Mac will find out the next time it polls
+const emitEvent = (name, data) => {
+
+  if (!eventListener) {
+
+    return false
+  }
+
+  try {
+
+    eventListener(name, data)
+  } catch (error) {
+
+    console.log(`emitEvent: error sending ${name} event`)
+    console.log(error)
+
+    return false
+  }
+
+  return true
+}
 
-// this is tied to mac_main.c's message window max width
-const MAX_WIDTH = 304
-const SPACE_WIDTH = widthFor12ptFont[32]
 let canStart = false
 let hasNewMessages = false
 
-const getNextWordLength = (word) => {
+// messages go to the Mac as they are and it wraps them to fit its window, see wrap.c. we keep up
+// to MAX_TRANSCRIPT_MESSAGES of them, but a Mac starting over is only sent the newest
+// MESSAGE_PAGE_SIZE, and pages in older ones with getMessagePage as they are scrolled to
+const MAX_TRANSCRIPT_MESSAGES = 500
+const MESSAGE_PAGE_SIZE = 16
 
-  let currentWidth = 0
+// the Mac keeps no more than this much of a message, see TRANSCRIPT_MAX_MESSAGE_LENGTH in transcript.h
+const MAX_MESSAGE_LENGTH = 1023
 
-  for (const char of word.split(``)) {
+const splitMessages = (messages) => {
 
-    let currentCharWidth = widthFor12ptFont[char.charCodeAt()]
+  if (!messages || messages.length === 0) {
 
-    if (isNaN(currentCharWidth)) {
+    return `no messages`
+  }
 
-    currentCharWidth = 1;
-    }
+  lastMessageOutput = messages.slice(-MAX_TRANSCRIPT_MESSAGES).map((message) => `${message.chatter}: ${message.text}`).join(`ENDLASTMESSAGE`)
 
-    currentWidth += currentCharWidth
-  }
+  return lastMessageOutput
+}
 
-  return currentWidth
+// the Mac keeps its own copy of the transcript and only asks for the messages it has not seen yet.
+// every message gets a sequence number that only ever goes up, so a sequence from before a reset or
+// from another chat falls outside of the current window and gets the whole transcript instead. the
+// transcript's rows are whole messages, the Mac does its own wrapping
+let transcript = {
+  chatId: undefined,
+  rows: [],
+  nextSequence: 0,
+  deliveredSequence: -1
 }
 
-const shortenText = (text) => {
+const resetTranscript = (chatId, rows) => {
 
-  let outputText = ``
-  let currentWidth = 0
+  // leave a gap so that the old next sequence can not be mistaken for a position in the new rows
+  transcript.chatId = chatId
+  transcript.nextSequence += rows.length + 1
+  transcript.rows = rows
+  transcript.deliveredSequence = -1
+}
 
-  for (const word of text.split(` `)) {
+const updateTranscript = (chatId, output) => {
 
-    let currentWordWidth = getNextWordLength(word)
+  const rows = output ? output.split(`ENDLASTMESSAGE`) : []
+  const oldRows = transcript.rows
 
-    if (currentWidth + currentWordWidth + SPACE_WIDTH > MAX_WIDTH) {
+  if (transcript.chatId !== chatId) {
 
-    outputText = `${outputText}ENDLASTMESSAGE`
-    currentWidth = 0
+    resetTranscript(chatId, rows)
 
-    // okay, but what if the word itself is greater than max width?
-    if (currentWordWidth > MAX_WIDTH) {
+    return
+  }
 
-      let splitWordWidth = 0
+  // the window only ever scrolls, so look for the point where the tail of the old rows lines up
+  // with the head of the new ones. everything after that is what was appended
+  for (let shift = 0; shift <= oldRows.length; shift++) {
 
-      for (const char of word.split(``)) {
+    const overlap = oldRows.length - shift
 
-        let currentCharWidth = widthFor12ptFont[char.charCodeAt()]
+    if (overlap > rows.length) {
 
-        if (isNaN(currentCharWidth)) {
-      
-          currentCharWidth = 1;
-        }
+      continue
+    }
 
-        if (splitWordWidth + currentCharWidth > MAX_WIDTH) {
+    let matches = true
 
-          outputText = `${outputText}ENDLASTMESSAGE`
-          splitWordWidth = 0
-        }
+    for (let row = 0; row < overlap && matches; row++) {
 
-        splitWordWidth += currentCharWidth
-        outputText = `${outputText}${char}`
-        }
+      matches = oldRows[shift + row] === rows[row]
+    }
 
-        currentWidth += splitWordWidth
-        
-        continue
-      }
+    if (!matches) {
+
+      continue
+    }
+
+    const appendedRows = rows.slice(overlap)
+
+    // rows dropping off the top with nothing new underneath means something was removed, start over
+    if (appendedRows.length === 0 && shift > 0) {
+
+      break
+    }
+
+    // nothing in common with what the Mac has, so it may as well start over
+    if (overlap === 0 && oldRows.length > 0) {
+
+      break
     }
 
-    currentWidth += currentWordWidth + SPACE_WIDTH
-    outputText = `${outputText} ${word}`
+    transcript.nextSequence += appendedRows.length
+    transcript.rows = rows
+
+    return
   }
 
-  return outputText
+  resetTranscript(chatId, rows)
 }
 
-const MAX_ROWS = 16
+// base&&&next&&&rows, where base is the sequence the rows follow on from, or -1 if they replace
+// everything, and next is the sequence the Mac should ask for next time. a Mac that is starting over
+// or has fallen a long way behind just gets the newest page
+const transcriptDelta = (since) => {
 
-const splitMessages = (messages) => {
+  const firstSequence = transcript.nextSequence - transcript.rows.length
+  let base = parseInt(since, 10)
+  let rows
 
-  let firstMessage = true
+  if (isNaN(base) || base < firstSequence || base > transcript.nextSequence || transcript.nextSequence - base > MESSAGE_PAGE_SIZE) {
 
-  if (!messages) {
+    base = -1
+    rows = transcript.rows.slice(-MESSAGE_PAGE_SIZE)
+  } else {
 
-    return `no messages ENDLASTMESSAGE`
+    rows = transcript.rows.slice(base - firstSequence)
   }
 
-  for (const message of messages) {
+  transcript.deliveredSequence = transcript.nextSequence
 
-    if (firstMessage) {
+  return `${base}&&&${transcript.nextSequence}&&&${rows.join(`ENDLASTMESSAGE`)}`
+}
 
-      let tempMessageOutput = `${message.chatter}: ${message.text}`
+// first&&&rows, the messages just before sequence before, going back no further than maxCount
+// messages or maxBytes of text. first is the sequence of the first one, so no rows means there is
+// nothing older. an empty string means before is not from this transcript, and the Mac should wait
+// to be sent the current one
+const transcriptPage = (chatId, before, maxBytes, maxCount) => {
 
-      tempMessageOutput = shortenText(tempMessageOutput)
-      messageOutput = tempMessageOutput
-    } else {
+  const firstSequence = transcript.nextSequence - transcript.rows.length
 
-      let tempMessageOutput = `${message.chatter}: ${message.text}`
+  before = parseInt(before, 10)
+  maxBytes = parseInt(maxBytes, 10)
+  maxCount = parseInt(maxCount, 10)
 
-      tempMessageOutput = shortenText(tempMessageOutput)
-      messageOutput = `${messageOutput}ENDLASTMESSAGE${tempMessageOutput}`
-    }
+  if (transcript.chatId !== chatId || isNaN(before) || before < firstSequence || before > transcript.nextSequence) {
 
-    firstMessage = false
+    return ``
   }
 
+  let first = before
+  let bytes = 0
 
-  if (messageOutput.split(`ENDLASTMESSAGE`).length > MAX_ROWS) {
+  // always at least one message, and the Mac would only cut long ones off anyway
+  while (first > firstSequence && before - first < maxCount) {
 
-    messageOutput = messageOutput.split(`ENDLASTMESSAGE`)
+    const rowBytes = Math.min(transcript.rows[first - 1 - firstSequence].length, MAX_MESSAGE_LENGTH) + `ENDLASTMESSAGE`.length
 
-    let newMessageOutput = []
+    if (first < before && bytes + rowBytes > maxBytes) {
 
-    for (let i = messageOutput.length; i > messageOutput.length - MAX_ROWS; i--) {
-
-      newMessageOutput.unshift(messageOutput[i])
+      break
     }
 
-    messageOutput = newMessageOutput.join(`ENDLASTMESSAGE`)
-  } 
+    bytes += rowBytes
+    first--
+  }
 
-  lastMessageOutput = messageOutput
+  const rows = transcript.rows.slice(first - firstSequence, before - firstSequence).map((row) => row.slice(0, MAX_MESSAGE_LENGTH))
 
-  return messageOutput
+  return `${first}&&&${rows.join(`ENDLASTMESSAGE`)}`
 }
 
 const parseChatsToFriendlyNameString = (chats) => {
@@ -371,10 +305,17 @@ class iMessageGraphClientClass {
       let currentLastMessageOutput = `${lastMessageOutput}`
 
       storedArgsAndResults.getMessages.output = splitMessages(TEST_MESSAGES)
+      updateTranscript(chatId, storedArgsAndResults.getMessages.output)
 
       if (!hasNewMessages && fromInterval) {
 
         hasNewMessages = currentLastMessageOutput !== storedArgsAndResults.getMessages.output
+
+        // once the Mac has been handed the messages there is nothing left for it to poll for
+        if (hasNewMessages && emitEvent(`newMessages`, `${chatId}&&&${transcriptDelta(transcript.deliveredSequence)}`)) {
+
+          hasNewMessages = false
+        }
       }
 
       return storedArgsAndResults.getMessages.output
@@ -410,6 +351,7 @@ class iMessageGraphClientClass {
     let currentLastMessageOutput = `${lastMessageOutput}`
 
     storedArgsAndResults.getMessages.output = splitMessages(messages)
+    updateTranscript(chatId, storedArgsAndResults.getMessages.output)
 
     if (!hasNewMessages && fromInterval) {
 
@@ -421,6 +363,12 @@ class iMessageGraphClientClass {
         console.log(currentLastMessageOutput)
         console.log(`new message set is:`)
         console.log(storedArgsAndResults.getMessages.output)
+
+        // once the Mac has been handed the messages there is nothing left for it to poll for
+        if (emitEvent(`newMessages`, `${chatId}&&&${transcriptDelta(transcript.deliveredSequence)}`)) {
+
+          hasNewMessages = false
+        }
       }
     }
 
@@ -447,6 +395,7 @@ class iMessageGraphClientClass {
       TEST_MESSAGES = TEST_MESSAGES.concat({chatter: `me`, text: message})
 
       storedArgsAndResults.getMessages.output = splitMessages(TEST_MESSAGES)
+      updateTranscript(chatId, storedArgsAndResults.getMessages.output)
 
       return storedArgsAndResults.getMessages.output
     }
@@ -476,6 +425,7 @@ class iMessageGraphClientClass {
     let messages = result.data.sendMessage
 
     storedArgsAndResults.getMessages.output = splitMessages(messages)
+    updateTranscript(chatId, storedArgsAndResults.getMessages.output)
 
     return storedArgsAndResults.getMessages.output
   }
@@ -584,6 +534,11 @@ class iMessageGraphClientClass {
     // remove trailing comma
     friendlyNameStrings = friendlyNameStrings.substring(1, friendlyNameStrings.length)
 
+    if (storedArgsAndResults.getChatCounts.output !== friendlyNameStrings) {
+
+      emitEvent(`chatCounts`, friendlyNameStrings)
+    }
+
     storedArgsAndResults.getChatCounts.output = friendlyNameStrings
 
     if (DEBUG) {
@@ -725,6 +680,81 @@ class iMessageClient {
     return returnValue
   }
 
+  // getMessages, but only returning the rows that came after since. see transcriptDelta for the format
+  async getMessagesSince (chatId, page, since) {
+
+    await this.getMessages(chatId, page)
+
+    return transcriptDelta(since)
+  }
+
+  // older messages for the Mac's scrollback, see transcriptPage
+  getMessagePage (chatId, before, maxBytes, maxCount) {
+
+    lastMessageFromSerialPortTime = new Date()
+
+    return transcriptPage(chatId, before, maxBytes, maxCount)
+  }
+
+  // hasNewMessagesInChat and getMessagesSince rolled in to one, so that the Mac does not need a
+  // second round trip to fetch messages once it hears there are new ones. returns an empty string
+  // if there is nothing the Mac has not already seen
+  async getNewMessages (chatId, page, since) {
+
+    await this.hasNewMessagesInChat(chatId)
+    await this.getMessages(chatId, page)
+
+    if (transcript.chatId === chatId && parseInt(since, 10) === transcript.nextSequence) {
+
+      return ``
+    }
+
+    return transcriptDelta(since)
+  }
+
+  // runs several calls for the price of one serial round trip. the arguments are a flat list of
+  // function name, argument count and that many arguments, repeated for each call, each of them
+  // length prefixed on the way over (see decodeArguments in coprocessor/frame.js). each result
+  // comes back as `<length>:<result>` so that results can contain anything, including delimiters
+  async batch (...args) {
+
+    lastMessageFromSerialPortTime = new Date()
+
+    let output = ``
+    let argIndex = 0
+
+    while (argIndex < args.length) {
+
+      const functionName = args[argIndex]
+      const argumentCount = parseInt(args[argIndex + 1], 10) || 0
+      const functionArgs = args.slice(argIndex + 2, argIndex + 2 + argumentCount)
+
+      argIndex += 2 + argumentCount
+
+      let result = ``
+
+      if (functionName !== `batch` && typeof this[functionName] === `function`) {
+
+        try {
+
+          result = await this[functionName](...functionArgs)
+        } catch (error) {
+
+          console.log(`iMessageClient.batch: error running ${functionName}`)
+          console.log(error)
+        }
+      } else {
+
+        console.log(`iMessageClient.batch: unknown function ${functionName}`)
+      }
+
+      result = `${result === undefined || result === null ? `` : result}`
+      output = `${output}${result.length}:${result}`
+    }
+
+    return output
+  }
+
   async sendMessage (chatId, message) {
 
     lastMessageFromSerialPortTime = new Date()
@@ -736,6 +766,15 @@ class iMessageClient {
     return messages
   }
 
+  // sendMessage, but only returning the rows that came after since. the arguments come over length
+  // prefixed, so the message arrives whole whatever delimiters it contains
+  async sendMessageSince (chatId, since, message) {
+
+    await this.sendMessage(chatId, message)
+
+    return transcriptDelta(since)
+  }
+
   async getChats () {
 
     lastMessageFromSerialPortTime = new Date()
@@ -763,6 +802,15 @@ class iMessageClient {
     return storedArgsAndResults.getChatCounts.output
   }
 
+  // lets the coprocessor host push changes to the Mac instead of waiting to be polled. listener is
+  // called with an event name and its data, and should write them to the Mac as an EVENT frame,
+  // such as port.write(frame.encodeEvent(`nuklear`, name, data)). the first argument is the name
+  // the Mac passes to setupCoprocessor in mac_main.c, encodeEvent folds it with applicationIdFor
+  setEventListener (listener) {
+
+    eventListener = listener
+  }
+
   setIPAddress (IPAddress) {
 
     console.log(`iMessageClient.setIPAddress`)
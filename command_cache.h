@@ -0,0 +1,214 @@
+#ifndef COMMAND_CACHE_H
+#define COMMAND_CACHE_H
+
+// the command cache for nuklear_quickdraw.h, in its own header so the tests can run it against
+// nuklear on its own. include it after nuklear.h
+#include <MacTypes.h>
+#include <stddef.h>
+#include <string.h>
+#include "SerialHelper.h"
+
+// every command drawn last frame is kept in a small open addressed table, keyed on a hash of
+// everything about it except where it sits in the command buffer. a command found there is already
+// on the offscreen buffer and is skipped, even if something earlier in the frame was added or
+// removed and shifted it along. entries hold the command's offset in `last` so a hash collision can
+// never skip a command that is not really the same
+#define COMMAND_HASH_TABLE_SIZE 256 // must be a power of 2
+#define COMMAND_HASH_TABLE_MAX_LOAD (COMMAND_HASH_TABLE_SIZE * 3 / 4)
+
+typedef struct {
+    unsigned long hash; // 0 marks an empty slot
+    nk_size offset;
+} CommandHashEntry;
+
+CommandHashEntry commandHashTables[2][COMMAND_HASH_TABLE_SIZE];
+Boolean commandCacheBypassed = false;
+CommandHashEntry *lastCommandHashes = commandHashTables[0];
+CommandHashEntry *currentCommandHashes = commandHashTables[1];
+short currentCommandHashCount = 0;
+
+#ifdef PROFILING
+    unsigned short commandCacheHits;
+    unsigned short commandCacheMisses;
+#endif
+
+// the bytes of a command that decide what it draws: everything after the header, which holds the
+// offset of the next command. text and polygons carry their strings and points on the end
+long commandDrawSize(const struct nk_command *cmd) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: commandDrawSize");
+    #endif
+
+    switch (cmd->type) {
+
+        case NK_COMMAND_SCISSOR:
+
+            return sizeof(struct nk_command_scissor);
+        case NK_COMMAND_LINE:
+
+            return sizeof(struct nk_command_line);
+        case NK_COMMAND_CURVE:
+
+            return sizeof(struct nk_command_curve);
+        case NK_COMMAND_RECT:
+
+            return sizeof(struct nk_command_rect);
+        case NK_COMMAND_RECT_FILLED:
+
+            return sizeof(struct nk_command_rect_filled);
+        case NK_COMMAND_CIRCLE:
+
+            return sizeof(struct nk_command_circle);
+        case NK_COMMAND_CIRCLE_FILLED:
+
+            return sizeof(struct nk_command_circle_filled);
+        case NK_COMMAND_ARC:
+
+            return sizeof(struct nk_command_arc);
+        case NK_COMMAND_TRIANGLE:
+
+            return sizeof(struct nk_command_triangle);
+        case NK_COMMAND_TRIANGLE_FILLED:
+
+            return sizeof(struct nk_command_triangle_filled);
+        case NK_COMMAND_POLYGON:
+        case NK_COMMAND_POLYLINE:
+
+            return offsetof(struct nk_command_polygon, points) + ((const struct nk_command_polygon *)cmd)->point_count * sizeof(struct nk_vec2i);
+        case NK_COMMAND_POLYGON_FILLED:
+
+            return offsetof(struct nk_command_polygon_filled, points) + ((const struct nk_command_polygon_filled *)cmd)->point_count * sizeof(struct nk_vec2i);
+        case NK_COMMAND_TEXT:
+
+            return offsetof(struct nk_command_text, string) + ((const struct nk_command_text *)cmd)->length;
+        default:
+
+            // nothing else is drawn, so there is nothing to compare
+            return sizeof(struct nk_command);
+    }
+}
+
+// FNV-1a over the type and the drawn bytes
+unsigned long commandHash(const struct nk_command *cmd) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: commandHash");
+    #endif
+
+    const unsigned char *bytes = (const unsigned char *)cmd + sizeof(struct nk_command);
+    long length = commandDrawSize(cmd) - sizeof(struct nk_command);
+    unsigned long hash = 2166136261UL ^ cmd->type;
+
+    while (length-- > 0) {
+
+        hash = (hash ^ *bytes++) * 16777619UL;
+    }
+
+    return hash == 0 ? 1 : hash;
+}
+
+Boolean commandsDrawTheSame(const struct nk_command *a, const struct nk_command *b) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: commandsDrawTheSame");
+    #endif
+
+    long size = commandDrawSize(a);
+
+    return a->type == b->type && size == commandDrawSize(b) &&
+        !memcmp((const char *)a + sizeof(struct nk_command), (const char *)b + sizeof(struct nk_command), size - sizeof(struct nk_command));
+}
+
+// finds cmd in a table of commands that live in buffer, returning its slot, or the empty slot it
+// would go in
+CommandHashEntry *findCommand(CommandHashEntry *table, const void *buffer, const struct nk_command *cmd, unsigned long hash) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: findCommand");
+    #endif
+
+    short slot = hash & (COMMAND_HASH_TABLE_SIZE - 1);
+
+    // the table is never more than 3/4 full, so this always finds a match or an empty slot
+    while (table[slot].hash != 0) {
+
+        if (table[slot].hash == hash && commandsDrawTheSame(nk_ptr_add_const(struct nk_command, buffer, table[slot].offset), cmd)) {
+
+            break;
+        }
+
+        slot = (slot + 1) & (COMMAND_HASH_TABLE_SIZE - 1);
+    }
+
+    return &table[slot];
+}
+
+// remembers that cmd, at offset in this frame's buffer, is on the offscreen buffer now
+void rememberCommand(const void *buffer, const struct nk_command *cmd) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: rememberCommand");
+    #endif
+
+    // scissors draw nothing, so they are never looked up
+    if (cmd->type == NK_COMMAND_SCISSOR || currentCommandHashCount >= COMMAND_HASH_TABLE_MAX_LOAD) {
+
+        return;
+    }
+
+    unsigned long hash = commandHash(cmd);
+    CommandHashEntry *entry = findCommand(currentCommandHashes, buffer, cmd, hash);
+
+    if (entry->hash == 0) {
+
+        entry->hash = hash;
+        entry->offset = (const char *)cmd - (const char *)buffer;
+        currentCommandHashCount++;
+    }
+}
+
+// true if cmd was drawn last frame, when the commands were in lastBuffer
+Boolean alreadyDrawn(const void *lastBuffer, const struct nk_command *cmd) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: alreadyDrawn");
+    #endif
+
+    // a layer that has just been made is blank, whatever was drawn last frame
+    if (commandCacheBypassed) {
+
+        return false;
+    }
+
+    Boolean found = findCommand(lastCommandHashes, lastBuffer, cmd, commandHash(cmd))->hash != 0;
+
+    #ifdef PROFILING
+        if (found) {
+
+            commandCacheHits++;
+        } else {
+
+            commandCacheMisses++;
+        }
+    #endif
+
+    return found;
+}
+
+// this frame's commands become last frame's once it has been drawn
+void swapCommandHashTables() {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: swapCommandHashTables");
+    #endif
+
+    CommandHashEntry *swap = lastCommandHashes;
+
+    lastCommandHashes = currentCommandHashes;
+    currentCommandHashes = swap;
+    memset(currentCommandHashes, 0, sizeof(CommandHashEntry) * COMMAND_HASH_TABLE_SIZE);
+    currentCommandHashCount = 0;
+}
+
+#endif
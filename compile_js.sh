@@ -3,6 +3,10 @@
 # into a single file following the format outlined for programs in https://github.com/CamHenlin/coprocessor.js
 # requires truncate
 # requires xxd
+# requires node
+
+# the renderer's character widths, see font_metrics.js
+node font_metrics.js header
 
 truncate --size=0 output_js
 truncate --size=0 output_js.h
@@ -17,5 +21,13 @@ done
 
 cd ..
 truncate -s-4 output_js # remove trailing &&&
+
+# the coprocessor caches programs by this hash, so the Mac only has to upload one when it changes
+node -e "process.stdout.write('#define OUTPUT_JS_HASH \"' + require('./coprocessor/frame.js').programHash(require('fs').readFileSync('output_js')) + '\"\n')" >> output_js.h
+
+# the Mac sends the program with the compressed flag set, which cuts down how long startup spends
+# pushing it through the serial port. see coprocessor/frame.js for the format
+node -e "const fs = require('fs'); fs.writeFileSync('output_js', require('./coprocessor/frame.js').compress(fs.readFileSync('output_js')))"
+
 xxd -C -i output_js >> output_js.h
 #rm output_js
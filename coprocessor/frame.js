@@ -0,0 +1,487 @@
+// binary framing shared with coprocessorjs.c on the Macintosh side. every message in either
+// direction is a 16 byte header followed by the payload -- see coprocessorjs.h for the layout.
+// the host in host.js uses this in place of the old `;;;` and `;;@@&&` delimited strings, which
+// meant scanning every byte several times and broke on payloads containing the delimiters. it
+// lives out here rather than in JS/ so that compile_js.sh does not bundle it in to the program
+const crypto = require(`crypto`)
+const fs = require(`fs`)
+const path = require(`path`)
+
+const MAGIC = [0x43, 0x4a] // `C` `J`
+const VERSION = 1
+const HEADER_SIZE = 16
+
+const OPCODES = {
+  PROGRAM: 1,
+  EVAL: 2,
+  FUNCTION: 3,
+  EVENT: 4, // unsolicited, coprocessor to Mac only
+  PROGRAM_HASH: 5 // payload is a programHash, see ProgramCache
+}
+
+// every request gets an answer, so the Mac is never left waiting out a timeout. one with an
+// opcode the host does not handle is answered with UNKNOWN_OPCODE, see unknownOpcodeResponse
+const STATUS = {
+  SUCCESS: 0,
+  FAILURE: 1,
+  UNKNOWN_OPCODE: 2
+}
+
+const FLAGS = {
+  COMPRESSED: 0x01
+}
+
+// compressed payloads are a 4 byte big endian decoded length followed by an LZ4 style block: each
+// sequence is a token (high nibble literal count, low nibble match length - 4, 15 meaning more
+// length bytes follow, added up until one is not 255), the literals, then a 2 byte offset back in
+// to the output. unlike LZ4 the offset is big endian, which is what the 68000 reads natively. the
+// last sequence is only literals. see decompressFromReceiveRing in coprocessorjs.c
+const MIN_MATCH = 4
+const MAX_OFFSET = 0xffff
+const HASH_BITS = 12
+
+// small payloads are not worth the Mac's time to decode
+const COMPRESSION_THRESHOLD = 64
+
+const writeLength = (output, length) => {
+
+  while (length >= 255) {
+
+    output.push(255)
+    length -= 255
+  }
+
+  output.push(length)
+}
+
+const compress = (input) => {
+
+  const output = [
+    (input.length >>> 24) & 0xff,
+    (input.length >>> 16) & 0xff,
+    (input.length >>> 8) & 0xff,
+    input.length & 0xff
+  ]
+
+  const hashTable = new Int32Array(1 << HASH_BITS).fill(-1)
+  const hash = (position) => (Math.imul(input.readUInt32BE(position), 2654435761) >>> (32 - HASH_BITS))
+
+  const writeSequence = (literalStart, literalEnd, offset, matchLength) => {
+
+    const literalLength = literalEnd - literalStart
+    const hasMatch = matchLength >= MIN_MATCH
+
+    output.push((Math.min(literalLength, 15) << 4) | (hasMatch ? Math.min(matchLength - MIN_MATCH, 15) : 0))
+
+    if (literalLength >= 15) {
+
+      writeLength(output, literalLength - 15)
+    }
+
+    for (let position = literalStart; position < literalEnd; position++) {
+
+      output.push(input[position])
+    }
+
+    if (!hasMatch) {
+
+      return
+    }
+
+    output.push((offset >>> 8) & 0xff, offset & 0xff)
+
+    if (matchLength - MIN_MATCH >= 15) {
+
+      writeLength(output, matchLength - MIN_MATCH - 15)
+    }
+  }
+
+  let literalStart = 0
+  let position = 0
+
+  while (position + MIN_MATCH <= input.length) {
+
+    const bucket = hash(position)
+    const candidate = hashTable[bucket]
+
+    hashTable[bucket] = position
+
+    if (candidate < 0 || position - candidate > MAX_OFFSET || input.readUInt32BE(candidate) !== input.readUInt32BE(position)) {
+
+      position++
+
+      continue
+    }
+
+    let matchLength = MIN_MATCH
+
+    while (position + matchLength < input.length && input[candidate + matchLength] === input[position + matchLength]) {
+
+      matchLength++
+    }
+
+    writeSequence(literalStart, position, position - candidate, matchLength)
+
+    position += matchLength
+    literalStart = position
+  }
+
+  // the trailing literals always get a sequence of their own, even an empty one, so the decoder
+  // knows the block has ended cleanly
+  writeSequence(literalStart, input.length, 0, 0)
+
+  return Buffer.from(output)
+}
+
+const readLength = (block, cursor) => {
+
+  let length = 0
+  let byte
+
+  do {
+
+    byte = block[cursor.position++]
+    length += byte
+  } while (byte === 255)
+
+  return length
+}
+
+const decompress = (block) => {
+
+  const output = Buffer.alloc(block.readUInt32BE(0))
+  const cursor = {position: 4}
+  let outputPosition = 0
+
+  while (cursor.position < block.length) {
+
+    const token = block[cursor.position++]
+    let literalLength = token >>> 4
+
+    if (literalLength === 15) {
+
+      literalLength += readLength(block, cursor)
+    }
+
+    block.copy(output, outputPosition, cursor.position, cursor.position + literalLength)
+    cursor.position += literalLength
+    outputPosition += literalLength
+
+    if (cursor.position >= block.length) {
+
+      break
+    }
+
+    const offset = block.readUInt16BE(cursor.position)
+    let matchLength = token & 0x0f
+
+    cursor.position += 2
+
+    if (matchLength === 15) {
+
+      matchLength += readLength(block, cursor)
+    }
+
+    matchLength += MIN_MATCH
+
+    // matches may overlap the bytes they produce, so copy one byte at a time
+    for (let i = 0; i < matchLength; i++, outputPosition++) {
+
+      output[outputPosition] = output[outputPosition - offset]
+    }
+  }
+
+  return output
+}
+
+// strings travel as raw bytes, the Mac side does not know about UTF-8
+const toPayloadBuffer = (payload) => {
+
+  if (Buffer.isBuffer(payload)) {
+
+    return payload
+  }
+
+  return Buffer.from(`${payload === undefined || payload === null ? `` : payload}`, `latin1`)
+}
+
+// with compressible set, the payload is compressed whenever it is large enough for that to be worth
+// it and actually comes out smaller
+const encodeFrame = ({opcode, status = STATUS.SUCCESS, flags = 0, applicationId, callId, payload, compressible = false}) => {
+
+  let payloadBuffer = toPayloadBuffer(payload)
+
+  if (compressible && payloadBuffer.length >= COMPRESSION_THRESHOLD) {
+
+    const compressedBuffer = compress(payloadBuffer)
+
+    if (compressedBuffer.length < payloadBuffer.length) {
+
+      payloadBuffer = compressedBuffer
+      flags |= FLAGS.COMPRESSED
+    }
+  }
+
+  const frame = Buffer.alloc(HEADER_SIZE + payloadBuffer.length)
+
+  frame[0] = MAGIC[0]
+  frame[1] = MAGIC[1]
+  frame.writeUInt8(VERSION, 2)
+  frame.writeUInt8(opcode, 3)
+  frame.writeUInt8(status, 4)
+  frame.writeUInt8(flags, 5)
+  frame.writeUInt16BE(applicationId & 0xffff, 6)
+  frame.writeUInt16BE(callId & 0xffff, 8)
+  frame.writeUInt32BE(payloadBuffer.length, 10)
+  payloadBuffer.copy(frame, HEADER_SIZE)
+
+  return frame
+}
+
+// a response echoes the application id, call id and opcode of the request it answers
+const encodeResponse = (request, status, payload) => {
+
+  return encodeFrame({
+    opcode: request.opcode,
+    status,
+    applicationId: request.applicationId,
+    callId: request.callId,
+    payload,
+    compressible: true
+  })
+}
+
+// frames carry the application id as a number, which the Mac works out from the name it was set
+// up with (see setupCoprocessor in coprocessorjs.c). an event with any other id is dropped there
+// without a word, so always get it from here rather than working it out by hand
+const applicationIdFor = (name) => {
+
+  let applicationId = 0
+
+  for (const character of Buffer.from(`${name}`, `latin1`)) {
+
+    applicationId = (applicationId * 31 + character) & 0xffff
+  }
+
+  return applicationId
+}
+
+// the answer to a request the host does not know what to do with. the Mac takes this as a no,
+// straight away, which is what lets it probe with an opcode like PROGRAM_HASH that an older host
+// may not have
+const unknownOpcodeResponse = (request) => {
+
+  return encodeResponse(request, STATUS.UNKNOWN_OPCODE, ``)
+}
+
+// a FUNCTION request's payload is the function's name and then each of its arguments, every one
+// of them as `<length>:<bytes>`, the same as the results of a batch. nothing in an argument is
+// looked at, so a message can hold any of our delimiters. see CoprocessorArguments in
+// coprocessorjs.h for the Mac's end
+const encodeArguments = (name, args = []) => {
+
+  return Buffer.concat([name, ...args].map((argument) => {
+
+    const argumentBuffer = toPayloadBuffer(argument)
+
+    return Buffer.concat([Buffer.from(`${argumentBuffer.length}:`, `latin1`), argumentBuffer])
+  }))
+}
+
+// the other way, [name, ...args] as strings. throws on a payload that is cut short or not
+// length prefixed at all, rather than calling something with half of what was meant
+const decodeArguments = (payload) => {
+
+  const payloadBuffer = toPayloadBuffer(payload)
+  const decoded = []
+  let offset = 0
+
+  while (offset < payloadBuffer.length) {
+
+    const colon = payloadBuffer.indexOf(`:`, offset, `latin1`)
+    const lengthText = colon < 0 ? `` : payloadBuffer.toString(`latin1`, offset, colon)
+
+    if (!/^[0-9]+$/.test(lengthText)) {
+
+      throw new Error(`argument ${decoded.length} has no length`)
+    }
+
+    const end = colon + 1 + Number(lengthText)
+
+    if (end > payloadBuffer.length) {
+
+      throw new Error(`argument ${decoded.length} runs past the payload`)
+    }
+
+    decoded.push(payloadBuffer.toString(`latin1`, colon + 1, end))
+    offset = end
+  }
+
+  return decoded
+}
+
+// events are not answers to anything, so they carry no call id. the payload is the event name
+// and its data joined by `&&&`. application is the application's name, or an id from
+// applicationIdFor, or from a request the Mac sent
+const encodeEvent = (application, name, data) => {
+
+  return encodeFrame({
+    opcode: OPCODES.EVENT,
+    applicationId: typeof application === `number` ? application : applicationIdFor(application),
+    callId: 0,
+    payload: `${name}&&&${data}`,
+    compressible: true
+  })
+}
+
+const decodeHeader = (buffer, offset = 0) => {
+
+  return {
+    version: buffer.readUInt8(offset + 2),
+    opcode: buffer.readUInt8(offset + 3),
+    status: buffer.readUInt8(offset + 4),
+    flags: buffer.readUInt8(offset + 5),
+    applicationId: buffer.readUInt16BE(offset + 6),
+    callId: buffer.readUInt16BE(offset + 8),
+    payloadLength: buffer.readUInt32BE(offset + 10)
+  }
+}
+
+// collects bytes as they arrive from the serial port and hands back whole frames. the payload
+// length in the header tells us exactly how much to wait for, so nothing is scanned twice.
+// compressed payloads are handed back already decompressed
+class FrameReader {
+
+  constructor () {
+
+    this.pending = Buffer.alloc(0)
+  }
+
+  push (chunk) {
+
+    this.pending = this.pending.length === 0 ? chunk : Buffer.concat([this.pending, chunk])
+
+    const frames = []
+
+    while (true) {
+
+      // if we have lost our place in the stream, skip ahead to the next thing that looks like a frame
+      let start = 0
+
+      while (start + 1 < this.pending.length && (this.pending[start] !== MAGIC[0] || this.pending[start + 1] !== MAGIC[1])) {
+
+        start++
+      }
+
+      this.pending = this.pending.slice(start)
+
+      if (this.pending.length < HEADER_SIZE) {
+
+        break
+      }
+
+      const header = decodeHeader(this.pending)
+
+      if (this.pending.length < HEADER_SIZE + header.payloadLength) {
+
+        break
+      }
+
+      let payload = this.pending.slice(HEADER_SIZE, HEADER_SIZE + header.payloadLength)
+
+      if (header.flags & FLAGS.COMPRESSED) {
+
+        payload = decompress(payload)
+        header.flags &= ~FLAGS.COMPRESSED
+        header.payloadLength = payload.length
+      }
+
+      frames.push({
+        ...header,
+        payload
+      })
+
+      this.pending = this.pending.slice(HEADER_SIZE + header.payloadLength)
+    }
+
+    return frames
+  }
+}
+
+// compile_js.sh writes this in to output_js.h as OUTPUT_JS_HASH. it is taken over the program as
+// the Mac would send it uncompressed, which is also what a FrameReader hands back
+const programHash = (program) => {
+
+  return crypto.createHash(`sha256`).update(program).digest(`hex`)
+}
+
+// keeps every program the Mac uploads on disk, named by its hash. when a PROGRAM_HASH frame comes
+// in, the host looks the hash up here: if the program is found it is run exactly as if it had just
+// been uploaded, and the response is the same as for PROGRAM. if not, the host answers with
+// STATUS.FAILURE and the Mac uploads it with a PROGRAM frame, which the host should then store
+class ProgramCache {
+
+  constructor (directory) {
+
+    this.directory = directory
+    fs.mkdirSync(directory, {recursive: true})
+  }
+
+  pathFor (hash) {
+
+    // the hash comes from the Mac, so make sure it can only ever name a file in our directory
+    if (!/^[0-9a-f]{64}$/.test(hash)) {
+
+      return undefined
+    }
+
+    return path.join(this.directory, `${hash}.program`)
+  }
+
+  load (hash) {
+
+    const programPath = this.pathFor(`${hash}`)
+
+    if (!programPath || !fs.existsSync(programPath)) {
+
+      return undefined
+    }
+
+    const program = fs.readFileSync(programPath)
+
+    // a partial write or a damaged file is as good as a miss
+    return programHash(program) === hash ? program : undefined
+  }
+
+  store (program) {
+
+    const hash = programHash(program)
+    const temporaryPath = `${this.pathFor(hash)}.${process.pid}.tmp`
+
+    fs.writeFileSync(temporaryPath, program)
+    fs.renameSync(temporaryPath, this.pathFor(hash))
+
+    return hash
+  }
+}
+
+module.exports = {
+  HEADER_SIZE,
+  VERSION,
+  OPCODES,
+  STATUS,
+  FLAGS,
+  compress,
+  decompress,
+  programHash,
+  ProgramCache,
+  encodeFrame,
+  encodeResponse,
+  unknownOpcodeResponse,
+  applicationIdFor,
+  encodeArguments,
+  decodeArguments,
+  encodeEvent,
+  decodeHeader,
+  FrameReader
+}
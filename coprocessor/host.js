@@ -0,0 +1,188 @@
+// the coprocessor side of the binary protocol in frame.js, for a host such as coprocessor.js to run
+// in place of its delimited string handling. it has nothing to do with serial ports itself: feed
+// it whatever comes in from the Mac with push, and it hands every frame it answers with to write.
+//
+//   const host = new CoprocessorHost({write: (bytes) => port.write(bytes)})
+//   port.on(`data`, (chunk) => host.push(chunk))
+//
+// PROGRAM unpacks the bundle compile_js.sh makes, requires its index.js and makes an instance of
+// what that exports. FUNCTION calls a method on that instance, EVAL evaluates, and PROGRAM_HASH
+// runs a program out of the ProgramCache. anything else is answered with UNKNOWN_OPCODE, so the
+// Mac is never left waiting out a timeout
+const childProcess = require(`child_process`)
+const fs = require(`fs`)
+const os = require(`os`)
+const path = require(`path`)
+const frame = require(`./frame.js`)
+
+// compile_js.sh writes each file as `<filename>@@@\n<contents>&&&\n`, and cuts the last `&&&\n`
+// off. the contents can hold `&&&` themselves (index.js does), so a file only ends where the next
+// one's name follows
+const FILE_HEADER = /(?:^|&&&\n)([\w.-]+)@@@\n/g
+
+const unpackProgram = (program) => {
+
+  const fileHeader = new RegExp(FILE_HEADER)
+  const source = `${program}`
+  const files = []
+  let match
+
+  while ((match = fileHeader.exec(source)) !== null) {
+
+    if (files.length > 0) {
+
+      files[files.length - 1].end = match.index
+    }
+
+    files.push({filename: match[1], start: fileHeader.lastIndex})
+  }
+
+  return files.map(({filename, start, end}) => {
+
+    return {filename, contents: source.slice(start, end === undefined ? source.length : end)}
+  })
+}
+
+// npm install, if the program has a package.json and has not been installed in this directory yet
+const installDependencies = (directory) => {
+
+  if (fs.existsSync(path.join(directory, `package.json`)) && !fs.existsSync(path.join(directory, `node_modules`))) {
+
+    childProcess.execSync(`npm install --production`, {cwd: directory, stdio: `inherit`})
+  }
+}
+
+class CoprocessorHost {
+
+  // write is called with each frame to send to the Mac. programs are written out under
+  // programDirectory, one directory per program hash, and kept in a ProgramCache in cacheDirectory.
+  // install is called with a program's directory before it is required, and log with anything that
+  // goes wrong
+  constructor ({write, programDirectory = path.join(os.tmpdir(), `coprocessor-programs`), cacheDirectory = path.join(programDirectory, `cache`), install = installDependencies, log = console.log}) {
+
+    this.write = write
+    this.log = log
+    this.programDirectory = programDirectory
+    this.cache = new frame.ProgramCache(cacheDirectory)
+    this.install = install
+    this.reader = new frame.FrameReader()
+    this.program = undefined
+  }
+
+  // answers go out as they are ready, which is not always in the order the requests came in. the
+  // Mac matches them up by call id
+  push (chunk) {
+
+    const handled = this.reader.push(chunk).map((request) => this.handle(request))
+
+    return Promise.all(handled)
+  }
+
+  async handle (request) {
+
+    let response
+
+    try {
+
+      response = await this.answer(request)
+    } catch (error) {
+
+      this.log(`CoprocessorHost: error handling opcode ${request.opcode}`)
+      this.log(error)
+
+      response = frame.encodeResponse(request, frame.STATUS.FAILURE, `${error && error.message ? error.message : error}`)
+    }
+
+    this.write(response)
+  }
+
+  async answer (request) {
+
+    switch (request.opcode) {
+
+      case frame.OPCODES.PROGRAM:
+
+        this.cache.store(request.payload)
+
+        return this.runProgram(request, request.payload)
+
+      case frame.OPCODES.PROGRAM_HASH: {
+
+        const program = this.cache.load(`${request.payload}`)
+
+        // not cached, so the Mac uploads it with a PROGRAM frame
+        if (program === undefined) {
+
+          return frame.encodeResponse(request, frame.STATUS.FAILURE, ``)
+        }
+
+        return this.runProgram(request, program)
+      }
+
+      case frame.OPCODES.FUNCTION:
+
+        return this.callFunction(request)
+
+      case frame.OPCODES.EVAL: {
+
+        // indirect, so that it runs in the global scope rather than in here
+        const result = await (0, eval)(`${request.payload}`)
+
+        return frame.encodeResponse(request, frame.STATUS.SUCCESS, result === undefined || result === null ? `` : `${result}`)
+      }
+
+      default:
+
+        return frame.unknownOpcodeResponse(request)
+    }
+  }
+
+  runProgram (request, program) {
+
+    const directory = path.join(this.programDirectory, frame.programHash(program))
+
+    fs.mkdirSync(directory, {recursive: true})
+
+    for (const {filename, contents} of unpackProgram(program)) {
+
+      fs.writeFileSync(path.join(directory, filename), contents)
+    }
+
+    this.install(directory)
+
+    const exported = require(path.join(directory, `index.js`))
+    const instance = typeof exported === `function` ? new exported() : exported
+
+    // events go to the application the Mac uploaded the program as
+    if (typeof instance.setEventListener === `function`) {
+
+      instance.setEventListener((name, data) => this.write(frame.encodeEvent(request.applicationId, name, data)))
+    }
+
+    this.program = instance
+
+    return frame.encodeResponse(request, frame.STATUS.SUCCESS, ``)
+  }
+
+  async callFunction (request) {
+
+    const [name, ...args] = frame.decodeArguments(request.payload)
+
+    if (this.program === undefined || name === `constructor` || typeof this.program[name] !== `function`) {
+
+      this.log(`CoprocessorHost: no function ${name}`)
+
+      return frame.encodeResponse(request, frame.STATUS.FAILURE, ``)
+    }
+
+    const result = await this.program[name](...args)
+
+    return frame.encodeResponse(request, frame.STATUS.SUCCESS, result === undefined || result === null ? `` : `${result}`)
+  }
+}
+
+module.exports = {
+  unpackProgram,
+  installDependencies,
+  CoprocessorHost
+}
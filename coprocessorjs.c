@@ -13,40 +13,126 @@ IOParam outgoingSerialPortReference;
 IOParam incomingSerialPortReference;
 // #define PRINT_ERRORS 1
 // #define DEBUGGING 1
-#define MAX_ATTEMPTS 10
+// #define PROFILING 1 // times payload decompression, turn on along with PROFILING in mac_main.c
 #define RECEIVE_WINDOW_SIZE 32767 // receive in up to 32kb chunks
 #define MAX_RECEIVE_SIZE 32767 // matching RECEIVE_WINDOW_SIZE for now
+#define FUNCTION_CALL_TIMEOUT_TICKS 1800 // 30 seconds
+#define PROGRAM_HASH_TIMEOUT_TICKS 300 // a coprocessor that does not know the probe might say nothing at all
 char *GlobalSerialInputBuffer;
-char *tempOutput;
-char *application_id;
-int call_counter = 0;
+unsigned short application_id = 0;
+unsigned short call_counter = 0;
+CoprocessorStats coprocessorStats;
 
-// from: https://stackoverflow.com/questions/29847915/implementing-strtok-whose-delimiter-has-more-than-one-character
-// basically multichar delimter strtok
-char *strtokm(char *str, const char *delim) {
+// multichar delimiter tokenizer over a (pointer, length) view. this replaces the old strtokm: all of
+// the state lives in the caller's CoprocessorTokenizer rather than in statics, so tokenizers can be
+// nested or used from a completion path, and nothing is written in to the source. like strtokm,
+// empty tokens are returned, including a trailing one after a final delimiter
+void beginTokenizer(CoprocessorTokenizer *tokenizer, const char *data, long length, const char *delimiter) {
 
     #ifdef DEBUG_FUNCTION_CALLS
-        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: strtokm");
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: beginTokenizer");
     #endif
-    static char *tok;
-    static char *next;
-    char *m;
 
-    if (delim == NULL) return NULL;
+    tokenizer->cursor = data;
+    tokenizer->end = data + length;
+    tokenizer->delimiter = delimiter;
+    tokenizer->delimiterLength = strlen(delimiter);
+    tokenizer->done = tokenizer->delimiterLength == 0;
+}
 
-    tok = (str) ? str : next;
-    if (tok == NULL) return NULL;
+Boolean nextToken(CoprocessorTokenizer *tokenizer, CoprocessorView *token) {
 
-    m = strstr(tok, delim);
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: nextToken");
+    #endif
 
-    if (m) {
-        next = m + strlen(delim);
-        *m = '\0';
-    } else {
-        next = NULL;
+    if (tokenizer->done) {
+
+        return false;
+    }
+
+    const char *start = tokenizer->cursor;
+    const char *lastStart = tokenizer->end - tokenizer->delimiterLength;
+    char first = tokenizer->delimiter[0];
+
+    // the cursor only ever moves forward, so a whole tokenizing pass looks at each byte about once.
+    // memchr skips to each place the delimiter could start, which is quicker than a byte at a time
+    // through long tokens like messages (see tokenizer_bench.c)
+    for (const char *candidate = start; candidate <= lastStart; candidate++) {
+
+        candidate = memchr(candidate, first, lastStart - candidate + 1);
+
+        if (candidate == NULL) {
+
+            break;
+        }
+
+        if (!memcmp(candidate, tokenizer->delimiter, tokenizer->delimiterLength)) {
+
+            token->data = start;
+            token->length = candidate - start;
+            tokenizer->cursor = candidate + tokenizer->delimiterLength;
+
+            return true;
+        }
     }
 
-    return tok;
+    token->data = start;
+    token->length = tokenizer->end - start;
+    tokenizer->done = true;
+
+    return true;
+}
+
+// true if the view is exactly the NUL terminated string
+Boolean viewEquals(const CoprocessorView *view, const char *string) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: viewEquals");
+    #endif
+
+    long length = strlen(string);
+
+    return view->length == length && !memcmp(view->data, string, length);
+}
+
+// true if the view begins with the NUL terminated string
+Boolean viewStartsWith(const CoprocessorView *view, const char *prefix) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: viewStartsWith");
+    #endif
+
+    long length = strlen(prefix);
+
+    return view->length >= length && !memcmp(view->data, prefix, length);
+}
+
+// reads a leading, optionally negative, decimal number from the view, stopping at the first
+// character that is not a digit. views are not NUL terminated, so atoi and strtol are no good here
+long viewToLong(const CoprocessorView *view) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: viewToLong");
+    #endif
+
+    const char *cursor = view->data;
+    const char *end = view->data + view->length;
+    Boolean negative = false;
+    long value = 0;
+
+    if (cursor < end && *cursor == '-') {
+
+        negative = true;
+        cursor++;
+    }
+
+    while (cursor < end && *cursor >= '0' && *cursor <= '9') {
+
+        value = value * 10 + (*cursor++ - '0');
+    }
+
+    return negative ? -value : value;
 }
 
 /*
@@ -210,166 +296,472 @@ void wait(float timeInSeconds) {
     // printf(log);
 }
 
-const int MAX_RECIEVE_LOOP_ITERATIONS = 1000;
+// the receive ring is filled by asynchronous PBRead calls issued from pumpSerialReceive, so the
+// caller is never stuck spinning on wait() while the coprocessor is still producing its response.
+// the size must be a power of 2 so that we can mask ring positions rather than divide them
+#define RECEIVE_RING_SIZE 32768
+#define RECEIVE_RING_MASK (RECEIVE_RING_SIZE - 1)
+
+char *receiveRing;
+unsigned long receiveRingHead = 0; // next position the serial driver will write to
+unsigned long receiveRingTail = 0; // first byte of the frame currently being assembled
+unsigned long receiveDiscardRemaining = 0; // bytes left to throw away from a frame too large for the ring
+IOParam asyncReadParamBlock;
+Boolean asyncReadPending = false;
+
+// responses handed out as views still live in the ring, so the serial driver must not be allowed to
+// read over them. while any view is held, free space is measured from the oldest one rather than the tail
+unsigned long receiveRingPin = 0;
+short pinnedViewCount = 0;
+
+// calls that have been written but not yet answered, keyed by call id. responses are routed to
+// their waiter as they arrive, so several calls can be written back to back on one round trip
+#define MAX_PENDING_CALLS 8
+CoprocessorCall *pendingCalls[MAX_PENDING_CALLS];
+short pendingCallCount = 0;
+
+// where EVENT frames go. until a handler is set they are dropped
+CoprocessorEventHandler eventHandler = NULL;
+char *eventOutput;
+long eventOutputSize = 0;
+
+// moves whatever the serial driver has buffered in to the receive ring without blocking. this is
+// safe to call as often as we like, and should be called at least once per event loop iteration
+// while a call is in flight
+void pumpSerialReceive() {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: pumpSerialReceive");
+    #endif
+
+    if (asyncReadPending) {
 
-// void because this function re-assigns respo
-void readSerialPort(char* output) {
+        // ioResult stays positive until the driver has completed the read at interrupt time
+        if (asyncReadParamBlock.ioResult > 0) {
+
+            return;
+        }
+
+        #ifdef PRINT_ERRORS
+            if (asyncReadParamBlock.ioResult < 0) {
+
+                char errMessage[100];
+                sprintf(errMessage, "async PBRead err:%d", asyncReadParamBlock.ioResult);
+                writeSerialPortDebug(boutRefNum, errMessage);
+            }
+        #endif
+
+        receiveRingHead += asyncReadParamBlock.ioActCount;
+        coprocessorStats.bytesReceived += asyncReadParamBlock.ioActCount;
+        asyncReadPending = false;
+    }
+
+    long byteCount = 0;
+
+    SerGetBuf(incomingSerialPortReference.ioRefNum, &byteCount);
+
+    if (byteCount == 0) {
+
+        return;
+    }
+
+    // we only ever read in to contiguous free space, so a single read never wraps the ring
+    long freeSpace = RECEIVE_RING_SIZE - (long)(receiveRingHead - (pinnedViewCount > 0 ? receiveRingPin : receiveRingTail));
+    long contiguousSpace = RECEIVE_RING_SIZE - (long)(receiveRingHead & RECEIVE_RING_MASK);
+
+    if (byteCount > freeSpace) {
+
+        byteCount = freeSpace;
+    }
+
+    if (byteCount > contiguousSpace) {
+
+        byteCount = contiguousSpace;
+    }
+
+    if (byteCount <= 0) {
+
+        #ifdef DEBUGGING
+            writeSerialPortDebug(boutRefNum, "pumpSerialReceive: receive ring is full");
+        #endif
+
+        return;
+    }
+
+    asyncReadParamBlock.ioCompletion = NULL;
+    asyncReadParamBlock.ioRefNum = incomingSerialPortReference.ioRefNum;
+    asyncReadParamBlock.ioBuffer = (Ptr)&receiveRing[receiveRingHead & RECEIVE_RING_MASK];
+    asyncReadParamBlock.ioReqCount = byteCount;
+    asyncReadParamBlock.ioActCount = 0;
+
+    // note that we poll ioResult above rather than installing an ioCompletion routine: the routine
+    // would be handed its parameter block in A0, which needs assembly glue we would rather not carry
+    asyncReadPending = true;
+    PBRead((ParmBlkPtr)&asyncReadParamBlock, true);
+}
+
+// copies length bytes starting at start out of the ring, handling the wrap
+void copyRingBytes(char *output, unsigned long start, long length) {
+
+    long startOffset = (long)(start & RECEIVE_RING_MASK);
+    long firstPart = RECEIVE_RING_SIZE - startOffset;
+
+    if (firstPart > length) {
+
+        firstPart = length;
+    }
+
+    memcpy(output, &receiveRing[startOffset], firstPart);
+    memcpy(output + firstPart, receiveRing, length - firstPart);
+}
+
+// copies [start, end) out of the ring in to output, handling the wrap, and NUL terminates it
+void copyFromReceiveRing(char *output, long outputSize, unsigned long start, unsigned long end) {
 
     #ifdef DEBUG_FUNCTION_CALLS
-        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: readSerialPort");
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: copyFromReceiveRing");
     #endif
 
-    #ifdef DEBUGGING
-        writeSerialPortDebug(boutRefNum, "readSerialPort");
+    long length = (long)(end - start);
+
+    if (length > outputSize - 1) {
+
+        length = outputSize - 1;
+    }
+
+    copyRingBytes(output, start, length);
+    output[length] = '\0';
+}
+
+unsigned char receiveRingByte(unsigned long position) {
+
+    return (unsigned char)receiveRing[position & RECEIVE_RING_MASK];
+}
+
+// decodes the fixed size header that starts every frame, see coprocessorjs.h for the layout.
+// multi-byte fields are big endian, which happens to be the 68000's native order
+void decodeFrameHeader(unsigned long position, CoprocessorFrameHeader *header) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: decodeFrameHeader");
     #endif
-    
-    // make sure output variable is clear
-    memset(output, '\0', MAX_RECEIVE_SIZE);
-    memset(tempOutput, '\0', MAX_RECEIVE_SIZE);
 
-    bool done = false;
-    long int totalByteCount = 0;
-    incomingSerialPortReference.ioReqCount = 0;
-    int loopCounter = 0;
+    header->version = receiveRingByte(position + 2);
+    header->opcode = receiveRingByte(position + 3);
+    header->status = receiveRingByte(position + 4);
+    header->flags = receiveRingByte(position + 5);
+    header->applicationId = (receiveRingByte(position + 6) << 8) | receiveRingByte(position + 7);
+    header->callId = (receiveRingByte(position + 8) << 8) | receiveRingByte(position + 9);
+    header->payloadLength = ((unsigned long)receiveRingByte(position + 10) << 24) |
+                            ((unsigned long)receiveRingByte(position + 11) << 16) |
+                            ((unsigned long)receiveRingByte(position + 12) << 8) |
+                            (unsigned long)receiveRingByte(position + 13);
+}
 
-    #ifdef DEBUGGING
-        writeSerialPortDebug(boutRefNum, "readSerialPort, enter loop");
+void encodeFrameHeader(unsigned char *bytes, CoprocessorFrameHeader *header) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: encodeFrameHeader");
     #endif
 
-    // wait a moment for the buffer to fill
-    wait(0.01);
+    bytes[0] = COPROCESSOR_FRAME_MAGIC_0;
+    bytes[1] = COPROCESSOR_FRAME_MAGIC_1;
+    bytes[2] = header->version;
+    bytes[3] = header->opcode;
+    bytes[4] = header->status;
+    bytes[5] = header->flags;
+    bytes[6] = header->applicationId >> 8;
+    bytes[7] = header->applicationId & 0xFF;
+    bytes[8] = header->callId >> 8;
+    bytes[9] = header->callId & 0xFF;
+    bytes[10] = (header->payloadLength >> 24) & 0xFF;
+    bytes[11] = (header->payloadLength >> 16) & 0xFF;
+    bytes[12] = (header->payloadLength >> 8) & 0xFF;
+    bytes[13] = header->payloadLength & 0xFF;
+    bytes[14] = 0; // reserved, keeps the payload word aligned
+    bytes[15] = 0;
+}
 
-    while (!done) {
+// returns true once a whole frame (header and payload) is sitting in the ring, with its header
+// decoded in to header. nothing is consumed until consumeFrame is called, so the caller can decide
+// where the payload should go based on the header
+Boolean peekFrameInReceiveRing(CoprocessorFrameHeader *header) {
 
-        if (loopCounter++ > MAX_RECIEVE_LOOP_ITERATIONS) {
-            #ifdef DEBUGGING
-                writeSerialPortDebug(boutRefNum, "coprocessor.readSerialPort MAX RECEIVE ITERATIONS");
-            #endif
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: peekFrameInReceiveRing");
+    #endif
 
-            char *errorMessage = "TIMEOUT_ERROR";
+    // finish throwing away the rest of any frame that was too large for us to hold
+    if (receiveDiscardRemaining > 0) {
 
-            strncat(output, errorMessage, strlen(output) - 1);
+        unsigned long available = receiveRingHead - receiveRingTail;
+        unsigned long toDiscard = available < receiveDiscardRemaining ? available : receiveDiscardRemaining;
 
-            // once we are done reading the buffer entirely, we need to clear it. i'm not sure if this is the best way or not but seems to work
-            memset(GlobalSerialInputBuffer, '\0', MAX_RECEIVE_SIZE);
+        receiveRingTail += toDiscard;
+        receiveDiscardRemaining -= toDiscard;
 
-            return;
+        if (receiveDiscardRemaining > 0) {
+
+            return false;
         }
+    }
 
-        long int byteCount = 0;
-        long int lastByteCount = 0;
-        bool doByteCountsMatch = false;
+    // if we have lost our place in the stream, skip ahead to the next thing that looks like a frame
+    while (receiveRingHead - receiveRingTail >= 2 &&
+           (receiveRingByte(receiveRingTail) != COPROCESSOR_FRAME_MAGIC_0 ||
+            receiveRingByte(receiveRingTail + 1) != COPROCESSOR_FRAME_MAGIC_1)) {
 
-        // the byteCount != lastByteCount portion of the loop means that we want to wait 
-        // for the byteCounts to match between SerGetBuf calls - this means that the buffer
-        // is full and ready to be read
-        while (!doByteCountsMatch || byteCount == 0) {
+        #ifdef DEBUGGING
+            writeSerialPortDebug(boutRefNum, "peekFrameInReceiveRing: skipping byte outside of a frame");
+        #endif
 
-            #ifdef DEBUGGING
-                char debugMessage[100];
-                sprintf(debugMessage, "receive loop: byteCount: %ld, lastByteCount: %ld\n", byteCount, lastByteCount);
-                writeSerialPortDebug(boutRefNum, debugMessage);
-            #endif
+        receiveRingTail++;
+    }
 
-            lastByteCount = (long int)byteCount;
+    if (receiveRingHead - receiveRingTail < COPROCESSOR_FRAME_HEADER_SIZE) {
 
-            wait(0.01); // give the buffer a moment to fill
+        return false;
+    }
 
-            #ifdef PRINT_ERRORS
-                short serGetBufStatus = SerGetBuf(incomingSerialPortReference.ioRefNum, &byteCount);
+    decodeFrameHeader(receiveRingTail, header);
 
-                if (serGetBufStatus != 0) {
+    if (header->payloadLength > RECEIVE_RING_SIZE - COPROCESSOR_FRAME_HEADER_SIZE) {
 
-                    writeSerialPortDebug(boutRefNum, "potential problem with serGetBufStatus:\n");
-                    char debugMessage[100];
-                    sprintf(debugMessage, "serGetBufStatus: %d\n", serGetBufStatus);
-                    writeSerialPortDebug(boutRefNum, debugMessage);
-                }
-            #else
-                SerGetBuf(incomingSerialPortReference.ioRefNum, &byteCount);
-            #endif
+        #ifdef PRINT_ERRORS
+            writeSerialPortDebug(boutRefNum, "peekFrameInReceiveRing: frame is larger than the receive ring, discarding");
+        #endif
+
+        // hand the header over as a failed, empty frame and drop its payload as it arrives
+        receiveDiscardRemaining = header->payloadLength;
+        header->payloadLength = 0;
+        header->status = COPROCESSOR_STATUS_FAILURE;
+
+        return true;
+    }
 
-            // basically, we're stating that if we have a stall for 2 iterations of the loop where the byteCounts are matching, then
-            // we assume we are no longer receiving communication. could have bugs? ie, we could be "done" reading before the data is all written
-            if (byteCount == lastByteCount && byteCount != 0 && lastByteCount != 0) {
+    return receiveRingHead - receiveRingTail >= COPROCESSOR_FRAME_HEADER_SIZE + header->payloadLength;
+}
+
+// what readRingLength hands back when the block ends part way through a length. it has to be
+// checked for before the length is added to anything, or it wraps round to a small number
+#define RING_LENGTH_TRUNCATED 0xFFFFFFFF
+
+// reads one of the 255, 255, ..., n extended lengths from a compressed block
+unsigned long readRingLength(unsigned long *position, unsigned long end) {
+
+    unsigned long length = 0;
+    unsigned char byte;
+
+    do {
+
+        if (*position >= end) {
+
+            return RING_LENGTH_TRUNCATED;
+        }
+
+        byte = receiveRingByte((*position)++);
+        length += byte;
+    } while (byte == 255);
+
+    return length;
+}
+
+// decodes a compressed payload (see COPROCESSOR_FLAG_COMPRESSED) straight out of the ring in to
+// output and NUL terminates it. like copyFromReceiveRing, anything that does not fit in outputSize
+// is cut off. everything here is byte moves, adds and shifts, which the 68000 does quickly, and
+// literals go across with memcpy. returns the decoded length, or -1 if the block is malformed or
+// stops short of the length it starts with
+long decompressFromReceiveRing(char *output, long outputSize, unsigned long start, unsigned long end) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: decompressFromReceiveRing");
+    #endif
 
-                #ifdef DEBUGGING
-                    char debugMessage[100];
-                    sprintf(debugMessage, "receive loop setting last doByteCountsMatch to true: byteCount: %ld, lastByteCount: %ld\n", byteCount, lastByteCount);
-                    writeSerialPortDebug(boutRefNum, debugMessage);
-                #endif
+    unsigned long position = start;
 
-                doByteCountsMatch = true;
+    if (end - position < 4) {
+
+        return -1;
+    }
+
+    unsigned long decodedLength = ((unsigned long)receiveRingByte(position) << 24) |
+                                  ((unsigned long)receiveRingByte(position + 1) << 16) |
+                                  ((unsigned long)receiveRingByte(position + 2) << 8) |
+                                  (unsigned long)receiveRingByte(position + 3);
+    position += 4;
+
+    char *out = output;
+    char *outEnd = output + (decodedLength < (unsigned long)(outputSize - 1) ? decodedLength : (unsigned long)(outputSize - 1));
+
+    while (position < end && out < outEnd) {
+
+        unsigned char token = receiveRingByte(position++);
+        unsigned long literalLength = token >> 4;
+        unsigned long extraLength;
+
+        if (literalLength == 15) {
+
+            extraLength = readRingLength(&position, end);
+
+            if (extraLength == RING_LENGTH_TRUNCATED) {
+
+                return -1;
             }
+
+            literalLength += extraLength;
         }
 
-        #ifdef DEBUGGING
-            char debugMessage[100];
-            sprintf(debugMessage, "receive loop complete: byteCount: %ld, lastByteCount: %ld", byteCount, lastByteCount);
-            writeSerialPortDebug(boutRefNum, debugMessage);
-        #endif
+        if (literalLength > end - position) {
 
-        incomingSerialPortReference.ioReqCount = byteCount;
+            return -1;
+        }
 
-        #ifdef PRINT_ERRORS
-            OSErr err = PBRead((ParmBlkPtr)&incomingSerialPortReference, 0);
+        long literalsToCopy = outEnd - out < (long)literalLength ? outEnd - out : (long)literalLength;
 
-            char errMessage[100];
-            sprintf(errMessage, "err:%d", err);
-            writeSerialPortDebug(boutRefNum, errMessage);
-        #else
+        copyRingBytes(out, position, literalsToCopy);
+        out += literalsToCopy;
+        position += literalLength;
 
-            PBRead((ParmBlkPtr)&incomingSerialPortReference, 0);
-        #endif
+        // the last sequence is only literals
+        if (position >= end || out >= outEnd) {
 
-        memcpy(tempOutput, GlobalSerialInputBuffer, byteCount);
+            break;
+        }
 
-        totalByteCount += byteCount;
+        if (end - position < 2) {
 
-        if (strstr(tempOutput, ";;@@&&") != NULL) {
+            return -1;
+        }
 
-            #ifdef DEBUGGING
+        unsigned short offset = (receiveRingByte(position) << 8) | receiveRingByte(position + 1);
+        unsigned long matchLength = token & 0x0F;
 
-                writeSerialPortDebug(boutRefNum, "done building temp output");
-                writeSerialPortDebug(boutRefNum, tempOutput);
+        position += 2;
 
-                // char debugOutput[255];
-                // char tempString[MAX_RECEIVE_SIZE];
-                // strncat(tempString, tempOutput, totalByteCount);
-                // sprintf(debugOutput, "\n'%ld'\n", strlen(tempString));
-                // writeSerialPortDebug(boutRefNum, debugOutput);
-                // writeSerialPortDebug(boutRefNum, "\ndone with output\n");
-                // writeSerialPortDebug(boutRefNum, "\n");
-            #endif
+        if (matchLength == 15) {
 
-            done = true;
-        } else {
+            extraLength = readRingLength(&position, end);
 
-            #ifdef DEBUGGING
-                writeSerialPortDebug(boutRefNum, "receive loop complete, but terminator is missing");
-                writeSerialPortDebug(boutRefNum, tempOutput);
-            #endif
+            if (extraLength == RING_LENGTH_TRUNCATED) {
+
+                return -1;
+            }
+
+            matchLength += extraLength;
+        }
+
+        matchLength += 4;
+
+        if (offset == 0 || offset > out - output) {
+
+            return -1;
+        }
+
+        if ((long)matchLength > outEnd - out) {
 
-            done = true;
+            matchLength = outEnd - out;
+        }
+
+        // matches can overlap the bytes they produce (a run is a match at offset 1), so this has
+        // to go a byte at a time
+        char *match = out - offset;
+
+        while (matchLength--) {
+
+            *out++ = *match++;
         }
     }
 
-    // attach the gathered up output from the buffer to the output variable
-    memcpy(output, tempOutput, totalByteCount);
+    *out = '\0';
 
-    #ifdef DEBUGGING
-        writeSerialPortDebug(boutRefNum, "coprocessor.readSerialPort complete, output:");
-        writeSerialPortDebug(boutRefNum, output);
+    // a block cut off between two sequences still decodes cleanly, just to less than it should
+    if (out < outEnd) {
+
+        return -1;
+    }
+
+    return out - output;
+}
+
+// copies the payload of the frame found by peekFrameInReceiveRing straight in to output and
+// moves past the frame. output is always NUL terminated, and is truncated to fit outputSize.
+// returns the number of bytes written to output, not counting the terminator
+long consumeFrame(CoprocessorFrameHeader *header, char *output, long outputSize) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: consumeFrame");
     #endif
 
-    // once we are done reading the buffer entirely, we need to clear it. i'm not sure if this is the best way or not but seems to work
-    memset(GlobalSerialInputBuffer, '\0', MAX_RECEIVE_SIZE);
+    unsigned long payloadStart = receiveRingTail + COPROCESSOR_FRAME_HEADER_SIZE;
+    long length = 0;
 
-    return;
+    if (output != NULL && (header->flags & COPROCESSOR_FLAG_COMPRESSED)) {
+
+        #ifdef PROFILING
+            long decompressStartTicks = TickCount();
+        #endif
+
+        long decodedLength = decompressFromReceiveRing(output, outputSize, payloadStart, payloadStart + header->payloadLength);
+
+        if (decodedLength < 0) {
+
+            #ifdef PRINT_ERRORS
+                writeSerialPortDebug(boutRefNum, "consumeFrame: malformed compressed payload");
+            #endif
+
+            output[0] = '\0';
+        }
+
+        length = decodedLength < 0 ? 0 : decodedLength;
+
+        #ifdef PROFILING
+            coprocessorStats.bytesDecompressed += decodedLength < 0 ? 0 : decodedLength;
+            coprocessorStats.decompressTicks += TickCount() - decompressStartTicks;
+        #endif
+    } else if (output != NULL) {
+
+        copyFromReceiveRing(output, outputSize, payloadStart, payloadStart + header->payloadLength);
+        length = header->payloadLength < (unsigned long)(outputSize - 1) ? header->payloadLength : outputSize - 1;
+    }
+
+    coprocessorStats.bytesCopied += length;
+    receiveRingTail = payloadStart + header->payloadLength;
+
+    return length;
 }
 
+// the zero copy alternative to consumeFrame: if the payload is sitting in the ring in one piece, as
+// it is unless it happens to wrap or is compressed, view is pointed right at it and the frame is
+// moved past with nothing copied. the bytes stay pinned until releaseCoprocessorView
+Boolean viewFrameInReceiveRing(CoprocessorFrameHeader *header, CoprocessorView *view) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: viewFrameInReceiveRing");
+    #endif
 
-OSErr writeSerialPort(const char* stringToWrite) {
+    unsigned long payloadStart = receiveRingTail + COPROCESSOR_FRAME_HEADER_SIZE;
+    unsigned long payloadOffset = payloadStart & RECEIVE_RING_MASK;
+
+    if ((header->flags & COPROCESSOR_FLAG_COMPRESSED) || payloadOffset + header->payloadLength > RECEIVE_RING_SIZE) {
+
+        return false;
+    }
+
+    if (pinnedViewCount == 0 || payloadStart < receiveRingPin) {
+
+        receiveRingPin = payloadStart;
+    }
+
+    pinnedViewCount++;
+
+    view->data = &receiveRing[payloadOffset];
+    view->length = header->payloadLength;
+    receiveRingTail = payloadStart + header->payloadLength;
+
+    return true;
+}
+
+OSErr writeSerialPort(const char* bytesToWrite, long length) {
 
     #ifdef DEBUG_FUNCTION_CALLS
         writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: writeSerialPort");
@@ -380,8 +772,9 @@ OSErr writeSerialPort(const char* stringToWrite) {
         writeSerialPortDebug(boutRefNum, "writeSerialPort");
     #endif
 
-    outgoingSerialPortReference.ioBuffer = (Ptr)stringToWrite;
-    outgoingSerialPortReference.ioReqCount = strlen(stringToWrite);
+    outgoingSerialPortReference.ioBuffer = (Ptr)bytesToWrite;
+    outgoingSerialPortReference.ioReqCount = length;
+    coprocessorStats.bytesWritten += length;
     
     #ifdef DEBUGGING
 
@@ -411,10 +804,13 @@ void setupCoprocessor(char *applicationId, const char *serialDeviceName) {
     #endif
 
     GlobalSerialInputBuffer = malloc(sizeof(char) * MAX_RECEIVE_SIZE);
-    tempOutput = malloc(sizeof(char) * MAX_RECEIVE_SIZE);
-    application_id = malloc(sizeof(char) * 255);
-    
-    strcpy(application_id, applicationId);
+    receiveRing = malloc(sizeof(char) * RECEIVE_RING_SIZE);
+
+    // frames carry the application id as an integer, so fold the name down to 16 bits
+    for (char *c = applicationId; *c != '\0'; c++) {
+
+        application_id = application_id * 31 + (unsigned char)*c;
+    }
 
     setupSerialPort(serialDeviceName);
 
@@ -439,179 +835,307 @@ OSErr closeSerialPort() {
     return err;
 }
 
-// return value is char but this is only for error messages - final param is output variable that will be re-assigned within this function
-char* _getReturnValueFromResponse(char* response, char* application_id, char* call_counter, char* operation, char* output) {
+OSErr writeFrameToCoprocessor(unsigned char opcode, unsigned char flags, unsigned short callId, const char *payload, unsigned long payloadLength) {
 
     #ifdef DEBUG_FUNCTION_CALLS
-        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: _getReturnValueFromResponse");
-    #endif
-    
-    #ifdef DEBUGGING
-        
-        writeSerialPortDebug(boutRefNum, "_getReturnValueFromResponse\n");
-        writeSerialPortDebug(boutRefNum, response);
-        writeSerialPortDebug(boutRefNum, "\n");
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: writeFrameToCoprocessor");
     #endif
 
-    // get the first token in to memory
-    char *token = strtokm(response, ";;;");
-    
-    // we need to track the token that we are on because the coprocessor.js responses are standardized
-    // so the tokens at specific positions will map to specific items in the response
-    int tokenCounter = 0;
+    CoprocessorFrameHeader header;
+    unsigned char headerBytes[COPROCESSOR_FRAME_HEADER_SIZE];
 
-    // loop through the string to extract all other tokens
-    while (token != NULL) {
+    header.version = COPROCESSOR_FRAME_VERSION;
+    header.opcode = opcode;
+    header.status = COPROCESSOR_STATUS_SUCCESS;
+    header.flags = flags;
+    header.applicationId = application_id;
+    header.callId = callId;
+    header.payloadLength = payloadLength;
 
-        if (tokenCounter > MAX_ATTEMPTS) {
+    encodeFrameHeader(headerBytes, &header);
 
-            return "max attempts exceeded";
-        }
+    // the payload goes out straight from the caller's buffer, there is no need to build the whole frame in memory
+    OSErr err = writeSerialPort((const char *)headerBytes, COPROCESSOR_FRAME_HEADER_SIZE);
 
-        #ifdef DEBUGGING
+    if (err == noErr && payloadLength > 0) {
 
-            char debugOutput[MAX_RECEIVE_SIZE];
-            sprintf(debugOutput, "inspect token %d: %s\n", tokenCounter, token);
-            writeSerialPortDebug(boutRefNum, debugOutput);
-        #endif
+        err = writeSerialPort(payload, payloadLength);
+    }
 
-        switch (tokenCounter) {
+    #ifdef PRINT_ERRORS
 
-            case 0: // APPLICATION ID
+        char errMessage[100];
+        sprintf(errMessage, "writeFrameToCoprocessor err:%d\n", err);
+        writeSerialPortDebug(boutRefNum, errMessage);
+    #endif
 
-                if (strcmp(token, application_id) != 0) {
+    return err;
+}
 
-                    return "application id mismatch"; // TODO figure out better error handling
-                }
+// return value is char but this is only for error messages
+char* checkFrameHeaderForCall(CoprocessorFrameHeader *header, CoprocessorCall *call) {
 
-                break;
-            case 1: // CALL COUNTER
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: checkFrameHeaderForCall");
+    #endif
 
-                if (strcmp(token, call_counter) != 0) {
+    if (header->version != COPROCESSOR_FRAME_VERSION) {
 
-                    return "call counter mismatch"; // TODO figure out better error handling
-                }
- 
-                break;
-            case 2: // OPERATION
+        return "frame version mismatch";
+    }
 
-                if (strcmp(token, operation) != 0) {
+    if (header->applicationId != application_id) {
 
-                    return "operation mismatch"; // TODO figure out better error handling
-                }
+        return "application id mismatch"; // TODO figure out better error handling
+    }
 
-                break;
-            case 3: // STATUS
+    if (header->callId != call->callId) {
 
-                if (strcmp(token, "SUCCESS") != 0) {
+        return "call counter mismatch"; // TODO figure out better error handling
+    }
 
-                    return "operation failed"; // TODO figure out better error handling
-                }
+    if (header->opcode != call->opcode) {
 
-                break;
-            case 4:;
-            
-                #ifdef DEBUGGING
+        return "operation mismatch"; // TODO figure out better error handling
+    }
 
-                    writeSerialPortDebug(boutRefNum, "setting output to token:\n");
-                    writeSerialPortDebug(boutRefNum, token);
-                    char debugOutput[255];
-                    sprintf(debugOutput, "\n'%ld'\n", strlen(token));
-                    writeSerialPortDebug(boutRefNum, debugOutput);
-                    writeSerialPortDebug(boutRefNum, "\ndone with output\n");
-                #endif
+    if (header->status != COPROCESSOR_STATUS_SUCCESS) {
 
-                int lengthWithoutControlChars = strlen(token) - 6;
+        return "operation failed"; // TODO figure out better error handling
+    }
 
-                // writeSerialPortDebug(boutRefNum, "SETTING OUTPUT VARIABLE");
-                // char x[2555];
-                // sprintf(x, "%s: %d (%.*s)", token, lengthWithoutControlChars, lengthWithoutControlChars, token);
-                // writeSerialPortDebug(boutRefNum, x);
-                // this seems to be the location where we can sometimes mangle our response data
-                sprintf(output, "%.*s", lengthWithoutControlChars, token); // drop the ;;@@&& off the end of the response
+    return NULL;
+}
 
-                #ifdef DEBUGGING
-                    writeSerialPortDebug(boutRefNum, output);
-                #endif
+void setCoprocessorEventHandler(CoprocessorEventHandler handler, char *output, long outputSize) {
 
-                return NULL;
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: setCoprocessorEventHandler");
+    #endif
 
-            default:
+    eventHandler = handler;
+    eventOutput = output;
+    eventOutputSize = outputSize;
+}
 
-                break;
-        }
+void dispatchEventFrame(CoprocessorFrameHeader *header) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: dispatchEventFrame");
+    #endif
+
+    if (eventHandler == NULL || header->version != COPROCESSOR_FRAME_VERSION || header->applicationId != application_id || header->status != COPROCESSOR_STATUS_SUCCESS) {
+
+        #ifdef PRINT_ERRORS
+            writeSerialPortDebug(boutRefNum, "dispatchEventFrame: dropping event");
+        #endif
+
+        consumeFrame(header, NULL, 0);
 
-        // get the next token. strtokm has some weird syntax
-        token = strtokm(NULL, ";;;");
-        tokenCounter++;
+        return;
     }
 
-    return NULL;
+    consumeFrame(header, eventOutput, eventOutputSize);
+    eventHandler(eventOutput);
 }
 
-void writeToCoprocessor(char* operation, char* operand) {
+Boolean coprocessorCallInFlight() {
 
     #ifdef DEBUG_FUNCTION_CALLS
-        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: writeToCoprocessor");
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: coprocessorCallInFlight");
     #endif
-    
-    #ifdef DEBUGGING
-        
-        writeSerialPortDebug(boutRefNum, "writeToCoprocessor\n");
+
+    return pendingCallCount > 0;
+}
+
+void removePendingCall(short index) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: removePendingCall");
     #endif
 
-    const char* messageTemplate = "%s;;;%s;;;%s;;;%s;;@@&&"; // see: https://github.com/CamHenlin/coprocessor.js/blob/main/index.js#L25
-    char call_id[32];
+    // keep the table in the order the calls were made so that pendingCalls[0] is always the oldest
+    for (short i = index; i < pendingCallCount - 1; i++) {
 
-    // over-allocate by 1kb for the operand (which could be an entire nodejs app) + message template wrapper
-    // and other associated info. wasting a tiny bit of memory here, could get more precise if memory becomes a problem.
-    char messageToSend[strlen(operand) + 1024];
+        pendingCalls[i] = pendingCalls[i + 1];
+    }
 
-    sprintf(call_id, "%d", call_counter++);
+    pendingCallCount--;
+}
 
-    // application_id is globally defined for now, how will that work in a library?
-    sprintf(messageToSend, messageTemplate, application_id, call_id, operation, operand);
+// hands every complete frame in the ring to the call that is waiting for it
+void dispatchReceivedFrames() {
 
-    #ifdef PRINT_ERRORS
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: dispatchReceivedFrames");
+    #endif
 
-        OSErr err = writeSerialPort(messageToSend);
+    CoprocessorFrameHeader header;
 
-        char errMessage[100];
-        sprintf(errMessage, "writeToCoprocessor err:%d\n", err);
-        writeSerialPortDebug(boutRefNum, errMessage);
-    #else
-        writeSerialPort(messageToSend);
+    while (peekFrameInReceiveRing(&header)) {
+
+        if (header.opcode == COPROCESSOR_OPCODE_EVENT) {
+
+            dispatchEventFrame(&header);
+
+            continue;
+        }
+
+        short index = 0;
+
+        while (index < pendingCallCount && pendingCalls[index]->callId != header.callId) {
+
+            index++;
+        }
+
+        if (index == pendingCallCount) {
+
+            // most likely the late answer to a call that already timed out
+            #ifdef PRINT_ERRORS
+                writeSerialPortDebug(boutRefNum, "dispatchReceivedFrames: no call waiting for this call id, dropping frame");
+            #endif
+
+            consumeFrame(&header, NULL, 0);
+
+            continue;
+        }
+
+        CoprocessorCall *call = pendingCalls[index];
+        char *err = checkFrameHeaderForCall(&header, call);
+
+        if (err != NULL) {
+
+            #ifdef PRINT_ERRORS
+                writeSerialPortDebug(boutRefNum, "error getting return value from response:");
+                writeSerialPortDebug(boutRefNum, err);
+            #endif
+
+            consumeFrame(&header, NULL, 0);
+            call->status = header.status != COPROCESSOR_STATUS_SUCCESS ? header.status : COPROCESSOR_STATUS_FAILURE;
+            call->view.data = call->output;
+            call->view.length = 0;
+        } else if (call->wantsView && viewFrameInReceiveRing(&header, &call->view)) {
+
+            call->viewPinned = true;
+            call->status = COPROCESSOR_STATUS_SUCCESS;
+        } else {
+
+            call->view.data = call->output;
+            call->view.length = consumeFrame(&header, call->output, call->outputSize);
+            call->status = COPROCESSOR_STATUS_SUCCESS;
+        }
+
+        call->state = COPROCESSOR_CALL_COMPLETE;
+        removePendingCall(index);
+    }
+}
+
+// returns true once the call has finished, either with its response copied in to the call's output
+// or with a timeout. the caller should inspect call->state and then set it back to COPROCESSOR_CALL_IDLE
+Boolean pollCoprocessorCall(CoprocessorCall *call) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: pollCoprocessorCall");
     #endif
 
-    return;
+    if (call->state != COPROCESSOR_CALL_PENDING) {
+
+        return call->state != COPROCESSOR_CALL_IDLE;
+    }
+
+    pumpSerialReceive();
+    dispatchReceivedFrames();
+
+    if (call->state != COPROCESSOR_CALL_PENDING) {
+
+        return true;
+    }
+
+    if (call->timeoutTicks > 0 && TickCount() - call->startTicks > call->timeoutTicks) {
+
+        #ifdef DEBUGGING
+            writeSerialPortDebug(boutRefNum, "pollCoprocessorCall: TIMEOUT_ERROR");
+        #endif
+
+        for (short i = 0; i < pendingCallCount; i++) {
+
+            if (pendingCalls[i] == call) {
+
+                removePendingCall(i);
+
+                break;
+            }
+        }
+
+        call->state = COPROCESSOR_CALL_TIMED_OUT;
+
+        return true;
+    }
+
+    return false;
 }
 
-// must be called after writeToCoprocessor and before other writeToCoprocessor
-// operations because we depend on the location of call_counter
-void getReturnValueFromResponse(char *response, char *operation, char *output) {
+// picks up any EVENT frames the coprocessor has pushed to us without blocking. SerGetBuf tells us
+// whether anything is waiting, so this costs next to nothing when the line is quiet
+void pollCoprocessorEvents() {
 
     #ifdef DEBUG_FUNCTION_CALLS
-        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: getReturnValueFromResponse");
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: pollCoprocessorEvents");
     #endif
 
-    #ifdef DEBUGGING
-        writeSerialPortDebug(boutRefNum, "getReturnValueFromResponse");
+    pumpSerialReceive();
+    dispatchReceivedFrames();
+}
+
+void waitForCoprocessorCall(CoprocessorCall *call) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: waitForCoprocessorCall");
     #endif
 
-    char call_id[32];
-    sprintf(call_id, "%d", call_counter - 1);
-    
-    #ifdef PRINT_ERRORS
-        char *err = _getReturnValueFromResponse(response, application_id, call_id, operation, output);
+    while (!pollCoprocessorCall(call)) {
 
-        if (err != NULL) {
-            
-            writeSerialPortDebug(boutRefNum, "error getting return value from response:");
-            writeSerialPortDebug(boutRefNum, err);
+        // nothing to do but let the driver keep filling the ring
     }
-    #else
-        _getReturnValueFromResponse(response, application_id, call_id, operation, output);
+}
+
+// writes the request and hands back immediately; the response is collected by pollCoprocessorCall
+void startCoprocessorCall(unsigned char opcode, unsigned char flags, const char *operand, unsigned long operandLength, char *output, long outputSize, long timeoutTicks, CoprocessorCall *call) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: startCoprocessorCall");
     #endif
+
+    // if the table is full, make room by finishing the oldest call
+    if (pendingCallCount == MAX_PENDING_CALLS) {
+
+        waitForCoprocessorCall(pendingCalls[0]);
+    }
+
+    output[0] = '\0';
+
+    call->state = COPROCESSOR_CALL_PENDING;
+    call->callId = call_counter++;
+    call->opcode = opcode;
+    call->status = COPROCESSOR_STATUS_FAILURE;
+    call->wantsView = false;
+    call->viewPinned = false;
+    call->view.data = output;
+    call->view.length = 0;
+    call->output = output;
+    call->outputSize = outputSize;
+    call->startTicks = TickCount();
+    call->timeoutTicks = timeoutTicks;
+
+    pendingCalls[pendingCallCount++] = call;
+    coprocessorStats.roundTrips++;
+
+    // no answer is coming for a request that never went out, so there is no point waiting for one
+    if (writeFrameToCoprocessor(opcode, flags, call->callId, operand, operandLength) != noErr) {
+
+        removePendingCall(pendingCallCount - 1);
+        call->state = COPROCESSOR_CALL_COMPLETE;
+    }
 }
 
 // TODO: these should all bubble up and return legible errors
@@ -627,56 +1151,212 @@ void sendProgramToCoprocessor(char* program, char *output) {
 
     SetCursor(*GetCursor(watchCursor));
 
-    writeToCoprocessor("PROGRAM", program);
+    CoprocessorCall call;
 
-    char serialPortResponse[MAX_RECEIVE_SIZE];
-    readSerialPort(serialPortResponse);
-
-    getReturnValueFromResponse(serialPortResponse, "PROGRAM", output);
+    // the coprocessor may need to install dependencies for the program, so there is no timeout here
+    startCoprocessorCall(COPROCESSOR_OPCODE_PROGRAM, 0, program, strlen(program), output, MAX_RECEIVE_SIZE, 0, &call);
+    waitForCoprocessorCall(&call);
 
     SetCursor(&qd.arrow);
     
     return;
 }
 
-void callFunctionOnCoprocessor(char* functionName, char* parameters, char* output) {
+// the same as sendProgramToCoprocessor, for a program that compile_js.sh has already compressed
+// (see COPROCESSOR_FLAG_COMPRESSED). this is a lot less to push through the serial port at startup
+void sendCompressedProgramToCoprocessor(const char* program, unsigned long programLength, char *output) {
 
     #ifdef DEBUG_FUNCTION_CALLS
-        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: callFunctionOnCoprocessor");
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: sendCompressedProgramToCoprocessor");
+    #endif
+
+    SetCursor(*GetCursor(watchCursor));
+
+    CoprocessorCall call;
+
+    startCoprocessorCall(COPROCESSOR_OPCODE_PROGRAM, COPROCESSOR_FLAG_COMPRESSED, program, programLength, output, MAX_RECEIVE_SIZE, 0, &call);
+    waitForCoprocessorCall(&call);
+
+    SetCursor(&qd.arrow);
+
+    return;
+}
+
+// asks the coprocessor to run the program with this hash (see OUTPUT_JS_HASH from compile_js.sh)
+// out of its on disk cache. returns true if it did, in which case output holds the same result an
+// upload would have given. otherwise the program needs to be uploaded. any answer other than
+// success is a miss the moment it arrives, whether the program is not cached or the coprocessor
+// does not know the probe (COPROCESSOR_STATUS_UNKNOWN_OPCODE), and so is a request that could not
+// be written. PROGRAM_HASH_TIMEOUT_TICKS is only sat out if nothing comes back at all
+Boolean sendProgramHashToCoprocessor(const char* programHash, char *output) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: sendProgramHashToCoprocessor");
+    #endif
+
+    SetCursor(*GetCursor(watchCursor));
+
+    CoprocessorCall call;
+
+    startCoprocessorCall(COPROCESSOR_OPCODE_PROGRAM_HASH, 0, programHash, strlen(programHash), output, MAX_RECEIVE_SIZE, PROGRAM_HASH_TIMEOUT_TICKS, &call);
+    waitForCoprocessorCall(&call);
+
+    SetCursor(&qd.arrow);
+
+    return call.state == COPROCESSOR_CALL_COMPLETE && call.status == COPROCESSOR_STATUS_SUCCESS;
+}
+
+void beginCoprocessorArguments(CoprocessorArguments *arguments, char *buffer, long size) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: beginCoprocessorArguments");
+    #endif
+
+    arguments->data = buffer;
+    arguments->size = size;
+    arguments->length = 0;
+    arguments->count = 0;
+    arguments->full = false;
+}
+
+// adds `<length>:<argument>`. returns false, leaving the arguments as they were and marking them
+// full, if it does not fit
+Boolean addCoprocessorArgument(CoprocessorArguments *arguments, const char *data, long length) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: addCoprocessorArgument");
+    #endif
+
+    char prefix[16];
+    int prefixLength = sprintf(prefix, "%ld:", length);
+
+    if (length < 0 || arguments->length + prefixLength + length > arguments->size) {
+
+        #ifdef PRINT_ERRORS
+            writeSerialPortDebug(boutRefNum, "addCoprocessorArgument: no room for the argument");
+        #endif
+
+        arguments->full = true;
+
+        return false;
+    }
+
+    memcpy(&arguments->data[arguments->length], prefix, prefixLength);
+    memcpy(&arguments->data[arguments->length + prefixLength], data, length);
+    arguments->length += prefixLength + length;
+    arguments->count++;
+
+    return true;
+}
+
+Boolean addCoprocessorStringArgument(CoprocessorArguments *arguments, const char *string) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: addCoprocessorStringArgument");
+    #endif
+
+    return addCoprocessorArgument(arguments, string, strlen(string));
+}
+
+// index.js gets every argument as a string, numbers included
+Boolean addCoprocessorNumberArgument(CoprocessorArguments *arguments, long number) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: addCoprocessorNumberArgument");
+    #endif
+
+    char digits[16];
+
+    return addCoprocessorArgument(arguments, digits, sprintf(digits, "%ld", number));
+}
+
+// arguments can be NULL for a function that takes none. if they were marked full, the call is not
+// made at all, and completes at once with nothing in output
+void callFunctionOnCoprocessorAsync(char* functionName, CoprocessorArguments *arguments, char* output, long outputSize, CoprocessorCall *call) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: callFunctionOnCoprocessorAsync");
     #endif
     
     #ifdef DEBUGGING
 
-        writeSerialPortDebug(boutRefNum, "callFunctionOnCoprocessor\n");
+        writeSerialPortDebug(boutRefNum, "callFunctionOnCoprocessorAsync\n");
     #endif
 
-    const char* functionTemplate = "%s&&&%s";
+    long argumentsLength = arguments != NULL ? arguments->length : 0;
 
-    // over-allocate by 1kb for the operand (which could be whatever a programmer sends to this function) + message template wrapper
-    // and other associated info. wasting a tiny bit of memory here, could get more precise if memory becomes a problem.
-    char functionCallMessage[strlen(parameters) + 1024];
+    if (arguments != NULL && arguments->full) {
 
-    // delimeter for function paramters is &&& - user must do this on their own via sprintf call or other construct - this is easiest for us to deal with
-    sprintf(functionCallMessage, functionTemplate, functionName, parameters);
+        output[0] = '\0';
+        call->state = COPROCESSOR_CALL_COMPLETE;
+        call->status = COPROCESSOR_STATUS_FAILURE;
+        call->wantsView = false;
+        call->viewPinned = false;
+        call->view.data = output;
+        call->view.length = 0;
+        call->output = output;
 
-    SetCursor(*GetCursor(watchCursor));
+        return;
+    }
 
-    #ifdef DEBUGGING
-        writeSerialPortDebug(boutRefNum, functionCallMessage);
+    // the function name goes first, length prefixed the same as the arguments after it
+    char functionCallMessage[strlen(functionName) + argumentsLength + 16];
+    CoprocessorArguments message;
+
+    beginCoprocessorArguments(&message, functionCallMessage, sizeof(functionCallMessage));
+    addCoprocessorStringArgument(&message, functionName);
+
+    if (argumentsLength > 0) {
+
+        memcpy(&functionCallMessage[message.length], arguments->data, argumentsLength);
+        message.length += argumentsLength;
+    }
+
+    startCoprocessorCall(COPROCESSOR_OPCODE_FUNCTION, 0, functionCallMessage, message.length, output, outputSize, FUNCTION_CALL_TIMEOUT_TICKS, call);
+}
+
+// like callFunctionOnCoprocessorAsync, but the response is left in the receive ring and handed back
+// as call->view. output is only filled in if the response is compressed or wraps around the end of
+// the ring. call releaseCoprocessorView once finished with the response
+void callFunctionOnCoprocessorViewAsync(char* functionName, CoprocessorArguments *arguments, char* output, long outputSize, CoprocessorCall *call) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: callFunctionOnCoprocessorViewAsync");
     #endif
 
-    writeToCoprocessor("FUNCTION", functionCallMessage);
+    // nothing is dispatched until the call is next polled, so it is safe to set this afterwards
+    callFunctionOnCoprocessorAsync(functionName, arguments, output, outputSize, call);
+    call->wantsView = true;
+}
 
-    char serialPortResponse[MAX_RECEIVE_SIZE];
-    readSerialPort(serialPortResponse);
+void releaseCoprocessorView(CoprocessorCall *call) {
 
-    #ifdef DEBUGGING
-        writeSerialPortDebug(boutRefNum, "Got response from serial port:");
-        writeSerialPortDebug(boutRefNum, serialPortResponse);
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: releaseCoprocessorView");
     #endif
 
-    memset(output, '\0', RECEIVE_WINDOW_SIZE);
-    getReturnValueFromResponse(serialPortResponse, "FUNCTION", output);
+    if (call->viewPinned) {
+
+        call->viewPinned = false;
+        pinnedViewCount--;
+    }
+
+    call->view.data = call->output;
+    call->view.length = 0;
+}
+
+void callFunctionOnCoprocessor(char* functionName, CoprocessorArguments *arguments, char* output) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: callFunctionOnCoprocessor");
+    #endif
+
+    SetCursor(*GetCursor(watchCursor));
+
+    CoprocessorCall call;
+
+    callFunctionOnCoprocessorAsync(functionName, arguments, output, MAX_RECEIVE_SIZE, &call);
+    waitForCoprocessorCall(&call);
 
     #ifdef DEBUGGING
         writeSerialPortDebug(boutRefNum, "Got return value from response");
@@ -688,6 +1368,125 @@ void callFunctionOnCoprocessor(char* functionName, char* parameters, char* outpu
     return;
 }
 
+void beginCoprocessorBatch(CoprocessorBatch *batch) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: beginCoprocessorBatch");
+    #endif
+
+    batch->callCount = 0;
+    beginCoprocessorArguments(&batch->arguments, batch->payload, COPROCESSOR_BATCH_PAYLOAD_SIZE);
+}
+
+// arguments can be NULL for a function that takes none. returns false, leaving the batch as it
+// was, if the call does not fit
+Boolean addFunctionToCoprocessorBatch(CoprocessorBatch *batch, char* functionName, CoprocessorArguments *arguments) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: addFunctionToCoprocessorBatch");
+    #endif
+
+    long argumentsLength = arguments != NULL ? arguments->length : 0;
+    long lengthBefore = batch->arguments.length;
+    short countBefore = batch->arguments.count;
+
+    if (batch->callCount == COPROCESSOR_BATCH_MAX_CALLS || (arguments != NULL && arguments->full)) {
+
+        return false;
+    }
+
+    // the call's own arguments are already length prefixed, so they go in as they are, after the
+    // count that tells the coprocessor where they end
+    if (!addCoprocessorStringArgument(&batch->arguments, functionName) ||
+        !addCoprocessorNumberArgument(&batch->arguments, arguments != NULL ? arguments->count : 0) ||
+        batch->arguments.length + argumentsLength > batch->arguments.size) {
+
+        #ifdef PRINT_ERRORS
+            writeSerialPortDebug(boutRefNum, "addFunctionToCoprocessorBatch: batch is full");
+        #endif
+
+        batch->arguments.length = lengthBefore;
+        batch->arguments.count = countBefore;
+        batch->arguments.full = false;
+
+        return false;
+    }
+
+    if (argumentsLength > 0) {
+
+        memcpy(&batch->arguments.data[batch->arguments.length], arguments->data, argumentsLength);
+        batch->arguments.length += argumentsLength;
+        batch->arguments.count += arguments->count;
+    }
+
+    batch->callCount++;
+
+    return true;
+}
+
+void callBatchOnCoprocessorAsync(CoprocessorBatch *batch, char* output, long outputSize, CoprocessorCall *call) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: callBatchOnCoprocessorAsync");
+    #endif
+
+    callFunctionOnCoprocessorAsync("batch", &batch->arguments, output, outputSize, call);
+}
+
+void callBatchOnCoprocessorViewAsync(CoprocessorBatch *batch, char* output, long outputSize, CoprocessorCall *call) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: callBatchOnCoprocessorViewAsync");
+    #endif
+
+    callFunctionOnCoprocessorViewAsync("batch", &batch->arguments, output, outputSize, call);
+}
+
+// splits a batch response in to a view of each call's result, without copying or modifying it.
+// returns how many results were found, which is less than the number of calls if the response was
+// truncated or malformed
+short splitCoprocessorBatchResults(CoprocessorView *response, CoprocessorView *results, short maxResults) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: splitCoprocessorBatchResults");
+    #endif
+
+    const char *cursor = response->data;
+    const char *end = response->data + response->length;
+    short resultCount = 0;
+
+    while (cursor < end && resultCount < maxResults) {
+
+        long length = 0;
+        const char *digits = cursor;
+
+        // the response is not NUL terminated, so we can not hand this to strtol
+        while (cursor < end && *cursor >= '0' && *cursor <= '9') {
+
+            length = length * 10 + (*cursor++ - '0');
+        }
+
+        if (cursor == digits || cursor == end || *cursor != ':' || length > end - cursor - 1) {
+
+            #ifdef PRINT_ERRORS
+                writeSerialPortDebug(boutRefNum, "splitCoprocessorBatchResults: malformed or truncated batch response");
+            #endif
+
+            break;
+        }
+
+        cursor++;
+
+        results[resultCount].data = cursor;
+        results[resultCount].length = length;
+        resultCount++;
+
+        cursor += length;
+    }
+
+    return resultCount;
+}
+
 void callEvalOnCoprocessor(char* toEval, char* output) {
 
     #ifdef DEBUG_FUNCTION_CALLS
@@ -698,11 +1497,10 @@ void callEvalOnCoprocessor(char* toEval, char* output) {
         writeSerialPortDebug(boutRefNum, "callEvalOnCoprocessor\n");
     #endif
 
-    writeToCoprocessor("EVAL", toEval);
+    CoprocessorCall call;
 
-    char serialPortResponse[MAX_RECEIVE_SIZE];
-    readSerialPort(serialPortResponse);
-    getReturnValueFromResponse(serialPortResponse, "EVAL", output);
+    startCoprocessorCall(COPROCESSOR_OPCODE_EVAL, 0, toEval, strlen(toEval), output, MAX_RECEIVE_SIZE, FUNCTION_CALL_TIMEOUT_TICKS, &call);
+    waitForCoprocessorCall(&call);
 
     return;
 }
\ No newline at end of file
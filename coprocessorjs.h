@@ -1,13 +1,185 @@
+#ifndef COPROCESSORJS_H
+#define COPROCESSORJS_H
+
+// every message in either direction is a frame: a fixed 16 byte header followed by payloadLength
+// bytes of payload. the header layout, with multi-byte fields big endian, is:
+//   0-1   magic 'C' 'J'
+//   2     version
+//   3     opcode
+//   4     status (responses only)
+//   5     flags
+//   6-7   application id
+//   8-9   call id
+//   10-13 payload length
+//   14-15 reserved, zero
+// coprocessor/frame.js is the matching codec for the coprocessor side
+#define COPROCESSOR_FRAME_MAGIC_0 'C'
+#define COPROCESSOR_FRAME_MAGIC_1 'J'
+#define COPROCESSOR_FRAME_VERSION 1
+#define COPROCESSOR_FRAME_HEADER_SIZE 16
+
+#define COPROCESSOR_OPCODE_PROGRAM 1
+#define COPROCESSOR_OPCODE_EVAL 2
+#define COPROCESSOR_OPCODE_FUNCTION 3
+#define COPROCESSOR_OPCODE_EVENT 4 // unsolicited, coprocessor to Mac only. the call id is unused
+#define COPROCESSOR_OPCODE_PROGRAM_HASH 5 // asks the coprocessor to run a program it has cached by hash
+
+#define COPROCESSOR_STATUS_SUCCESS 0
+#define COPROCESSOR_STATUS_FAILURE 1
+#define COPROCESSOR_STATUS_UNKNOWN_OPCODE 2 // the coprocessor does not know the request's opcode
+
+// the payload is a 4 byte big endian decoded length followed by an LZ4 style block, with the match
+// offsets big endian. coprocessor/frame.js has the compressor and describes the format
+#define COPROCESSOR_FLAG_COMPRESSED 0x01
+
+typedef struct CoprocessorFrameHeader {
+    unsigned char version;
+    unsigned char opcode;
+    unsigned char status;
+    unsigned char flags;
+    unsigned short applicationId;
+    unsigned short callId;
+    unsigned long payloadLength;
+} CoprocessorFrameHeader;
+
+// a response as (pointer, length). it is not NUL terminated. for calls started with one of the
+// ...ViewAsync functions it usually points straight in to the receive ring, with nothing copied,
+// and the caller must hand it back with releaseCoprocessorView before the ring can reuse the space
+typedef struct CoprocessorView {
+    const char *data;
+    long length;
+} CoprocessorView;
+
+typedef struct CoprocessorTokenizer {
+    const char *cursor;
+    const char *end;
+    const char *delimiter;
+    short delimiterLength;
+    Boolean done;
+} CoprocessorTokenizer;
+
+#define COPROCESSOR_CALL_IDLE 0
+#define COPROCESSOR_CALL_PENDING 1
+#define COPROCESSOR_CALL_COMPLETE 2
+#define COPROCESSOR_CALL_TIMED_OUT 3
+
+// handle for a call that has been written to the coprocessor but whose response may not have
+// arrived yet. start one with callFunctionOnCoprocessorAsync and poll it from the event loop
+typedef struct CoprocessorCall {
+    short state;
+    unsigned short callId;
+    unsigned char opcode;
+    unsigned char status; // COPROCESSOR_STATUS_SUCCESS once the call has completed successfully
+    char *output; // for view calls, only used when the response can not be left in the ring
+    long outputSize;
+    long startTicks;
+    long timeoutTicks; // 0 waits forever
+    Boolean wantsView;
+    Boolean viewPinned;
+    CoprocessorView view; // set for every completed call, wherever the response ended up
+} CoprocessorCall;
+
+// called with the payload of each EVENT frame as it arrives, which is the event name, then &&&, then
+// the event's data. this can run from inside waitForCoprocessorCall, so a handler must not start
+// coprocessor calls of its own
+typedef void (*CoprocessorEventHandler)(char *payload);
+
+// a function call's arguments. each one goes out as `<length>:<argument>`, the same way a batch's
+// results come back, so that an argument can hold anything, our delimiters included. the function
+// name goes in front the same way, see decodeArguments in coprocessor/frame.js for the other
+// side. the caller provides the buffer they are built in
+typedef struct CoprocessorArguments {
+    char *data;
+    long size;
+    long length;
+    short count;
+    Boolean full; // an argument did not fit, so the call is not made
+} CoprocessorArguments;
+
+// a batch runs several functions on the coprocessor for the price of a single round trip. it goes
+// out as one call to the program's `batch` function, with the arguments laid out as a flat list of
+// function name, argument count and that many arguments for each call, and the results come back
+// concatenated as `<length>:<result>`
+#define COPROCESSOR_BATCH_PAYLOAD_SIZE 1024
+#define COPROCESSOR_BATCH_MAX_CALLS 8
+
+typedef struct CoprocessorBatch {
+    short callCount;
+    CoprocessorArguments arguments; // in payload
+    char payload[COPROCESSOR_BATCH_PAYLOAD_SIZE];
+} CoprocessorBatch;
+
+// running totals of serial traffic, so that the cost of the polling done by the event loop can be
+// measured (see PROFILING in mac_main.c)
+typedef struct CoprocessorStats {
+    unsigned long roundTrips;
+    unsigned long bytesWritten;
+    unsigned long bytesReceived;
+    unsigned long bytesCopied; // response bytes copied or decoded out of the receive ring
+    unsigned long bytesDecompressed; // only counted when PROFILING is defined in coprocessorjs.c
+    unsigned long decompressTicks;
+} CoprocessorStats;
+
+extern CoprocessorStats coprocessorStats;
+
 void setupCoprocessor(char *applicationId, const char *serialDeviceName);
 
 void sendProgramToCoprocessor(char* program, char *output);
 
-void callFunctionOnCoprocessor(char* functionName, char* parameters, char* output);
+void sendCompressedProgramToCoprocessor(const char* program, unsigned long programLength, char *output);
+
+Boolean sendProgramHashToCoprocessor(const char* programHash, char *output);
+
+void beginCoprocessorArguments(CoprocessorArguments *arguments, char *buffer, long size);
+
+Boolean addCoprocessorArgument(CoprocessorArguments *arguments, const char *data, long length);
+
+Boolean addCoprocessorStringArgument(CoprocessorArguments *arguments, const char *string);
+
+Boolean addCoprocessorNumberArgument(CoprocessorArguments *arguments, long number);
+
+void callFunctionOnCoprocessor(char* functionName, CoprocessorArguments *arguments, char* output);
+
+void callFunctionOnCoprocessorAsync(char* functionName, CoprocessorArguments *arguments, char* output, long outputSize, CoprocessorCall *call);
+
+void callFunctionOnCoprocessorViewAsync(char* functionName, CoprocessorArguments *arguments, char* output, long outputSize, CoprocessorCall *call);
+
+void releaseCoprocessorView(CoprocessorCall *call);
+
+Boolean pollCoprocessorCall(CoprocessorCall *call);
+
+void waitForCoprocessorCall(CoprocessorCall *call);
+
+Boolean coprocessorCallInFlight();
+
+void setCoprocessorEventHandler(CoprocessorEventHandler handler, char *output, long outputSize);
+
+void pollCoprocessorEvents();
+
+void beginCoprocessorBatch(CoprocessorBatch *batch);
+
+Boolean addFunctionToCoprocessorBatch(CoprocessorBatch *batch, char* functionName, CoprocessorArguments *arguments);
+
+void callBatchOnCoprocessorAsync(CoprocessorBatch *batch, char* output, long outputSize, CoprocessorCall *call);
+
+void callBatchOnCoprocessorViewAsync(CoprocessorBatch *batch, char* output, long outputSize, CoprocessorCall *call);
+
+short splitCoprocessorBatchResults(CoprocessorView *response, CoprocessorView *results, short maxResults);
 
 void callEvalOnCoprocessor(char* toEval, char* output);
 
 void wait(float whatever);
 
-char *strtokm(char *str, const char *delim);
+void beginTokenizer(CoprocessorTokenizer *tokenizer, const char *data, long length, const char *delimiter);
+
+Boolean nextToken(CoprocessorTokenizer *tokenizer, CoprocessorView *token);
+
+Boolean viewEquals(const CoprocessorView *view, const char *string);
+
+Boolean viewStartsWith(const CoprocessorView *view, const char *prefix);
+
+long viewToLong(const CoprocessorView *view);
+
+OSErr closeSerialPort();
 
-OSErr closeSerialPort();
\ No newline at end of file
+#endif
\ No newline at end of file
@@ -0,0 +1,208 @@
+// builds the character width tables the renderer (nuklear_quickdraw.h) and the message wrapper
+// (wrap.c) measure text with, so that neither has to call TextWidth.
+//
+// the tables live in font_metrics.json, keyed by `family-size`, one width per Mac Roman byte. a
+// width of null means the table does not know it, and the Mac measures those with CharWidth the
+// first time it needs them.
+//
+// to add or refresh a font, pull it out of a resource fork (the System file has the system fonts):
+//
+//   node font_metrics.js extract <family> <fontNumber> <size> <resource fork> <FONT|NFNT> <resource id>
+//
+// classic FONT resources are numbered fontNumber * 128 + size, so Chicago 12 is FONT 12 and
+// Geneva 9 is FONT 393. compile_js.sh then runs `node font_metrics.js header`, which writes
+// font_metrics.h from the JSON
+const fs = require(`fs`)
+const path = require(`path`)
+
+const METRICS_PATH = path.join(__dirname, `font_metrics.json`)
+const HEADER_PATH = path.join(__dirname, `font_metrics.h`)
+const CHARACTER_COUNT = 256
+
+// written in to the header as FONT_METRICS_UNKNOWN
+const UNKNOWN_WIDTH = 255
+
+const readMetrics = () => {
+
+  if (!fs.existsSync(METRICS_PATH)) {
+
+    return {}
+  }
+
+  return JSON.parse(fs.readFileSync(METRICS_PATH, `utf8`))
+}
+
+// one row of 16 widths per line, so a diff shows which characters changed
+const writeMetrics = (metrics) => {
+
+  const fonts = Object.keys(metrics).map((key) => {
+
+    const font = metrics[key]
+    const rows = []
+
+    for (let i = 0; i < CHARACTER_COUNT; i += 16) {
+
+      rows.push(`      ${font.widths.slice(i, i + 16).map((width) => `${width}`).join(`, `)}`)
+    }
+
+    return `  ${JSON.stringify(key)}: {\n    "family": ${JSON.stringify(font.family)},\n    "fontNumber": ${font.fontNumber},\n    "size": ${font.size},\n    "widths": [\n${rows.join(`,\n`)}\n    ]\n  }`
+  })
+
+  fs.writeFileSync(METRICS_PATH, `{\n${fonts.join(`,\n`)}\n}\n`)
+}
+
+// finds a resource's data in a resource fork, see Inside Macintosh: More Macintosh Toolbox 1-121
+const findResource = (fork, type, id) => {
+
+  const dataOffset = fork.readUInt32BE(0)
+  const mapOffset = fork.readUInt32BE(4)
+  const typeListOffset = mapOffset + fork.readUInt16BE(mapOffset + 24)
+  const typeCount = fork.readInt16BE(typeListOffset) + 1
+
+  for (let i = 0; i < typeCount; i++) {
+
+    const typeEntry = typeListOffset + 2 + i * 8
+
+    if (fork.toString(`latin1`, typeEntry, typeEntry + 4) !== type) {
+
+      continue
+    }
+
+    const referenceCount = fork.readUInt16BE(typeEntry + 4) + 1
+    const referenceListOffset = typeListOffset + fork.readUInt16BE(typeEntry + 6)
+
+    for (let j = 0; j < referenceCount; j++) {
+
+      const reference = referenceListOffset + j * 12
+
+      if (fork.readInt16BE(reference) !== id) {
+
+        continue
+      }
+
+      // the low 3 bytes of this long are the offset, the high byte is the resource's attributes
+      const resourceOffset = dataOffset + (fork.readUInt32BE(reference + 4) & 0xffffff)
+      const resourceLength = fork.readUInt32BE(resourceOffset)
+
+      return fork.slice(resourceOffset + 4, resourceOffset + 4 + resourceLength)
+    }
+  }
+
+  return undefined
+}
+
+// reads the widths out of a FONT or NFNT resource's offset/width table. characters the font does not
+// have are drawn with its missing symbol, so that is the width they get, same as CharWidth would say
+const widthsFromFont = (font) => {
+
+  const firstChar = font.readInt16BE(2)
+  const lastChar = font.readInt16BE(4)
+  const nDescent = font.readInt16BE(10)
+
+  // owTLoc is counted in words from its own position. fonts too big for 16 bits keep the high word
+  // in nDescent
+  const owTLoc = (nDescent > 0 ? nDescent * 65536 : 0) + font.readUInt16BE(16)
+  const offsetWidthTable = 16 + owTLoc * 2
+  const missingSymbol = lastChar - firstChar + 1
+
+  const entryWidth = (index) => {
+
+    const entry = font.readUInt16BE(offsetWidthTable + index * 2)
+
+    return entry === 0xffff ? undefined : entry & 0xff
+  }
+
+  const missingWidth = entryWidth(missingSymbol) || 0
+  const widths = []
+
+  for (let character = 0; character < CHARACTER_COUNT; character++) {
+
+    const width = character >= firstChar && character <= lastChar ? entryWidth(character - firstChar) : undefined
+
+    widths.push(width === undefined ? missingWidth : width)
+  }
+
+  return widths
+}
+
+const extract = ([family, fontNumber, size, forkPath, type, id]) => {
+
+  if (!family || !forkPath || (type !== `FONT` && type !== `NFNT`)) {
+
+    console.log(`usage: node font_metrics.js extract <family> <fontNumber> <size> <resource fork> <FONT|NFNT> <resource id>`)
+    process.exit(1)
+  }
+
+  const font = findResource(fs.readFileSync(forkPath), type, parseInt(id, 10))
+
+  if (!font) {
+
+    console.log(`font_metrics.js: no ${type} ${id} in ${forkPath}`)
+    process.exit(1)
+  }
+
+  const metrics = readMetrics()
+
+  metrics[`${family}-${size}`] = {
+    family,
+    fontNumber: parseInt(fontNumber, 10),
+    size: parseInt(size, 10),
+    widths: widthsFromFont(font)
+  }
+
+  writeMetrics(metrics)
+}
+
+const header = () => {
+
+  const metrics = readMetrics()
+  const keys = Object.keys(metrics)
+
+  const tables = keys.map((key) => {
+
+    const font = metrics[key]
+    const rows = []
+
+    for (let i = 0; i < CHARACTER_COUNT; i += 16) {
+
+      rows.push(`        ${font.widths.slice(i, i + 16).map((width) => `${width === null ? `FONT_METRICS_UNKNOWN` : width}`).join(`, `)}`)
+    }
+
+    return `    // ${key}\n    {${font.fontNumber}, ${font.size}, {\n${rows.join(`,\n`)}\n    }}`
+  })
+
+  fs.writeFileSync(HEADER_PATH, `// generated by font_metrics.js from font_metrics.json, do not edit
+#ifndef FONT_METRICS_H
+#define FONT_METRICS_H
+
+// widths the table does not know, nuklear_quickdraw.h measures these with CharWidth
+#define FONT_METRICS_UNKNOWN ${UNKNOWN_WIDTH}
+#define FONT_METRICS_COUNT ${keys.length}
+
+typedef struct FontMetrics {
+    short fontNumber;
+    short size;
+    unsigned char widths[${CHARACTER_COUNT}];
+} FontMetrics;
+
+FontMetrics fontMetrics[FONT_METRICS_COUNT${keys.length === 0 ? ` + 1` : ``}] = {
+${tables.join(`,\n`)}
+};
+
+#endif
+`)
+}
+
+const [command, ...args] = process.argv.slice(2)
+
+if (command === `extract`) {
+
+  extract(args)
+} else if (command === `header`) {
+
+  header()
+} else {
+
+  console.log(`usage: node font_metrics.js extract|header`)
+  process.exit(1)
+}
@@ -0,0 +1,150 @@
+#include "SerialHelper.h"
+#include "frame_pacer.h"
+
+Boolean frameInputOpen = false; // the event loop has started nuklear's input, and it is not drawn yet
+Boolean frameInputKeysOnly = true;
+long frameInputTickCount; // when the oldest input waiting to be drawn arrived
+long lastFrameTickCount = 0;
+long lastFullFrameTicks = 0; // how long the last full frame took
+long lastFullFrameTickCount = 0; // and when it started
+long lastKeyTickCount = 0;
+
+// input has arrived for the next frame. arrived is the tick it came in at, keys is whether it was a
+// keystroke. returns true if it is the first input since the last frame, and the caller should
+// start nuklear's input
+Boolean openFrameInput(long arrived, Boolean keys) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: openFrameInput");
+    #endif
+
+    Boolean opened = !frameInputOpen;
+
+    if (opened) {
+
+        frameInputOpen = true;
+        frameInputKeysOnly = true;
+        frameInputTickCount = arrived;
+    }
+
+    if (!keys) {
+
+        frameInputKeysOnly = false;
+    }
+
+    return opened;
+}
+
+static Boolean typingOverBudget(long now) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: typingOverBudget");
+    #endif
+
+    return lastFullFrameTicks > FRAME_BUDGET_TICKS && now - lastKeyTickCount < TYPING_PAUSE_TICKS;
+}
+
+// typing is over budget, and the other windows have not been kept waiting too long for it
+static Boolean deferringFullFrames(long now) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: deferringFullFrames");
+    #endif
+
+    return typingOverBudget(now) && now - lastFullFrameTickCount < MAX_FULL_FRAME_DEFERRAL_TICKS;
+}
+
+// how long until the next frame can draw, or -1 if there is nothing to draw. invalidated is whether
+// any window is waiting to be drawn again
+long ticksUntilFrame(long now, Boolean invalidated) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: ticksUntilFrame");
+    #endif
+
+    if (!frameInputOpen && !invalidated) {
+
+        return -1;
+    }
+
+    long due = lastFrameTickCount + FRAME_TICKS;
+
+    // a redraw with no input in it waits for the user to stop typing, but no longer than
+    // MAX_FULL_FRAME_DEFERRAL_TICKS after the last full frame
+    if (!frameInputOpen && deferringFullFrames(now)) {
+
+        long resumes = lastKeyTickCount + TYPING_PAUSE_TICKS;
+
+        if (resumes > lastFullFrameTickCount + MAX_FULL_FRAME_DEFERRAL_TICKS) {
+
+            resumes = lastFullFrameTickCount + MAX_FULL_FRAME_DEFERRAL_TICKS;
+        }
+
+        if (resumes > due) {
+
+            due = resumes;
+        }
+    }
+
+    return due > now ? due - now : 0;
+}
+
+// which kind of frame to draw now, if any
+short frameToDraw(long now, Boolean invalidated) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: frameToDraw");
+    #endif
+
+    if (ticksUntilFrame(now, invalidated) != 0) {
+
+        return NO_FRAME;
+    }
+
+    // with nothing else waiting, keys only ever need the input drawn
+    if (frameInputOpen && frameInputKeysOnly && typingOverBudget(now) && (!invalidated || deferringFullFrames(now))) {
+
+        return INPUT_FRAME;
+    }
+
+    return FULL_FRAME;
+}
+
+// the frame frameToDraw asked for is on screen, with all the input that was waiting for it
+void frameDrawn(short frame, long started, long finished) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: frameDrawn");
+    #endif
+
+    if (frame == FULL_FRAME) {
+
+        lastFullFrameTicks = finished - started;
+        lastFullFrameTickCount = started;
+    }
+
+    frameInputOpen = false;
+    lastFrameTickCount = started;
+}
+
+short inputLatencyBucket(long ticks) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: inputLatencyBucket");
+    #endif
+
+    if (ticks < 4) {
+
+        return ticks < 0 ? 0 : ticks;
+    }
+
+    short bucket = 4;
+
+    while (bucket < INPUT_LATENCY_BUCKETS - 1 && ticks >= 8) {
+
+        ticks >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
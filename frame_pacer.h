@@ -0,0 +1,43 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <MacTypes.h>
+
+// decides when the event loop draws a frame, and what kind. times are in ticks
+
+// the fewest ticks from the start of one frame to the start of the next. input that arrives in
+// between is held and drawn together, so typing fast or waving the mouse around can not queue up
+// back to back renders
+#define FRAME_TICKS 2
+// #define FRAME_TICKS 0 // draw as often as the loop goes round
+
+// a full frame that takes longer than this is over budget. while the user is typing, frames that
+// only have keystrokes in them then draw just the message input, and anything else waits until
+// typing stops for TYPING_PAUSE_TICKS, or until MAX_FULL_FRAME_DEFERRAL_TICKS have gone by since
+// the last full frame, so that someone typing without a break still sees new messages come in
+#define FRAME_BUDGET_TICKS 4
+#define TYPING_PAUSE_TICKS 15
+#define MAX_FULL_FRAME_DEFERRAL_TICKS 180
+
+#define NO_FRAME 0
+#define FULL_FRAME 1
+#define INPUT_FRAME 2
+
+// ticks from input arriving to it being on screen: 0, 1, 2, 3, 4-7, 8-15, 16-31, 32 or more
+#define INPUT_LATENCY_BUCKETS 8
+
+extern Boolean frameInputOpen;
+extern Boolean frameInputKeysOnly;
+extern long frameInputTickCount;
+extern long lastFrameTickCount;
+extern long lastFullFrameTicks;
+extern long lastFullFrameTickCount;
+extern long lastKeyTickCount;
+
+Boolean openFrameInput(long arrived, Boolean keys);
+long ticksUntilFrame(long now, Boolean invalidated);
+short frameToDraw(long now, Boolean invalidated);
+void frameDrawn(short frame, long started, long finished);
+short inputLatencyBucket(long ticks);
+
+#endif
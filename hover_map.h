@@ -0,0 +1,62 @@
+#ifndef HOVER_MAP_H
+#define HOVER_MAP_H
+
+// the hover map for nuklear_app.c, in its own header so the tests can run it against nuklear on its
+// own. include it after nuklear.h, with APP_WINDOWS defined
+#include <MacTypes.h>
+#include "SerialHelper.h"
+
+// the widgets that look different with the mouse over them, as of the last time each window was
+// drawn. moving the mouse only needs a pass through nuklearApp when it crosses the edge of one of
+// these, anywhere else nothing on screen would change
+#define MAX_HOVER_RECTS 12 // per window, the chat list has the most
+
+struct nk_rect hoverRects[APP_WINDOWS][MAX_HOVER_RECTS];
+short hoverRectCounts[APP_WINDOWS];
+
+void clearHoverRects(short window) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: clearHoverRects");
+    #endif
+
+    hoverRectCounts[window] = 0;
+}
+
+// call before laying out the widget, nk_widget_bounds gives where the next one goes
+void addHoverRect(short window, struct nk_rect rect) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: addHoverRect");
+    #endif
+
+    if (hoverRectCounts[window] < MAX_HOVER_RECTS) {
+
+        hoverRects[window][hoverRectCounts[window]++] = rect;
+    }
+}
+
+// which hover rect x, y is in, or -1 if it is not over anything that reacts to the mouse
+short hoverRectAt(int x, int y) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: hoverRectAt");
+    #endif
+
+    for (short window = 0; window < APP_WINDOWS; window++) {
+
+        for (short i = 0; i < hoverRectCounts[window]; i++) {
+
+            struct nk_rect rect = hoverRects[window][i];
+
+            if (x >= rect.x && x < rect.x + rect.w && y >= rect.y && y < rect.y + rect.h) {
+
+                return window * MAX_HOVER_RECTS + i;
+            }
+        }
+    }
+
+    return -1;
+}
+
+#endif
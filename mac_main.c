@@ -95,6 +95,7 @@ void PROFILE_COMPLETE() {
 #include "Quickdraw.h"
 #include "output_js.h"
 #include "coprocessorjs.h"
+#include "frame_pacer.h"
 #include "nuklear_app.c"
 
 /* GMac is used to hold the result of a SysEnvirons call. This makes
@@ -159,10 +160,20 @@ int main()
     SysBeep(1);
 
     setupCoprocessor("nuklear", "modem"); // could also be "printer", modem is 0 in PCE settings - printer would be 1
+    setCoprocessorEventHandler(handleCoprocessorEvent, eventFunctionResponse, MAX_RECEIVE_SIZE);
     // we could build a nuklear window for selection
 
-    char programResult[MAX_RECEIVE_SIZE];
-    sendProgramToCoprocessor((char *)OUTPUT_JS, programResult);
+    // the coprocessor keeps every program it has been sent on disk, so unless the JS has changed
+    // since the last launch there is nothing to upload
+    // (the result goes in to the scratch arena rather than a 32 KB array on our stack)
+    char *loadResponse = scratchAlloc(&callScratch, MAX_RECEIVE_SIZE);
+
+    if (!sendProgramHashToCoprocessor(OUTPUT_JS_HASH, loadResponse)) {
+
+        sendCompressedProgramToCoprocessor((const char *)OUTPUT_JS, OUTPUT_JS_LEN, loadResponse);
+    }
+
+    resetScratchArena(&callScratch);
 
     #ifdef MAC_APP_DEBUGGING
         writeSerialPortDebug(boutRefNum, "coprocessor loaded");
@@ -170,24 +181,254 @@ int main()
 
     coprocessorLoaded = 1;
 
+    // the loading dialog gives way to the one asking for the server
+    invalidateWindow(DIALOG_WINDOW, INVALIDATE_DIALOG_OPENED);
+
     EventLoop(ctx);
 
     return 0;
 }
 
 Boolean gotKeyboardEvent = false;
-int gotKeyboardEventTime = 0;
+
+#define CURSOR_HIDDEN_TICKS 20 // how long the cursor stays hidden after a key press
+
+// the longest WaitNextEvent sleeps for. nothing wakes us when the coprocessor writes to the serial
+// port, so this is also how late a pushed event can be noticed while we are idle. once the
+// coprocessor has shown that it pushes events, we sleep for no more than PUSHED_EVENT_SLEEP_TICKS
+// so that they are on screen within a tenth of a second. checking for them is only a SerGetBuf
+#define MAX_EVENT_SLEEP_TICKS 30
+#define PUSHED_EVENT_SLEEP_TICKS 6
+
+short cursorTask = -1;
+
+#ifdef PROFILING
+    short profileTask = -1;
+
+    // ticks from input arriving to it being on screen, bucketed by inputLatencyBucket
+    unsigned long inputLatencyHistogram[INPUT_LATENCY_BUCKETS];
+
+    // how well drawing keeps up while the mouse is moving
+    unsigned long mouseMoves = 0;
+    unsigned long mouseMovingTicks = 0;
+    unsigned long mouseMovingFrames = 0;
+
+    // how many frames each keystroke or click costs us, counting every frame drawn within
+    // USER_ACTION_TICKS of one
+    #define USER_ACTION_TICKS 60
+    unsigned long userActions = 0;
+    unsigned long userActionFrames = 0;
+    long lastUserActionTickCount = -USER_ACTION_TICKS;
+#endif
+
+// cursorTask, which brings the cursor back once the user has stopped typing
+Boolean showCursorAfterTyping() {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: showCursorAfterTyping");
+    #endif
+
+    gotKeyboardEvent = false;
+    ShowCursor();
+
+    return false;
+}
+
+#ifdef PROFILING
+
+    // leave the app idle for a few minutes to measure what background polling costs us, or wave
+    // the mouse around for one to see how many frames that draws
+    Boolean writeProfileMinute() {
+
+        #ifdef DEBUG_FUNCTION_CALLS
+            writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: writeProfileMinute");
+        #endif
+
+        char profileMessage[255];
+        sprintf(profileMessage, "PROFILE_COPROCESSOR_MINUTE round trips: %lu, bytes written: %lu, bytes received: %lu, bytes copied: %lu, bytes decompressed: %lu, decompress ticks: %lu",
+                coprocessorStats.roundTrips, coprocessorStats.bytesWritten, coprocessorStats.bytesReceived,
+                coprocessorStats.bytesCopied, coprocessorStats.bytesDecompressed, coprocessorStats.decompressTicks);
+        writeSerialPortProfile(profileMessage);
+
+        coprocessorStats.roundTrips = 0;
+        coprocessorStats.bytesWritten = 0;
+        coprocessorStats.bytesReceived = 0;
+        coprocessorStats.bytesCopied = 0;
+        coprocessorStats.bytesDecompressed = 0;
+        coprocessorStats.decompressTicks = 0;
+
+        sprintf(profileMessage, "PROFILE_MOUSE_MOTION moves: %lu, frames: %lu over %lu ticks of movement, %lu frames per second",
+                mouseMoves, mouseMovingFrames, mouseMovingTicks, mouseMovingTicks ? mouseMovingFrames * 60 / mouseMovingTicks : 0);
+        writeSerialPortProfile(profileMessage);
+
+        mouseMoves = 0;
+        mouseMovingTicks = 0;
+        mouseMovingFrames = 0;
+
+        sprintf(profileMessage, "PROFILE_INPUT_LATENCY ticks 0: %lu, 1: %lu, 2: %lu, 3: %lu, 4-7: %lu, 8-15: %lu, 16-31: %lu, 32+: %lu",
+                inputLatencyHistogram[0], inputLatencyHistogram[1], inputLatencyHistogram[2], inputLatencyHistogram[3],
+                inputLatencyHistogram[4], inputLatencyHistogram[5], inputLatencyHistogram[6], inputLatencyHistogram[7]);
+        writeSerialPortProfile(profileMessage);
+
+        for (short i = 0; i < INPUT_LATENCY_BUCKETS; i++) {
+
+            inputLatencyHistogram[i] = 0;
+        }
+
+        sprintf(profileMessage, "PROFILE_FRAMES_PER_ACTION actions: %lu, frames: %lu, %lu.%lu frames per action",
+                userActions, userActionFrames, userActions ? userActionFrames / userActions : 0,
+                userActions ? userActionFrames * 10 / userActions % 10 : 0);
+        writeSerialPortProfile(profileMessage);
+
+        userActions = 0;
+        userActionFrames = 0;
+
+        // these are totals since launch
+        for (short i = 0; i < scheduledTaskCount; i++) {
+
+            sprintf(profileMessage, "PROFILE_SCHEDULED_TASK %s runs: %lu, overruns: %lu, worst lateness: %ld ticks",
+                    scheduledTasks[i].name, scheduledTasks[i].runs, scheduledTasks[i].overruns, scheduledTasks[i].worstLateness);
+            writeSerialPortProfile(profileMessage);
+        }
+
+        return false;
+    }
+#endif
+
+// starts collecting input for the next frame, unless there is already input waiting for one.
+// arrived is the tick the input came in at, keys is whether it was a keystroke
+void beginFrameInput(struct nk_context *ctx, long arrived, Boolean keys) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: beginFrameInput");
+    #endif
+
+    if (openFrameInput(arrived, keys)) {
+
+        nk_input_begin(ctx);
+
+        // catch nuklear up with any motion that did not need a pass of its own
+        nk_input_motion(ctx, mouse_x, mouse_y);
+    }
+}
+
+// how long the event loop can sleep in WaitNextEvent before a scheduled task is due. this is what
+// lets the app sit at next to no CPU when nothing is happening, and gives the time to other
+// MultiFinder apps
+long eventLoopSleepTicks(long now) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: eventLoopSleepTicks");
+    #endif
+
+    long sleep = coprocessorPushesEvents ? PUSHED_EVENT_SLEEP_TICKS : MAX_EVENT_SLEEP_TICKS;
+    long untilFrame = ticksUntilFrame(now, windowsInvalidated());
+
+    // something is waiting to be drawn, so only sleep until the frame pacer lets it
+    if (untilFrame >= 0 && untilFrame < sleep) {
+
+        sleep = untilFrame;
+    }
+
+    // responses to calls arrive over serial, which does not make an event either
+    if (coprocessorCallInFlight() && sleep > 1) {
+
+        sleep = 1;
+    }
+
+    return ticksUntilNextTask(now, sleep);
+}
+
+// WaitNextEvent where we have it, GetNextEvent where we do not. sleeping is only worth it for the
+// first call of an iteration, the rest are just draining what is queued up
+Boolean getEventOrSleep(EventRecord *event, long sleep, RgnHandle mouseRegion) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: getEventOrSleep");
+    #endif
+
+    if (gHasWaitNextEvent) {
+
+        return WaitNextEvent(everyEvent, event, sleep, mouseRegion);
+    }
+
+    return GetNextEvent(everyEvent, event);
+}
+
+// the next keystroke waiting, without sleeping or taking any other kind of event
+Boolean getKeyEvent(EventRecord *event) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: getKeyEvent");
+    #endif
+
+    if (gHasWaitNextEvent) {
+
+        return WaitNextEvent(keyDownMask | autoKeyMask, event, 0, NULL);
+    }
+
+    return GetNextEvent(keyDownMask | autoKeyMask, event);
+}
+
+// passes an event on to DoEvent as input for the next frame
+void takeEvent(struct nk_context *ctx, EventRecord *event) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: takeEvent");
+    #endif
+
+    #ifdef MAC_APP_DEBUGGING
+
+        writeSerialPortDebug(boutRefNum, "calling to DoEvent");
+    #endif
+
+    beginFrameInput(ctx, event->when, event->what == keyDown || event->what == autoKey);
+
+    DoEvent(event, ctx);
+
+    #ifdef MAC_APP_DEBUGGING
+
+        writeSerialPortDebug(boutRefNum, "done with DoEvent");
+    #endif
+
+    #ifdef PROFILING
+
+        if (event->what == keyDown || event->what == autoKey || event->what == mouseDown) {
+
+            userActions++;
+            lastUserActionTickCount = event->when;
+        }
+    #endif
+}
+
+// we track the mouse ourselves at the top of the event loop, so mouse-moved events only need to
+// wake us up
+static Boolean isMouseMovedEvent(EventRecord *event) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: isMouseMovedEvent");
+    #endif
+
+    return event->what == osEvt && ((event->message >> 24) & 0x0FF) == kMouseMovedMessage;
+}
 
 void EventLoop(struct nk_context *ctx)
 {
     Boolean	gotEvent;
     EventRecord	event;
     Point mouse;
+    RgnHandle mouseRegion = NewRgn();
 
     int lastMouseHPos = 0;
     int lastMouseVPos = 0;
-    int lastUpdatedTickCountMessagesInChat = 0;
-    int lastUpdatedTickCountChatCounts = 0;
+
+    scheduleNuklearAppTasks(TickCount());
+    cursorTask = addScheduledTask("cursor", showCursorAfterTyping, 0, 0, false, 0);
+
+    #ifdef PROFILING
+        profileTask = addScheduledTask("profile", writeProfileMinute, 3600, 60, false, TickCount() + 3600);
+        long lastLoopTickCount = TickCount();
+    #endif
 
     do {
 
@@ -197,115 +438,97 @@ void EventLoop(struct nk_context *ctx)
         //     PROFILE_START("eventloop");
         // #endif
 
-        if (gotKeyboardEvent && TickCount() > gotKeyboardEventTime + 20) {
+        // anything a blocking call left in the scratch arena is finished with by now
+        resetScratchArena(&callScratch);
 
-            gotKeyboardEvent = false;
-            ShowCursor();
-        }
+        // pick up pushed events and finish any background coprocessor requests whose responses have
+        // arrived. this never blocks, so rendering and input keep going while the coprocessor is working
+        pollBackgroundCoprocessorCalls();
 
-        // check for new stuff every x sec?
-        // note! this is used by some of the functionality in our nuklear_app to trigger
-        // new chat lookups
-        if (TickCount() - lastUpdatedTickCountMessagesInChat > 300) {
+        // then start whatever background work has come due. chat counts and new messages in the
+        // active chat are checked together in one batched coprocessor call, see syncWithCoprocessor.
+        // once the coprocessor has shown that it pushes events to us when these change, this is
+        // only a slow safety net
+        runDueTasks(TickCount());
 
-            lastUpdatedTickCountMessagesInChat = TickCount();
-
-            if (strcmp(activeChat, "no active chat")) {
+        #ifdef PROFILING
+            Boolean mouseMoved = false;
+        #endif
 
-                // writeSerialPortDebug(boutRefNum, "check chat");
-                getHasNewMessagesInChat(activeChat);
-            }
-        } 
+        GetGlobalMouse(&mouse);
 
-        // this should be out of sync with the counter above it so that we dont end up making
-        // two coprocessor calls on one event loop iteratio
-        if (TickCount() - lastUpdatedTickCountChatCounts > 500) {
+        // mouse-moved events only tell us that the mouse left a region, so we track it ourselves
+        // and call nk_input_motion directly rather than building dummy events for DoEvent.
+        // a click is drawn before any more input is taken, so that nuklear sees each one on its own
+        Boolean clickWaiting = frameInputOpen && gotMouseEvent;
 
-            // writeSerialPortDebug(boutRefNum, "update by tick count");
-            lastUpdatedTickCountChatCounts = TickCount();
+        // keystrokes are taken first, every time round, so that they never wait behind a frame for
+        // the mouse, and the frame pacer decides what to draw with them already in it
+        if (!clickWaiting) {
 
-            if (chatFriendlyNamesCounter > 0) {
+            while (getKeyEvent(&event)) {
 
-                // writeSerialPortDebug(boutRefNum, "check chat counts");
-                getChatCounts();
+                takeEvent(ctx, &event);
             }
         }
 
-        Boolean beganInput = false;
+        if (!clickWaiting && (lastMouseHPos != mouse.h || lastMouseVPos != mouse.v)) {
 
-        GetGlobalMouse(&mouse);
+            // only where the mouse has got to matters, not every point it passed on the way
+            Point tempPoint;
+            SetPt(&tempPoint, mouse.h, mouse.v);
+            GlobalToLocal(&tempPoint);
 
-        // as far as i can tell, there is no way to event on mouse movement with mac libraries,
-        // so we are just going to track on our own, and create our own events.
-        // this seems kind of a bummer to not pass this to event handling code, but to make
-        // it work we would need to create a dummy event, etc, so we will just directly 
-        // call the nk_input_motion command
-        if (lastMouseHPos != mouse.h || lastMouseVPos != mouse.v) {
-
-            // if the mouse is in motion, try to capture all motion before moving on to rendering
-            while (lastMouseHPos != mouse.h || lastMouseVPos != mouse.v) {
+            // and it only needs a pass through nuklear if it has crossed in to or out of something
+            // that reacts to it, or if the button is down and something may be being dragged
+            if (Button() || hoverRectAt(mouse_x, mouse_y) != hoverRectAt(tempPoint.h, tempPoint.v)) {
 
                 #ifdef MAC_APP_DEBUGGING
 
                     writeSerialPortDebug(boutRefNum, "nk_input_motion!");
                 #endif
 
-                Point tempPoint;
-                SetPt(&tempPoint, mouse.h, mouse.v);
-                GlobalToLocal(&tempPoint);
-
-                if (!beganInput) {
+                beginFrameInput(ctx, TickCount(), false);
+                nk_input_motion(ctx, tempPoint.h, tempPoint.v);
 
-                    nk_input_begin(ctx);
-                    beganInput = true;
-                }
+                // one frame to move the highlight, from where the mouse was to where it is
+                invalidateWindowAt(mouse_x, mouse_y, INVALIDATE_HOVER);
+                invalidateWindowAt(tempPoint.h, tempPoint.v, INVALIDATE_HOVER);
+            }
 
-                nk_input_motion(ctx, tempPoint.h, tempPoint.v);
+            #ifdef PROFILING
+                mouseMoved = true;
+                mouseMoves++;
+            #endif
 
-                firstOrMouseMove = true;
-                mouse_x = tempPoint.h;
-                mouse_y = tempPoint.v;
+            mouse_x = tempPoint.h;
+            mouse_y = tempPoint.v;
+        } else if (!clickWaiting) {
 
-                lastUpdatedTickCountChatCounts = TickCount();
-                lastUpdatedTickCountMessagesInChat = TickCount();
-                lastMouseHPos = mouse.h;
-                lastMouseVPos = mouse.v;
-                GetGlobalMouse(&mouse);
-            }
-        } else {
+            // sleep until an event comes in, the mouse leaves the pixel it is on, or a timer is due
+            SetRectRgn(mouseRegion, mouse.h, mouse.v, mouse.h + 1, mouse.v + 1);
 
-            gotEvent = GetNextEvent(everyEvent, &event);
-            gotMouseEvent = false;
+            gotEvent = getEventOrSleep(&event, eventLoopSleepTicks(TickCount()), mouseRegion);
 
             // drain all events before rendering -- really this only applies to keyboard events and single mouse clicks now
             while (gotEvent) {
 
-                lastUpdatedTickCountChatCounts = TickCount();
-                lastUpdatedTickCountMessagesInChat = TickCount();
-
-                #ifdef MAC_APP_DEBUGGING
-
-                    writeSerialPortDebug(boutRefNum, "calling to DoEvent");
-                #endif
+                if (isMouseMovedEvent(&event)) {
 
-                if (!beganInput) {
+                    gotEvent = getEventOrSleep(&event, 0, mouseRegion);
 
-                    nk_input_begin(ctx);
-                    beganInput = true;
+                    continue;
                 }
 
-                DoEvent(&event, ctx);
-
-                #ifdef MAC_APP_DEBUGGING
-
-                    writeSerialPortDebug(boutRefNum, "done with DoEvent");
-                #endif
+                takeEvent(ctx, &event);
 
                 if (!gotMouseEvent) {
 
-                    gotEvent = GetNextEvent(everyEvent, &event);
+                    gotEvent = getEventOrSleep(&event, 0, mouseRegion);
                 } else {
 
+                    // whatever was clicked on needs drawing, the rest of the screen can stay as it is
+                    invalidateWindowAt(mouse_x, mouse_y, INVALIDATE_CLICK);
                     gotEvent = false;
                 }
             }
@@ -314,10 +537,19 @@ void EventLoop(struct nk_context *ctx)
         lastMouseHPos = mouse.h;
         lastMouseVPos = mouse.v;
 
-        SystemTask();
+        // WaitNextEvent does this for us
+        if (!gHasWaitNextEvent) {
+
+            SystemTask();
+        }
+
+        // only re-render if there is an event, prevents screen flickering, speeds up app. the
+        // frame pacer holds frames back to FRAME_TICKS apart, and all input so far is in this one
+        short frame = frameToDraw(TickCount(), windowsInvalidated());
+
+        if (frame != NO_FRAME) {
 
-        // only re-render if there is an event, prevents screen flickering, speeds up app
-        if (beganInput || firstOrMouseMove || forceRedrawChats || forceRedrawMessages) {
+            long frameStartTickCount = TickCount();
 
             #ifdef PROFILING
                 PROFILE_START("nk_input_end");
@@ -335,9 +567,11 @@ void EventLoop(struct nk_context *ctx)
                 writeSerialPortDebug(boutRefNum, "nuklearApp");
             #endif
 
+            drawInputOnly = frame == INPUT_FRAME;
+
             nuklearApp(ctx);
 
-            firstOrMouseMove = false;
+            drawInputOnly = false;
 
             #ifdef PROFILING
                 PROFILE_END("nuklearApp");
@@ -348,7 +582,7 @@ void EventLoop(struct nk_context *ctx)
 
                 writeSerialPortDebug(boutRefNum, "nk_quickdraw_render");
                 char x[255];
-                sprintf(x, "why? beganInput: %d, firstOrMouseMove: %d, forceRedraw: %d", beganInput, firstOrMouseMove, forceRedrawChats);
+                sprintf(x, "why? frameInputOpen: %d, frame: %d, invalidated chats: %x, messages: %x", frameInputOpen, frame, windowInvalidations[CHATS_WINDOW], windowInvalidations[MESSAGES_WINDOW]);
                 writeSerialPortDebug(boutRefNum, x);
             #endif
 
@@ -363,10 +597,37 @@ void EventLoop(struct nk_context *ctx)
 
             #ifdef PROFILING
                 PROFILE_END("nk_clear");
+
+                if (mouseMoved) {
+
+                    mouseMovingFrames++;
+                }
+
+                if (frameInputOpen) {
+
+                    inputLatencyHistogram[inputLatencyBucket(TickCount() - frameInputTickCount)]++;
+                }
+
+                if (frameStartTickCount - lastUserActionTickCount < USER_ACTION_TICKS) {
+
+                    userActionFrames++;
+                }
             #endif
 
+            frameDrawn(frame, frameStartTickCount, TickCount());
+            gotMouseEvent = false;
         }
 
+        #ifdef PROFILING
+
+            if (mouseMoved) {
+
+                mouseMovingTicks += TickCount() - lastLoopTickCount;
+            }
+
+            lastLoopTickCount = TickCount();
+        #endif
+
         #ifdef MAC_APP_DEBUGGING
 
             writeSerialPortDebug(boutRefNum, "nk_input_render complete");
@@ -462,7 +723,8 @@ void DoEvent(EventRecord *event, struct nk_context *ctx) {
                 gotKeyboardEvent = true;
             }
 
-            gotKeyboardEventTime = TickCount();
+            lastKeyTickCount = TickCount();
+            scheduleTask(cursorTask, lastKeyTickCount + CURSOR_HIDDEN_TICKS);
 
             #ifdef MAC_APP_DEBUGGING
                 writeSerialPortDebug(boutRefNum, "key");
@@ -693,12 +955,13 @@ void DoMenuCommand(menuResult)
                     getMessages(activeChat, 0);
                     break;
                 case 4:
-                    memset(box_input_buffer, '\0', 2048);
+                    memset(box_input_buffer, '\0', MAX_MESSAGE_INPUT_LENGTH);
                     box_input_len = 0;
-                    forceRedrawMessages = 3;
+                    invalidateWindow(MESSAGE_INPUT_WINDOW, INVALIDATE_INPUT_CLEARED);
                     break;
                 default:
                     sendNewChat = 1;
+                    invalidateWindow(DIALOG_WINDOW, INVALIDATE_DIALOG_OPENED);
                     break;
             }
 
@@ -817,6 +1080,8 @@ void Initialize()
 
     gInBackground = false;
 
+    SysEnvirons(kSysEnvironsVersion, &gMac);
+
     InitGraf((Ptr) &qd.thePort);
     InitFonts();
     InitWindows();
@@ -829,6 +1094,8 @@ void Initialize()
         EventAvail(everyEvent, &event);
     }
 
+    gHasWaitNextEvent = TrapAvailable(_WaitNextEvent, ToolTrap);
+
     window = (WindowPtr) NewPtr(sizeof(WindowRecord));
 
     if ( window == nil ) {
@@ -1363,6 +1363,7 @@ NK_API const struct nk_command* nk__next(struct nk_context*, const struct nk_com
 /// NK_WINDOW_BACKGROUND        | Always keep window in the background
 /// NK_WINDOW_SCALE_LEFT        | Puts window scaler in the left-bottom corner instead right-bottom
 /// NK_WINDOW_NO_INPUT          | Prevents window of scaling, moving or getting focus
+/// NK_WINDOW_SKIP_RENDER       | Keeps the window and its state (scroll offsets and so on) for this frame without laying out or drawing anything in it: `nk_begin_xxx` returns false
 ///
 /// #### nk_collapse_states
 /// State           | Description
@@ -1382,7 +1383,10 @@ enum nk_panel_flags {
     NK_WINDOW_SCROLL_AUTO_HIDE  = NK_FLAG(7),
     NK_WINDOW_BACKGROUND        = NK_FLAG(8),
     NK_WINDOW_SCALE_LEFT        = NK_FLAG(9),
-    NK_WINDOW_NO_INPUT          = NK_FLAG(10)
+    NK_WINDOW_NO_INPUT          = NK_FLAG(10),
+    /* only for nk_begin_xxx and never kept in a window's flags, so it can share the last free bit
+     * of a 16 bit nk_flags with NK_WINDOW_DYNAMIC, which is only ever set on popups */
+    NK_WINDOW_SKIP_RENDER       = NK_FLAG(11)
 };
 /*/// #### nk_begin
 /// Starts a new window; needs to be called every frame for every
@@ -4245,6 +4249,7 @@ struct nk_command_buffer {
     short use_clipping;
     nk_handle userdata;
     nk_size begin, end, last;
+    unsigned long checksum; /* over every command pushed, see nk_command_buffer_checksum */
 };
 
 /* shape outlines */
@@ -5331,6 +5336,7 @@ NK_LIB void* nk_buffer_realloc(struct nk_buffer *b, nk_size capacity, nk_size *s
 /* draw */
 NK_LIB void nk_command_buffer_init(struct nk_command_buffer *cb, struct nk_buffer *b, enum nk_command_clipping clip);
 NK_LIB void nk_command_buffer_reset(struct nk_command_buffer *b);
+NK_LIB void nk_command_buffer_checksum(struct nk_command_buffer *b);
 NK_LIB void* nk_command_buffer_push(struct nk_command_buffer* b, enum nk_command_type t, nk_size size);
 NK_LIB void nk_draw_symbol(struct nk_command_buffer *out, enum nk_symbol_type type, struct nk_rect content, Pattern background, int foreground, short border_width, const struct nk_user_font *font);
 
@@ -7156,6 +7162,7 @@ nk_command_buffer_init(struct nk_command_buffer *cb,
     cb->begin = b->allocated;
     cb->end = b->allocated;
     cb->last = b->allocated;
+    cb->checksum = 0;
 }
 NK_LIB void
 nk_command_buffer_reset(struct nk_command_buffer *b)
@@ -7165,11 +7172,36 @@ nk_command_buffer_reset(struct nk_command_buffer *b)
     b->begin = 0;
     b->end = 0;
     b->last = 0;
+    b->checksum = 0;
     b->clip = nk_null_rect;
 #ifdef NK_INCLUDE_COMMAND_USERDATA
     b->userdata.ptr = 0;
 #endif
 }
+/* folds the last command pushed in to the buffer's checksum. commands are filled in after they
+ * are pushed, so this runs when the next one is pushed or the buffer is finished. the header is left
+ * out because its next offset moves whenever anything before it changes size. the whole command
+ * including its padding is zeroed before it is filled in, so it can be summed a word at a time */
+NK_LIB void
+nk_command_buffer_checksum(struct nk_command_buffer *b)
+{
+    const struct nk_command *cmd;
+    const unsigned short *word;
+    const unsigned short *end;
+    unsigned long sum;
+
+    if (!b || b->end == b->begin) return;
+    cmd = nk_ptr_add_const(struct nk_command, b->base->memory.ptr, b->last);
+    word = (const unsigned short*)(cmd + 1);
+    end = (const unsigned short*)nk_ptr_add_const(void, b->base->memory.ptr, b->end);
+
+    /* djb2, shifts and adds only since the 68000 has no 32 bit multiply */
+    sum = ((b->checksum << 5) + b->checksum) + (unsigned long)cmd->type;
+    while (word < end) {
+        sum = ((sum << 5) + sum) + *word++;
+    }
+    b->checksum = sum;
+}
 NK_LIB void*
 nk_command_buffer_push(struct nk_command_buffer* b,
     enum nk_command_type t, nk_size size)
@@ -7183,6 +7215,7 @@ nk_command_buffer_push(struct nk_command_buffer* b,
     // NK_ASSERT(b);
     // NK_ASSERT(b->base);
     if (!b) return 0;
+    nk_command_buffer_checksum(b);
     cmd = (struct nk_command*)nk_buffer_alloc(b->base,NK_BUFFER_FRONT,size,align);
     if (!cmd) return 0;
 
@@ -8841,6 +8874,7 @@ nk_start_buffer(struct nk_context *ctx, struct nk_command_buffer *buffer)
     buffer->begin = ctx->memory.allocated;
     buffer->end = buffer->begin;
     buffer->last = buffer->begin;
+    buffer->checksum = 0;
     buffer->clip = nk_null_rect;
 }
 NK_LIB void
@@ -8884,6 +8918,7 @@ nk_finish_buffer(struct nk_context *ctx, struct nk_command_buffer *buffer)
     // NK_ASSERT(ctx);
     // NK_ASSERT(buffer);
     if (!ctx || !buffer) return;
+    nk_command_buffer_checksum(buffer);
     buffer->end = ctx->memory.allocated;
 }
 NK_LIB void
@@ -9990,6 +10025,9 @@ nk_begin_titled(struct nk_context *ctx, const char *name, const char *title,
     nk_hash name_hash;
     short name_len;
     short ret = 0;
+    short skip_render = (flags & NK_WINDOW_SKIP_RENDER) != 0;
+
+    flags &= ~(nk_flags)NK_WINDOW_SKIP_RENDER;
 
     // NK_ASSERT(ctx);
     // NK_ASSERT(name);
@@ -10027,7 +10065,7 @@ nk_begin_titled(struct nk_context *ctx, const char *name, const char *title,
         NK_MEMCPY(win->name_string, name, name_length);
         win->name_string[name_length] = 0;
         win->popup.win = 0;
-        if (!ctx->active) {
+        if (!ctx->active && !skip_render) {
             ctx->active = win;
         }
     } else {
@@ -10046,11 +10084,20 @@ nk_begin_titled(struct nk_context *ctx, const char *name, const char *title,
          *      provided demo backends). */
         // NK_ASSERT(win->seq != ctx->seq);
         win->seq = ctx->seq;
-        if (!ctx->active && !(win->flags & NK_WINDOW_HIDDEN)) {
+        if (!ctx->active && !(win->flags & NK_WINDOW_HIDDEN) && !skip_render) {
             ctx->active = win;
             ctx->end = win;
         }
     }
+    if (skip_render) {
+        /* seen this frame, so nk_clear keeps it and its tables, but with no commands to draw */
+        struct nk_table *table;
+        for (table = win->tables; table; table = table->next)
+            table->seq = ctx->seq;
+        nk_start_buffer(ctx, &win->buffer);
+        win->layout = 0;
+        return 0;
+    }
     if (win->flags & NK_WINDOW_HIDDEN) {
         ctx->current = win;
         win->layout = 0;
@@ -15,54 +15,6 @@
 
 // #define MESSAGES_FOR_MACINTOSH_DEBUGGING
 
-// based on https://github.com/mr21/strsplit.c/blob/master/strsplit.c
-static char** _strsplit( const char* s, const char* delim, int* nb ) {
-
-    #ifdef DEBUG_FUNCTION_CALLS
-        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: _strsplit");
-    #endif
-    void* data;
-    char* _s = ( char* )s;
-    const char** ptrs;
-    int
-        ptrsSize,
-        nbWords = 1,
-        sLen = strlen( s ),
-        delimLen = strlen( delim );
-
-    while ( ( _s = strstr( _s, delim ) ) ) {
-        _s += delimLen;
-        ++nbWords;
-    }
-    ptrsSize = ( nbWords + 1 ) * sizeof( char* );
-    ptrs =
-    data = malloc( ptrsSize + sLen + 1 );
-    if ( data ) {
-        *ptrs =
-        _s = strcpy( ( ( char* )data ) + ptrsSize, s );
-        if ( nbWords > 1 ) {
-            while ( ( _s = strstr( _s, delim ) ) ) {
-                *_s = '\0';
-                _s += delimLen;
-                *++ptrs = _s;
-            }
-        }
-        *++ptrs = NULL;
-    }
-    if ( nb ) {
-        *nb = data ? nbWords : 0;
-    }
-    return data;
-}
-
-char** strsplit( const char* s, const char* delim ) {
-    return _strsplit( s, delim, NULL );
-}
-
-char** strsplit_count( const char* s, const char* delim, int* nb ) {
-    return _strsplit( s, delim, nb );
-}
-
 void aFailed(char *file, int line) {
 
     #ifdef DEBUG_FUNCTION_CALLS
@@ -78,27 +30,37 @@ void aFailed(char *file, int line) {
     while (true) {}
 }
 
-#define MAX_CHAT_MESSAGES 17
+#define MESSAGE_ROW_HEIGHT 11
+#define MESSAGE_WRAP_MARGIN 44 // the messages window's padding, border and the list's scrollbar
+#define MESSAGE_PAGE_BYTES 4096 // the most message text a page of older messages brings back
+#define MESSAGE_PAGE_MESSAGES 32 // and the most messages
 #define MAX_RECEIVE_SIZE 32767 // this has a corresponding value in coprocessor.c
 #define MAX_FRIENDLY_NAME_LENGTH 64
+#define MAX_CHATS 16
+#define SYNC_INTERVAL_TICKS 300
+#define PUSHED_SYNC_INTERVAL_TICKS 3600 // once index.js has shown that it pushes changes to us
+#define SYNC_JITTER_TICKS 60
+#define MESSAGE_PAGE_JITTER_TICKS 6 // the user is waiting on this one
+#define MAX_MESSAGE_INPUT_LENGTH 2048 // what nk_edit_string lets the message input hold
+#define SEND_MESSAGE_ARGUMENTS_SIZE (MAX_MESSAGE_INPUT_LENGTH + 64 + 32) // the chat name, the sequence and length prefixes on top
+#define CALL_SCRATCH_SIZE (MAX_RECEIVE_SIZE + SEND_MESSAGE_ARGUMENTS_SIZE + 64) // a blocking call's arguments and response, see callScratch
 
-Boolean firstOrMouseMove = true;
 Boolean gotMouseEvent = false;
+Boolean coprocessorPushesEvents = false; // index.js has pushed us an EVENT, see handleCoprocessorEvent
+Boolean drawInputOnly = false; // the frame pacer is over budget, only the message input is drawn
 char *activeChat;
-char *activeChatMessages;
 char *box_input_buffer;
 char *chatFriendlyNames;
 char *ip_input_buffer;
-char *jsFunctionResponse;
-char *chatCountFunctionResponse;
-char *tempChatCountFunctionResponse;
+char *syncFunctionResponse;
+char *eventFunctionResponse;
+char *pageFunctionResponse;
 char *previousChatCountFunctionResponse;
 char *new_message_input_buffer;
-int activeMessageCounter = 0;
+long activeChatSequence = -1; // the transcript sequence index.js gave us for activeChatSequenceChat
+char activeChatSequenceChat[MAX_FRIENDLY_NAME_LENGTH];
 int chatFriendlyNamesCounter = 0;
 int coprocessorLoaded = 0;
-int forceRedrawChats= 2; // this is how many 'iterations' of the chat list UI that we need to see every element for, starting with 2 to draw the UI appropriately
-int forceRedrawMessages = 2; // same as above but for messages
 int ipAddressSet = 0;
 int mouse_x;
 int mouse_y;
@@ -120,33 +82,303 @@ struct nk_context *ctx;
 #include <Types.h>
 #include "nuklear_quickdraw.h"
 #include "coprocessorjs.h"
+#include "transcript.h"
+#include "scratch.h"
+#include "scheduler.h"
+
+Transcript *activeTranscript;
+
+// the arguments and response of a blocking coprocessor call only live for the length of the call,
+// so they come from here and are released straight after. mac_main.c resets it every time round
+// the event loop in case anything was missed
+ScratchArena callScratch;
+
+// older messages are fetched a page at a time as the messages list is scrolled up to them
+CoprocessorCall pageCall;
+char pageChat[MAX_FRIENDLY_NAME_LENGTH];
+long pageBefore;
+Boolean transcriptHistoryComplete = false; // index.js has nothing older, or we have no room for it
+
+// the message at the top of the messages list, which is kept in place when messages are added or
+// dropped above it. unless the list is at the bottom, in which case it stays at the bottom
+long messagesAnchorSequence = -1;
+short messagesAnchorLine = 0;
+Boolean messagesFollowNewest = true;
+
+// handle for the batched request that the event loop makes in the background, along with what
+// went in to it so that the response can be picked apart
+CoprocessorCall syncCall;
+CoprocessorBatch syncBatch;
+Boolean syncIncludesChatCounts = false;
+Boolean syncIncludesNewMessages = false;
+char syncChat[64];
+
+// our background coprocessor calls, run by the event loop's scheduler. scheduling syncTask for now
+// asks for a sync on the next turn rather than waiting for the interval
+short syncTask = -1;
+short pageTask = -1;
+
+// the app's windows, for invalidation and the hover map
+#define CHATS_WINDOW 0
+#define MESSAGE_INPUT_WINDOW 1
+#define MESSAGES_WINDOW 2
+#define DIALOG_WINDOW 3
+#define APP_WINDOWS 4
+
+// why a window has to be drawn again. the chat list and messages windows are only laid out and
+// drawn when they have a reason to be, and drawing them clears it. anything that changes what one
+// of them shows invalidates it, and it is drawn once. if that happens while it is being drawn, say
+// a click on a chat, it gets one more frame to show the change
+#define INVALIDATE_STARTUP 0x01
+#define INVALIDATE_HOVER 0x02 // the mouse moved on to or off something that highlights, or dragged
+#define INVALIDATE_CLICK 0x04
+#define INVALIDATE_CHATS_CHANGED 0x08 // names or new message counts
+#define INVALIDATE_ACTIVE_CHAT 0x10
+#define INVALIDATE_MESSAGES_CHANGED 0x20
+#define INVALIDATE_DIALOG_CLOSED 0x40 // it was behind a dialog
+#define INVALIDATE_INPUT_CLEARED 0x80
+#define INVALIDATE_DIALOG_OPENED 0x100
+
+unsigned short windowInvalidations[APP_WINDOWS] = {INVALIDATE_STARTUP, INVALIDATE_STARTUP, INVALIDATE_STARTUP, 0};
+
+void invalidateWindow(short window, unsigned short reason) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: invalidateWindow");
+    #endif
+
+    windowInvalidations[window] |= reason;
+}
+
+// one of the dialogs in nuklearApp is up, and is drawn in place of the other windows
+Boolean dialogOpen() {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: dialogOpen");
+    #endif
+
+    return !coprocessorLoaded || !ipAddressSet || sendNewChat;
+}
+
+// true if any window is waiting to be drawn. while a dialog is up only it can be, and whatever the
+// others were invalidated for waits for it to close
+Boolean windowsInvalidated() {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: windowsInvalidated");
+    #endif
+
+    if (dialogOpen()) {
+
+        return windowInvalidations[DIALOG_WINDOW] != 0;
+    }
+
+    for (short i = 0; i < APP_WINDOWS; i++) {
+
+        if (windowInvalidations[i]) {
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// the dialog is being drawn, and the windows it covers are invalidated with INVALIDATE_DIALOG_CLOSED
+// when it closes, so whatever they were invalidated for in the meantime can be dropped. a window it
+// leaves uncovered, the message input, keeps its invalidations for when it is drawn again
+void clearInvalidationsUnderDialog(struct nk_rect dialog) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: clearInvalidationsUnderDialog");
+    #endif
+
+    struct nk_rect windowBounds[APP_WINDOWS];
+
+    windowBounds[CHATS_WINDOW] = chats_window_size;
+    windowBounds[MESSAGE_INPUT_WINDOW] = message_input_window_size;
+    windowBounds[MESSAGES_WINDOW] = messages_window_size;
+    windowBounds[DIALOG_WINDOW] = dialog;
+
+    for (short i = 0; i < APP_WINDOWS; i++) {
+
+        struct nk_rect bounds = windowBounds[i];
+
+        if (NK_INTERSECT(dialog.x, dialog.y, dialog.w, dialog.h, bounds.x, bounds.y, bounds.w, bounds.h)) {
+
+            windowInvalidations[i] = 0;
+        }
+    }
+}
 
 void refreshNuklearApp(Boolean blankInput);
 
-void getMessagesFromjsFunctionResponse() {
+// the sequence to hand back to index.js so that it only sends us rows we have not seen. a
+// sequence only means something for the chat it came from, -1 asks for the whole transcript
+long getActiveChatSequence() {
 
     #ifdef DEBUG_FUNCTION_CALLS
-        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: getMessagesFromjsFunctionResponse");
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: getActiveChatSequence");
     #endif
 
-    for (int i = 0; i < MAX_CHAT_MESSAGES; i++) {
+    if (strcmp(activeChat, activeChatSequenceChat)) {
 
-        memset(&activeChatMessages[i * 2048], '\0', 2048);
+        return -1;
     }
 
-    activeMessageCounter = 0;
+    return activeChatSequence;
+}
+
+// applies a transcript delta from index.js to the active chat. the delta is base&&&next&&&messages,
+// where messages are separated by ENDLASTMESSAGE and follow on from sequence base. when base is -1
+// they are the newest few messages and replace everything, older ones are paged in as needed.
+// nothing is written in to delta, so it can be a view straight in to the receive ring. returns true
+// if there is anything new to draw
+Boolean applyMessagesDelta(const char *delta, long deltaLength) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: applyMessagesDelta");
+    #endif
+
+    CoprocessorTokenizer fields;
+    CoprocessorView baseField;
+    CoprocessorView nextField;
 
-    char *token = (char *)strtokm(jsFunctionResponse, "ENDLASTMESSAGE");
+    beginTokenizer(&fields, delta, deltaLength, "&&&");
 
-    // loop through the string to extract all other tokens
-    while (token != NULL) {
+    // the messages are whatever follows the second delimiter, message text can contain &&& too
+    if (!nextToken(&fields, &baseField) || !nextToken(&fields, &nextField) || fields.done || baseField.length == 0 || nextField.length == 0) {
 
-        sprintf(&activeChatMessages[activeMessageCounter * 2048], "%s", token);
-        token = (char *)strtokm(NULL, "ENDLASTMESSAGE");
-        activeMessageCounter++;
+        return false;
     }
 
-    return;
+    long base = viewToLong(&baseField);
+    long next = viewToLong(&nextField);
+    CoprocessorView messages = {fields.cursor, fields.end - fields.cursor};
+
+    CoprocessorTokenizer messageTokenizer;
+    CoprocessorView message;
+
+    if (base == -1) {
+
+        // the messages end at next, so count them to find where they start
+        short messageCount = 0;
+
+        beginTokenizer(&messageTokenizer, messages.data, messages.length, "ENDLASTMESSAGE");
+
+        while (messages.length > 0 && nextToken(&messageTokenizer, &message)) {
+
+            messageCount++;
+        }
+
+        clearTranscript(activeTranscript, next - messageCount);
+        transcriptHistoryComplete = false;
+        messagesFollowNewest = true;
+    } else if (base != getActiveChatSequence()) {
+
+        #ifdef MESSAGES_FOR_MACINTOSH_DEBUGGING
+            writeSerialPortDebug(boutRefNum, "transcript delta does not follow on from what we have, asking for all of it");
+        #endif
+
+        activeChatSequence = -1;
+        scheduleTask(syncTask, TickCount());
+
+        return false;
+    }
+
+    sprintf(activeChatSequenceChat, "%.63s", activeChat);
+    activeChatSequence = next;
+
+    if (base == next) {
+
+        return false;
+    }
+
+    if (messages.length == 0) {
+
+        return true;
+    }
+
+    beginTokenizer(&messageTokenizer, messages.data, messages.length, "ENDLASTMESSAGE");
+
+    while (nextToken(&messageTokenizer, &message)) {
+
+        appendTranscriptMessage(activeTranscript, &message);
+    }
+
+    return true;
+}
+
+// asks index.js for the messages before the oldest one we have, without waiting for them. see
+// applyMessagePage for the answer. this is pageTask, so returns whether it sent anything
+Boolean requestOlderMessages() {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: requestOlderMessages");
+    #endif
+
+    if (pageCall.state != COPROCESSOR_CALL_IDLE || transcriptHistoryComplete || strcmp(activeChat, activeChatSequenceChat)) {
+
+        return false;
+    }
+
+    char output[128];
+    CoprocessorArguments arguments;
+
+    sprintf(pageChat, "%.63s", activeChat);
+    pageBefore = activeTranscript->firstSequence;
+
+    beginCoprocessorArguments(&arguments, output, sizeof(output));
+    addCoprocessorStringArgument(&arguments, pageChat);
+    addCoprocessorNumberArgument(&arguments, pageBefore);
+    addCoprocessorNumberArgument(&arguments, MESSAGE_PAGE_BYTES);
+    addCoprocessorNumberArgument(&arguments, MESSAGE_PAGE_MESSAGES);
+
+    callFunctionOnCoprocessorViewAsync("getMessagePage", &arguments, pageFunctionResponse, MESSAGE_PAGE_BYTES + 64, &pageCall);
+
+    return true;
+}
+
+// a page is first&&&messages, where first is the sequence of the first message and the messages run
+// up to the one before pageBefore. no messages means there is nothing older
+void applyMessagePage(CoprocessorView *page) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: applyMessagePage");
+    #endif
+
+    CoprocessorTokenizer fields;
+    CoprocessorView firstField;
+
+    beginTokenizer(&fields, page->data, page->length, "&&&");
+
+    // the transcript may have been replaced while the page was on its way
+    if (!nextToken(&fields, &firstField) || fields.done || firstField.length == 0 ||
+        strcmp(pageChat, activeChat) || strcmp(activeChat, activeChatSequenceChat) || pageBefore != activeTranscript->firstSequence) {
+
+        return;
+    }
+
+    CoprocessorView messages = {fields.cursor, fields.end - fields.cursor};
+    CoprocessorView pageMessages[MESSAGE_PAGE_MESSAGES];
+    short count = 0;
+    CoprocessorTokenizer messageTokenizer;
+
+    beginTokenizer(&messageTokenizer, messages.data, messages.length, "ENDLASTMESSAGE");
+
+    while (messages.length > 0 && count < MESSAGE_PAGE_MESSAGES && nextToken(&messageTokenizer, &pageMessages[count])) {
+
+        count++;
+    }
+
+    if (count == 0 || count != pageBefore - viewToLong(&firstField) || !prependTranscriptMessages(activeTranscript, pageMessages, count)) {
+
+        transcriptHistoryComplete = true;
+
+        return;
+    }
+
+    invalidateWindow(MESSAGES_WINDOW, INVALIDATE_MESSAGES_CHANGED);
 }
 
 // function to send messages in chat
@@ -156,21 +388,41 @@ void sendMessage() {
         writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: sendMessage");
     #endif
 
-    char output[2048];
-    sprintf(output, "%s&&&%.*s", activeChat, box_input_len, box_input_buffer);
+    long mark = scratchMark(&callScratch);
+    char *output = scratchAlloc(&callScratch, SEND_MESSAGE_ARGUMENTS_SIZE);
+    char *response = scratchAlloc(&callScratch, MAX_RECEIVE_SIZE);
+
+    if (response == NULL) {
 
-    memset(box_input_buffer, '\0', 2048);
+        scratchRelease(&callScratch, mark);
+
+        return;
+    }
+
+    CoprocessorArguments arguments;
+
+    // the message goes as it is, it can hold our delimiters and index.js still gets it whole.
+    // it can fill all of the input's 2048 bytes, and there is room for what goes in front of it
+    beginCoprocessorArguments(&arguments, output, SEND_MESSAGE_ARGUMENTS_SIZE);
+    addCoprocessorArgument(&arguments, activeChat, strlen(activeChat) < 63 ? strlen(activeChat) : 63);
+    addCoprocessorNumberArgument(&arguments, getActiveChatSequence());
+    addCoprocessorArgument(&arguments, box_input_buffer, box_input_len);
+
+    memset(box_input_buffer, '\0', MAX_MESSAGE_INPUT_LENGTH);
     box_input_len = 0;
 
     // this was an attempt to get the text in the textbox to go away... doesn't really work for a few more redraws
     // so actually just makes things slower:
     // refreshNuklearApp(1);
 
-    callFunctionOnCoprocessor("sendMessage", output, jsFunctionResponse);
+    callFunctionOnCoprocessor("sendMessageSince", &arguments, response);
+
+    if (applyMessagesDelta(response, strlen(response))) {
 
-    getMessagesFromjsFunctionResponse();
+        invalidateWindow(MESSAGES_WINDOW, INVALIDATE_MESSAGES_CHANGED);
+    }
 
-    forceRedrawMessages = 3;
+    scratchRelease(&callScratch, mark);
 
     return;
 }
@@ -183,19 +435,38 @@ void getChats() {
         writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: getChats");
     #endif
 
-    callFunctionOnCoprocessor("getChats", "", jsFunctionResponse);
+    long mark = scratchMark(&callScratch);
+    char *response = scratchAlloc(&callScratch, MAX_RECEIVE_SIZE);
+
+    if (response == NULL) {
+
+        return;
+    }
+
+    callFunctionOnCoprocessor("getChats", NULL, response);
+
+    CoprocessorTokenizer chats;
+    CoprocessorView chat;
+
+    beginTokenizer(&chats, response, strlen(response), ",");
+
+    // the names are read fresh every time, so start the list over rather than adding to the end of
+    // the last one. chatFriendlyNames only has room for MAX_CHATS names of MAX_FRIENDLY_NAME_LENGTH
+    chatFriendlyNamesCounter = 0;
 
-    char *token = (char *)strtokm(jsFunctionResponse, ",");
+    while (chatFriendlyNamesCounter < MAX_CHATS && nextToken(&chats, &chat)) {
 
-    while (token != NULL) {
+        sprintf(&chatFriendlyNames[chatFriendlyNamesCounter++ * MAX_FRIENDLY_NAME_LENGTH], "%.*s", (int)(chat.length < 63 ? chat.length : 63), chat.data);
 
         #ifdef MESSAGES_FOR_MACINTOSH_DEBUGGING
-            writeSerialPortDebug(boutRefNum, token);
+            writeSerialPortDebug(boutRefNum, &chatFriendlyNames[(chatFriendlyNamesCounter - 1) * MAX_FRIENDLY_NAME_LENGTH]);
         #endif
-        sprintf(&chatFriendlyNames[chatFriendlyNamesCounter++ * MAX_FRIENDLY_NAME_LENGTH], "%s", token); 
-        token = (char *)strtokm(NULL, ",");
     }
 
+    invalidateWindow(CHATS_WINDOW, INVALIDATE_CHATS_CHANGED);
+
+    scratchRelease(&callScratch, mark);
+
     return;
 }
 
@@ -205,10 +476,26 @@ void sendIPAddressToCoprocessor() {
         writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: sendIPAddressToCoprocessor");
     #endif
 
-    char output[2048];
-    sprintf(output, "%.*s", ip_input_buffer_len, ip_input_buffer);
+    long mark = scratchMark(&callScratch);
+    char *output = scratchAlloc(&callScratch, 2048);
+    char *response = scratchAlloc(&callScratch, MAX_RECEIVE_SIZE);
+
+    if (response == NULL) {
+
+        scratchRelease(&callScratch, mark);
+
+        return;
+    }
+
+    CoprocessorArguments arguments;
 
-    callFunctionOnCoprocessor("setIPAddress", output, jsFunctionResponse);
+    beginCoprocessorArguments(&arguments, output, 2048);
+    addCoprocessorArgument(&arguments, ip_input_buffer, ip_input_buffer_len);
+
+    callFunctionOnCoprocessor("setIPAddress", &arguments, response);
+
+    // getChats needs the room for its own response
+    scratchRelease(&callScratch, mark);
 
     // now that the IP is set, we can get all of our chats
     getChats();
@@ -225,41 +512,50 @@ void getMessages(char *thread, int page) {
         writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: getMessages");
     #endif
 
-    char output[68];
-    sprintf(output, "%s&&&%d", thread, page);
+    char output[128];
+    CoprocessorArguments arguments;
 
-    callFunctionOnCoprocessor("getMessages", output, jsFunctionResponse);
-    getMessagesFromjsFunctionResponse();
+    beginCoprocessorArguments(&arguments, output, sizeof(output));
+    addCoprocessorArgument(&arguments, thread, strlen(thread) < 63 ? strlen(thread) : 63);
+    addCoprocessorNumberArgument(&arguments, page);
+    addCoprocessorNumberArgument(&arguments, getActiveChatSequence());
 
-    forceRedrawMessages = 3;
+    long mark = scratchMark(&callScratch);
+    char *response = scratchAlloc(&callScratch, MAX_RECEIVE_SIZE);
 
-    return;
-}
+    if (response == NULL) {
 
-// from https://stackoverflow.com/a/4770992
-Boolean prefix(const char *pre, const char *str) {
+        return;
+    }
 
-    #ifdef DEBUG_FUNCTION_CALLS
-        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: prefix");
-    #endif
-    return strncmp(pre, str, strlen(pre)) == 0;
+    // only the rows we have not seen come back, and if there are none there is nothing to redraw
+    callFunctionOnCoprocessor("getMessagesSince", &arguments, response);
+
+    if (applyMessagesDelta(response, strlen(response))) {
+
+        invalidateWindow(MESSAGES_WINDOW, INVALIDATE_MESSAGES_CHANGED);
+    }
+
+    scratchRelease(&callScratch, mark);
+
+    return;
 }
 
-void getChatCounts() {
+// counts is NAME:::COUNT,NAME:::COUNT... and is only read, so it can be parsed where it arrived,
+// whether that is the receive ring or an event
+void updateChatCountsFromResponse(const char *counts, long length) {
 
     #ifdef DEBUG_FUNCTION_CALLS
-        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: getChatCounts");
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: updateChatCountsFromResponse");
     #endif
 
-    callFunctionOnCoprocessor("getChatCounts", "", chatCountFunctionResponse);
+    if (length > MAX_RECEIVE_SIZE - 1) {
 
-    #ifdef MESSAGES_FOR_MACINTOSH_DEBUGGING
-        writeSerialPortDebug(boutRefNum, "getChatCounts");
-        writeSerialPortDebug(boutRefNum, chatCountFunctionResponse);
-    #endif
+        length = MAX_RECEIVE_SIZE - 1;
+    }
 
     // bail out if the responses ARE equal
-    if (!strcmp(chatCountFunctionResponse, previousChatCountFunctionResponse)) {
+    if (length == strlen(previousChatCountFunctionResponse) && !memcmp(counts, previousChatCountFunctionResponse, length)) {
 
         #ifdef MESSAGES_FOR_MACINTOSH_DEBUGGING
             writeSerialPortDebug(boutRefNum, "no need to update current chat count");
@@ -272,183 +568,334 @@ void getChatCounts() {
         // TODO: if you hear a random sysbeep, it's probably caused by a mismatch here
         // potentially due to a bad serial port read or allocation. needs more investigation
         writeSerialPortDebug(boutRefNum, "update current chat count");
-        writeSerialPortDebug(boutRefNum, chatCountFunctionResponse);
         writeSerialPortDebug(boutRefNum, previousChatCountFunctionResponse);
     #endif
 
-    strcpy(previousChatCountFunctionResponse, chatCountFunctionResponse);
-
-    SysBeep(1);
+    memcpy(previousChatCountFunctionResponse, counts, length);
+    previousChatCountFunctionResponse[length] = '\0';
 
-    strcpy(tempChatCountFunctionResponse, chatCountFunctionResponse);
-    int chatCount = 0;
-
-    char **chats = strsplit_count(tempChatCountFunctionResponse, ",", &chatCount);
-
-    for (int chatLoopCounter = 0; chatLoopCounter < chatCount; chatLoopCounter++) {
+    #ifdef MESSAGES_FOR_MACINTOSH_DEBUGGING
+        writeSerialPortDebug(boutRefNum, previousChatCountFunctionResponse);
+    #endif
 
-        #ifdef MESSAGES_FOR_MACINTOSH_DEBUGGING 
-            writeSerialPortDebug(boutRefNum, "DUMMY DELETE: update current chat count loop");
-            writeSerialPortDebug(boutRefNum, chats[chatLoopCounter]);
-        #endif
-    }
+    SysBeep(1);
 
-    // loop through the string to extract all other tokens
-    for (int chatLoopCounter = 0; chatLoopCounter < chatCount; chatLoopCounter++) {
+    CoprocessorTokenizer chats;
+    CoprocessorView chat;
 
-        #ifdef MESSAGES_FOR_MACINTOSH_DEBUGGING 
-            writeSerialPortDebug(boutRefNum, "update current chat count loop");
-            writeSerialPortDebug(boutRefNum, chats[chatLoopCounter]);
-        #endif
+    beginTokenizer(&chats, counts, length, ",");
 
-        // chats[chatLoopCounter] should be in format NAME:::COUNT
+    while (nextToken(&chats, &chat)) {
 
-        strcpy(tempChatCountFunctionResponse, chatCountFunctionResponse);
-        int results = 0;
+        // chat should be in format NAME:::COUNT
+        CoprocessorTokenizer fields;
+        CoprocessorView name;
+        CoprocessorView countField;
+        CoprocessorView extraField;
 
-        char **chatUpdate = strsplit_count((char *)chats[chatLoopCounter], ":::", &results);
+        beginTokenizer(&fields, chat.data, chat.length, ":::");
 
-        if (results != 2) {
+        if (!nextToken(&fields, &name) || !nextToken(&fields, &countField) || nextToken(&fields, &extraField)) {
 
-            #ifdef MESSAGES_FOR_MACINTOSH_DEBUGGING 
+            #ifdef MESSAGES_FOR_MACINTOSH_DEBUGGING
                 char x[255];
-                sprintf(x, "ERROR: chat update mismatch splitting on ':::', expected 2 results, got: %d: %s -- bailing out", results, chats[chatLoopCounter]);
+                sprintf(x, "ERROR: chat update mismatch splitting on ':::', expected 2 results: %.*s -- bailing out", (int)(chat.length < 160 ? chat.length : 160), chat.data);
                 writeSerialPortDebug(boutRefNum, x);
-
-                for (int errorResultCounter = 0; errorResultCounter < results; errorResultCounter++) {
-
-                    writeSerialPortDebug(boutRefNum, chatUpdate[errorResultCounter]);
-
-                    char y[255];
-                    sprintf(y, "%d/%d: '%s'", errorResultCounter, results, chatUpdate[errorResultCounter]);
-                    writeSerialPortDebug(boutRefNum, y);
-                }
             #endif
 
             continue;
         }
 
-        short count = atoi((char *)chatUpdate[1]);
+        short count = viewToLong(&countField);
+        int nameLength = name.length < 63 ? name.length : 63;
 
         #ifdef MESSAGES_FOR_MACINTOSH_DEBUGGING
             char x[255];
-            sprintf(x, "name: %s, countString: %s, count: %d", chatUpdate[0], chatUpdate[1], count);
+            sprintf(x, "name: %.*s, count: %d", nameLength, name.data, count);
             writeSerialPortDebug(boutRefNum, x);
         #endif
 
         for (int i = 0; i < chatFriendlyNamesCounter; i++) {
 
-            if (strstr(&chatFriendlyNames[i * MAX_FRIENDLY_NAME_LENGTH], " new) ") != NULL) {
+            // names that already have a count on them are shown as "(N new) NAME"
+            char *displayedName = &chatFriendlyNames[i * MAX_FRIENDLY_NAME_LENGTH];
+            char *countEnd = strstr(displayedName, " new) ");
 
-                char chatName[64];
-                sprintf(chatName, "%.63s", &chatFriendlyNames[i * MAX_FRIENDLY_NAME_LENGTH]);
+            if (countEnd != NULL) {
 
-                int updateResults = 0;
+                displayedName = countEnd + 6;
+            }
 
-                char **updatePieces = strsplit_count(chatName, " new) ", &updateResults);
+            if (!viewStartsWith(&name, displayedName)) {
 
-                if (updateResults != 2) {
+                continue;
+            }
 
-                    #ifdef MESSAGES_FOR_MACINTOSH_DEBUGGING
-                        char x[255];
-                        sprintf(x, "ERROR: individual chat update mismatch splitting on ' new) ', expected 2 results, got: %d: %s -- bailing out", updateResults, chatName);
-                        writeSerialPortDebug(boutRefNum, x);
+            #ifdef MESSAGES_FOR_MACINTOSH_DEBUGGING
+                writeSerialPortDebug(boutRefNum, "match");
+                writeSerialPortDebug(boutRefNum, displayedName);
+            #endif
 
-                        for (int errorResultCounter = 0; errorResultCounter < updateResults; errorResultCounter++) {
+            if (count == 0 || viewEquals(&name, activeChat)) {
 
-                            char y[255];
-                            sprintf(y, "%d/%d: '%s'", errorResultCounter, updateResults, updatePieces[errorResultCounter]);
-                            writeSerialPortDebug(boutRefNum, y);
-                        }
-                    #endif
+                sprintf(&chatFriendlyNames[i * MAX_FRIENDLY_NAME_LENGTH], "%.*s", nameLength, name.data);
+            } else {
 
-                    continue;
-                }
+                sprintf(&chatFriendlyNames[i * MAX_FRIENDLY_NAME_LENGTH], "(%d new) %.*s", count, nameLength, name.data);
+            }
 
-                if (prefix((char *)updatePieces[1], (char *)chatUpdate[0])) {
+            break;
+        }
+    }
 
-                    #ifdef MESSAGES_FOR_MACINTOSH_DEBUGGING
-                        writeSerialPortDebug(boutRefNum, "match1");
-                        writeSerialPortDebug(boutRefNum, chatUpdate[0]);
-                    #endif
+    invalidateWindow(CHATS_WINDOW, INVALIDATE_CHATS_CHANGED);
 
-                    if (count == 0 || !strcmp(activeChat, (char *)chatUpdate[0])) {
+    return;
+}
 
-                        sprintf(&chatFriendlyNames[i * MAX_FRIENDLY_NAME_LENGTH], "%.63s", (char *)chatUpdate[0]);
-                    } else {
+// checks for new chat counts and for new messages in the active chat with one batched round trip,
+// without waiting for it. the response is handled by updateFromSyncResponse once
+// pollBackgroundCoprocessorCalls sees it arrive. this is syncTask, so returns whether it sent anything
+Boolean syncWithCoprocessor() {
 
-                        sprintf(&chatFriendlyNames[i * MAX_FRIENDLY_NAME_LENGTH], "(%d new) %.63s", count, (char *)chatUpdate[0]);
-                    }
-                    break;
-                }
-            } else if (prefix(&chatFriendlyNames[i * MAX_FRIENDLY_NAME_LENGTH], (char *)chatUpdate[0])) {
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: syncWithCoprocessor");
+    #endif
 
-                #ifdef MESSAGES_FOR_MACINTOSH_DEBUGGING
-                    writeSerialPortDebug(boutRefNum, "match2");
-                    writeSerialPortDebug(boutRefNum, chatUpdate[0]);
-                #endif
+    // the previous sync is still waiting on its answer, so go as soon as it has one
+    if (syncCall.state != COPROCESSOR_CALL_IDLE) {
 
-                if (count == 0 || !strcmp(activeChat, (char *)chatUpdate[0])) {
+        scheduleTask(syncTask, TickCount() + 1);
 
-                    sprintf(&chatFriendlyNames[i * MAX_FRIENDLY_NAME_LENGTH], "%.63s", (char *)chatUpdate[0]);
-                } else {
+        return false;
+    }
 
-                    sprintf(&chatFriendlyNames[i * MAX_FRIENDLY_NAME_LENGTH], "(%d new) %.63s", count, (char *)chatUpdate[0]);
-                }
-                break;
-            }
-        }
+    beginCoprocessorBatch(&syncBatch);
+
+    syncIncludesChatCounts = chatFriendlyNamesCounter > 0 && addFunctionToCoprocessorBatch(&syncBatch, "getChatCounts", NULL);
+    syncIncludesNewMessages = false;
+
+    if (strcmp(activeChat, "no active chat")) {
+
+        // getNewMessages is hasNewMessagesInChat and getMessages rolled in to one, so new messages
+        // come back in this same response rather than costing another round trip
+        char output[128];
+        CoprocessorArguments arguments;
+
+        sprintf(syncChat, "%.63s", activeChat);
+
+        beginCoprocessorArguments(&arguments, output, sizeof(output));
+        addCoprocessorStringArgument(&arguments, syncChat);
+        addCoprocessorNumberArgument(&arguments, 0);
+        addCoprocessorNumberArgument(&arguments, getActiveChatSequence());
+
+        syncIncludesNewMessages = addFunctionToCoprocessorBatch(&syncBatch, "getNewMessages", &arguments);
     }
 
-    forceRedrawChats = 3;
+    if (syncBatch.callCount == 0) {
 
-    return;
+        return false;
+    }
+
+    // the answer is nearly always "nothing changed", so it is looked at where it lands in the
+    // receive ring rather than copied out
+    callBatchOnCoprocessorViewAsync(&syncBatch, syncFunctionResponse, MAX_RECEIVE_SIZE, &syncCall);
+
+    return true;
 }
 
-void getHasNewMessagesInChat(char *thread) {
+// called by the event loop once the coprocessor is loaded, which is when the first sync goes out
+void scheduleNuklearAppTasks(long now) {
 
     #ifdef DEBUG_FUNCTION_CALLS
-        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: getHasNewMessagesInChat");
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: scheduleNuklearAppTasks");
     #endif
 
-    char output[68];
-    sprintf(output, "%s", thread);
+    syncTask = addScheduledTask("sync", syncWithCoprocessor, SYNC_INTERVAL_TICKS, SYNC_JITTER_TICKS, true, now);
+    pageTask = addScheduledTask("messagePage", requestOlderMessages, 0, MESSAGE_PAGE_JITTER_TICKS, true, now);
+}
+
+void updateFromSyncResponse() {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: updateFromSyncResponse");
+    #endif
+
+    CoprocessorView results[2];
+    short resultCount = splitCoprocessorBatchResults(&syncCall.view, results, 2);
+    short resultIndex = 0;
 
-    callFunctionOnCoprocessor("hasNewMessagesInChat", output, jsFunctionResponse);
+    if (syncIncludesChatCounts) {
+
+        // the counts rarely change, and updateChatCountsFromResponse compares them in place
+        if (resultIndex < resultCount) {
+
+            updateChatCountsFromResponse(results[resultIndex].data, results[resultIndex].length);
+        }
+
+        resultIndex++;
+    }
 
-    if (!strcmp(jsFunctionResponse, "true")) {
+    // an empty result means there was nothing new. if the user has switched chats since the sync
+    // went out, these messages are for a chat that is no longer on screen
+    if (!syncIncludesNewMessages || resultIndex >= resultCount || results[resultIndex].length == 0 || strcmp(syncChat, activeChat)) {
+
+        #ifdef MESSAGES_FOR_MACINTOSH_DEBUGGING
+            writeSerialPortDebug(boutRefNum, "do not update current chat");
+        #endif
+
+        return;
+    }
+
+    // applyMessagesDelta only reads the delta, so it is parsed straight out of the receive ring
+    if (applyMessagesDelta(results[resultIndex].data, results[resultIndex].length)) {
 
         #ifdef MESSAGES_FOR_MACINTOSH_DEBUGGING
             writeSerialPortDebug(boutRefNum, "update current chat");
         #endif
 
         SysBeep(1);
-        getMessages(thread, 0);
+
+        invalidateWindow(MESSAGES_WINDOW, INVALIDATE_MESSAGES_CHANGED);
     }
-    #ifdef MESSAGES_FOR_MACINTOSH_DEBUGGING
-        else {
 
-            writeSerialPortDebug(boutRefNum, "do not update current chat");
+    return;
+}
+
+// called once per event loop iteration so that background requests are completed without
+// ever blocking rendering or input while the coprocessor is working
+void pollBackgroundCoprocessorCalls() {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: pollBackgroundCoprocessorCalls");
+    #endif
+
+    pollCoprocessorEvents();
+
+    if (pollCoprocessorCall(&syncCall)) {
+
+        if (syncCall.state == COPROCESSOR_CALL_COMPLETE) {
+
+            updateFromSyncResponse();
         }
+
+        releaseCoprocessorView(&syncCall);
+        syncCall.state = COPROCESSOR_CALL_IDLE;
+    }
+
+    if (pollCoprocessorCall(&pageCall)) {
+
+        if (pageCall.state == COPROCESSOR_CALL_COMPLETE) {
+
+            applyMessagePage(&pageCall.view);
+        }
+
+        releaseCoprocessorView(&pageCall);
+        pageCall.state = COPROCESSOR_CALL_IDLE;
+    }
+}
+
+// handles the EVENT frames that index.js pushes when it notices something change, in the form
+// name&&&data. this can be called from inside a blocking coprocessor call, so it must only update
+// our own state and never call the coprocessor itself
+void handleCoprocessorEvent(char *payload) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: handleCoprocessorEvent");
     #endif
 
+    // the coprocessor pushes us changes, so polling for them is now only a safety net, and the
+    // event loop wakes often enough to notice them
+    setScheduledTaskPeriod(syncTask, PUSHED_SYNC_INTERVAL_TICKS);
+    coprocessorPushesEvents = true;
+
+    char *data = strstr(payload, "&&&");
+
+    if (data == NULL) {
+
+        return;
+    }
+
+    *data = '\0';
+    data += 3;
+
+    if (!strcmp(payload, "chatCounts")) {
+
+        updateChatCountsFromResponse(data, strlen(data));
+    } else if (!strcmp(payload, "newMessages")) {
+
+        // data is chat&&&delta, see applyMessagesDelta
+        char *messages = strstr(data, "&&&");
+
+        if (messages == NULL) {
+
+            return;
+        }
+
+        *messages = '\0';
+        messages += 3;
+
+        if (strcmp(data, activeChat) || !applyMessagesDelta(messages, strlen(messages))) {
+
+            return;
+        }
+
+        #ifdef MESSAGES_FOR_MACINTOSH_DEBUGGING
+            writeSerialPortDebug(boutRefNum, "new messages pushed for current chat");
+        #endif
+
+        SysBeep(1);
+
+        invalidateWindow(MESSAGES_WINDOW, INVALIDATE_MESSAGES_CHANGED);
+    }
+
     return;
 }
 
-Boolean chatWindowCollision;
-Boolean messageWindowCollision;
-
-Boolean checkCollision(struct nk_rect window) {
+Boolean checkCollision(struct nk_rect window, int x, int y) {
 
     #ifdef DEBUG_FUNCTION_CALLS
         writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: checkCollision");
     #endif
 
-    // if truthy return, mouse is over window!
-    return (window.x < mouse_x &&
-       window.x + window.w > mouse_x &&
-       window.y < mouse_y &&
-       window.y + window.h > mouse_y);
+    // if truthy return, x, y is over window!
+    return (window.x < x &&
+       window.x + window.w > x &&
+       window.y < y &&
+       window.y + window.h > y);
+}
+
+// invalidates whichever of the chat list and messages windows x, y is over
+void invalidateWindowAt(int x, int y, unsigned short reason) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: invalidateWindowAt");
+    #endif
+
+    if (checkCollision(chats_window_size, x, y)) {
+
+        invalidateWindow(CHATS_WINDOW, reason);
+    }
+
+    if (checkCollision(messages_window_size, x, y)) {
+
+        invalidateWindow(MESSAGES_WINDOW, reason);
+    }
+}
+
+#include "hover_map.h"
+
+// a dialog is drawn in place of the other windows, but they are still begun, with nothing laid out
+// in them, so that nk_clear does not free them and the messages window's scroll offset with them
+static void keepWindowsUnderDialog(struct nk_context *ctx) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: keepWindowsUnderDialog");
+    #endif
+
+    nk_begin(ctx, "Chats", chats_window_size, NK_WINDOW_BORDER|NK_WINDOW_NO_SCROLLBAR|NK_WINDOW_SKIP_RENDER);
+    nk_begin(ctx, "Message Input", message_input_window_size, NK_WINDOW_BORDER|NK_WINDOW_NO_SCROLLBAR|NK_WINDOW_SKIP_RENDER);
+    nk_begin_titled(ctx, "Message", activeChat, messages_window_size, NK_WINDOW_BORDER|NK_WINDOW_TITLE|NK_WINDOW_NO_SCROLLBAR|NK_WINDOW_SKIP_RENDER);
 }
 
 // UI setup and event handling goes here
@@ -461,6 +908,9 @@ static void nuklearApp(struct nk_context *ctx) {
     // prompt the user for the graphql instance
     if (!coprocessorLoaded) {
 
+        keepWindowsUnderDialog(ctx);
+        clearInvalidationsUnderDialog(graphql_input_window_size);
+
         if (nk_begin_titled(ctx, "Loading coprocessor services", "Loading coprocessor services", graphql_input_window_size, NK_WINDOW_TITLE|NK_WINDOW_BORDER)) {
 
             nk_layout_row_begin(ctx, NK_STATIC, 20, 1);
@@ -479,8 +929,13 @@ static void nuklearApp(struct nk_context *ctx) {
     // prompt the user for the graphql instance
     if (!ipAddressSet) {
 
+        keepWindowsUnderDialog(ctx);
+        clearInvalidationsUnderDialog(graphql_input_window_size);
+
         if (nk_begin_titled(ctx, "Enter iMessage GraphQL Server", "Enter iMessage GraphQL Server", graphql_input_window_size, NK_WINDOW_TITLE|NK_WINDOW_BORDER)) {
 
+            clearHoverRects(DIALOG_WINDOW);
+
             nk_layout_row_begin(ctx, NK_STATIC, 20, 1);
             {
                 nk_layout_row_push(ctx, 200);
@@ -492,14 +947,16 @@ static void nuklearApp(struct nk_context *ctx) {
             {
 
                 nk_layout_row_push(ctx, WINDOW_WIDTH / 2 - 100);
+                addHoverRect(DIALOG_WINDOW, nk_widget_bounds(ctx));
                 short ip_edit_return_value = nk_edit_string(ctx, NK_EDIT_ALWAYS_INSERT_MODE|NK_EDIT_GOTO_END_ON_ACTIVATE, ip_input_buffer, &ip_input_buffer_len, 255, nk_filter_default);
                 nk_layout_row_push(ctx, 55);
+                addHoverRect(DIALOG_WINDOW, nk_widget_bounds(ctx));
 
                 if (nk_button_label(ctx, "save") || ip_edit_return_value == 17) {
                 
                     ipAddressSet = 1;
-                    forceRedrawChats = 2;
-                    forceRedrawMessages = 2;
+                    invalidateWindow(CHATS_WINDOW, INVALIDATE_DIALOG_CLOSED);
+                    invalidateWindow(MESSAGES_WINDOW, INVALIDATE_DIALOG_CLOSED);
                     sendIPAddressToCoprocessor();
                 }
             }
@@ -508,24 +965,20 @@ static void nuklearApp(struct nk_context *ctx) {
             nk_end(ctx);
         }
 
-        // eliminate the initially-set force-redraw
-        if (forceRedrawChats) {
-            
-            forceRedrawChats--;
-        }
-
-        if (forceRedrawMessages) {
-            
-            forceRedrawMessages--;
-        }
-
         return;
     }
 
     // prompt the user for new chat
     if (sendNewChat) {
 
-        if (nk_begin_titled(ctx, "Enter New Message Recipient", "Enter New Message Recipient",  nk_rect(50, WINDOW_HEIGHT / 4, WINDOW_WIDTH - 100, 140), NK_WINDOW_TITLE|NK_WINDOW_BORDER)) {
+        struct nk_rect new_chat_window_size = nk_rect(50, WINDOW_HEIGHT / 4, WINDOW_WIDTH - 100, 140);
+
+        keepWindowsUnderDialog(ctx);
+        clearInvalidationsUnderDialog(new_chat_window_size);
+
+        if (nk_begin_titled(ctx, "Enter New Message Recipient", "Enter New Message Recipient", new_chat_window_size, NK_WINDOW_TITLE|NK_WINDOW_BORDER)) {
+
+            clearHoverRects(DIALOG_WINDOW);
 
             nk_layout_row_begin(ctx, NK_STATIC, 30, 1);
             {
@@ -539,22 +992,20 @@ static void nuklearApp(struct nk_context *ctx) {
             nk_layout_row_begin(ctx, NK_STATIC, 30, 2);
             {
                 nk_layout_row_push(ctx, WINDOW_WIDTH / 2);
+                addHoverRect(DIALOG_WINDOW, nk_widget_bounds(ctx));
                 nk_edit_string(ctx, NK_EDIT_SIMPLE, new_message_input_buffer, &new_message_input_buffer_len, 2048, nk_filter_default);
                 nk_layout_row_push(ctx, 100);
+                addHoverRect(DIALOG_WINDOW, nk_widget_bounds(ctx));
 
                 if (nk_button_label(ctx, "open chat")) {
                 
                     sendNewChat = 0;
-                    forceRedrawChats = 2;
-                    forceRedrawMessages = 2;
+                    invalidateWindow(CHATS_WINDOW, INVALIDATE_DIALOG_CLOSED);
+                    invalidateWindow(MESSAGES_WINDOW, INVALIDATE_DIALOG_CLOSED);
 
                     sprintf(activeChat, "%.*s", new_message_input_buffer_len, new_message_input_buffer);
 
-                    for (int i = 0; i < MAX_CHAT_MESSAGES; i++) {
-
-                        memset(&activeChatMessages[i * 2048], '\0', 2048);
-                    }
-
+                    // the new chat has no sequence yet, so this replaces whatever rows we had
                     getMessages(activeChat, 0);
                 }
             }
@@ -566,16 +1017,31 @@ static void nuklearApp(struct nk_context *ctx) {
         return;
     }
 
-    chatWindowCollision = checkCollision(chats_window_size);
+    // the dialogs are gone, and with them their hover rects
+    clearHoverRects(DIALOG_WINDOW);
 
-    if ((chatWindowCollision || forceRedrawChats) && nk_begin(ctx, "Chats", chats_window_size, NK_WINDOW_BORDER|NK_WINDOW_NO_SCROLLBAR)) {
+    // an input only frame leaves these for later, see drawInputOnly
+    Boolean drawChats = !drawInputOnly && windowInvalidations[CHATS_WINDOW];
+    Boolean drawMessages = !drawInputOnly && windowInvalidations[MESSAGES_WINDOW];
 
-        // we force a redraw for several following iterations in case the mouse has moved away,
-        // we want to ensure that the button highlighting disappears
-        if (chatWindowCollision && firstOrMouseMove) {
+    // anything invalidated from here on is for the next frame
+    if (drawChats) {
 
-            forceRedrawChats = 3;
-        }
+        windowInvalidations[CHATS_WINDOW] = 0;
+    }
+
+    if (drawMessages) {
+
+        windowInvalidations[MESSAGES_WINDOW] = 0;
+    }
+
+    windowInvalidations[MESSAGE_INPUT_WINDOW] = 0;
+
+    // a window that is not drawn this frame is still begun, so that nk_clear does not free it. it
+    // keeps its state, and what it drew last time stays on the screen
+    if (nk_begin(ctx, "Chats", chats_window_size, NK_WINDOW_BORDER|NK_WINDOW_NO_SCROLLBAR|(drawChats ? 0 : NK_WINDOW_SKIP_RENDER))) {
+
+        clearHoverRects(CHATS_WINDOW);
 
         nk_layout_row_begin(ctx, NK_STATIC, 25, 1);
         {
@@ -588,6 +1054,7 @@ static void nuklearApp(struct nk_context *ctx) {
                 }
 
                 nk_layout_row_push(ctx, 169);
+                addHoverRect(CHATS_WINDOW, nk_widget_bounds(ctx));
 
                 if (nk_button_label(ctx, &chatFriendlyNames[i * MAX_FRIENDLY_NAME_LENGTH])) {
 
@@ -601,23 +1068,24 @@ static void nuklearApp(struct nk_context *ctx) {
                             writeSerialPortDebug(boutRefNum, chatName);
                         #endif
 
+                        CoprocessorTokenizer pieces;
+                        CoprocessorView name;
+
                         // we are throwing out the first token
-                        char *name = (char *)strtokm(chatName, " new) ");
+                        beginTokenizer(&pieces, chatName, strlen(chatName), " new) ");
+                        nextToken(&pieces, &name);
 
-                        #ifdef MESSAGES_FOR_MACINTOSH_DEBUGGING
-                            writeSerialPortDebug(boutRefNum, "clicked1 portion1 of string, will toss");
-                            writeSerialPortDebug(boutRefNum, name);
-                        #endif
+                        if (!nextToken(&pieces, &name)) {
 
-                        name = (char *)strtokm(NULL, " new) ");
+                            name.length = 0;
+                        }
 
                         #ifdef MESSAGES_FOR_MACINTOSH_DEBUGGING
                             writeSerialPortDebug(boutRefNum, "clicked1 have name to assign to activeChat");
-                            writeSerialPortDebug(boutRefNum, name);
                         #endif
 
-                        sprintf(activeChat, "%.63s", name);
-                        sprintf(&chatFriendlyNames[i * MAX_FRIENDLY_NAME_LENGTH], "%.63s", name);
+                        sprintf(activeChat, "%.*s", (int)name.length, name.data);
+                        sprintf(&chatFriendlyNames[i * MAX_FRIENDLY_NAME_LENGTH], "%.*s", (int)name.length, name.data);
                     } else {
 
                         #ifdef MESSAGES_FOR_MACINTOSH_DEBUGGING
@@ -628,7 +1096,8 @@ static void nuklearApp(struct nk_context *ctx) {
                         sprintf(activeChat, "%.63s", &chatFriendlyNames[i * MAX_FRIENDLY_NAME_LENGTH]);
                     }
 
-                    forceRedrawChats = 6; // redraw the chat list for several iterations in an attempt to get rid of the hovered button
+                    invalidateWindow(CHATS_WINDOW, INVALIDATE_ACTIVE_CHAT);
+                    invalidateWindow(MESSAGES_WINDOW, INVALIDATE_ACTIVE_CHAT);
                     getMessages(activeChat, 0);
                 }
             }
@@ -645,9 +1114,12 @@ static void nuklearApp(struct nk_context *ctx) {
         {
             nk_layout_row_push(ctx, 312);
 
+            clearHoverRects(MESSAGE_INPUT_WINDOW);
+            addHoverRect(MESSAGE_INPUT_WINDOW, nk_widget_bounds(ctx));
+
             nk_edit_focus(ctx, NK_EDIT_ALWAYS_INSERT_MODE);
 
-            short edit_return_value = nk_edit_string(ctx, NK_EDIT_FIELD|NK_EDIT_SIG_ENTER, box_input_buffer, &box_input_len, 2048, nk_filter_default);
+            short edit_return_value = nk_edit_string(ctx, NK_EDIT_FIELD|NK_EDIT_SIG_ENTER, box_input_buffer, &box_input_len, MAX_MESSAGE_INPUT_LENGTH, nk_filter_default);
 
             // this is the enter key, obviously
             if (edit_return_value == 17 && box_input_len > 0) {
@@ -660,33 +1132,82 @@ static void nuklearApp(struct nk_context *ctx) {
         nk_end(ctx);
     }
 
-    if ((forceRedrawMessages) && nk_begin_titled(ctx, "Message", activeChat, messages_window_size, NK_WINDOW_BORDER|NK_WINDOW_TITLE|NK_WINDOW_NO_SCROLLBAR)) {
+    if (nk_begin_titled(ctx, "Message", activeChat, messages_window_size, NK_WINDOW_BORDER|NK_WINDOW_TITLE|NK_WINDOW_NO_SCROLLBAR|(drawMessages ? 0 : NK_WINDOW_SKIP_RENDER))) {
 
-        nk_layout_row_begin(ctx, NK_STATIC, 11, 1);
-        {
+        struct nk_list_view messageList;
+        struct nk_rect content = nk_window_get_content_region(ctx);
+        short rowHeight = MESSAGE_ROW_HEIGHT + ctx->style.window.spacing.y;
+        short listHeight = (short)content.h - ctx->style.window.spacing.y;
 
-            for (int i = 0; i < activeMessageCounter; i++) {
+        // messages are only broken in to lines again when they are new or the width changes. when
+        // rows come or go, put back whatever was at the top of the list, or stay at the bottom. this
+        // is not done every frame, as snapping the offset to a whole row would eat any scrolling
+        // smaller than a row
+        if (layoutTranscript(activeTranscript, (short)messages_window_size.w - MESSAGE_WRAP_MARGIN, nk_quickdraw_char_width)) {
 
-                nk_layout_row_push(ctx, 305);
+            short topRow = 0;
+            long anchor = messagesAnchorSequence - activeTranscript->firstSequence;
 
-                // writeSerialPortDebug(boutRefNum, "activeChatMessages[i]");
-                // writeSerialPortDebug(boutRefNum, activeChatMessages[i]);
-                nk_label(ctx, &activeChatMessages[i * 2048], NK_TEXT_ALIGN_LEFT);
+            if (messagesFollowNewest) {
+
+                topRow = NK_MAX(activeTranscript->rowCount - (listHeight - ctx->style.window.group_padding.y * 2) / rowHeight, 0);
+            } else if (anchor >= 0 && anchor < activeTranscript->messageCount) {
+
+                topRow = activeTranscript->messages[anchor].firstRow + NK_MIN(messagesAnchorLine, activeTranscript->messages[anchor].lineCount - 1);
             }
+
+            nk_group_set_scroll(ctx, "messages", 0, topRow * rowHeight);
         }
 
-        nk_layout_row_end(ctx);
-        nk_end(ctx);
-    }
+        nk_layout_row_dynamic(ctx, listHeight, 1);
 
-    if (forceRedrawChats) {
+        // the rows are plain text, so only the list's scrollbar down the right hand side reacts
+        struct nk_rect listBounds = nk_widget_bounds(ctx);
+        float scrollbarWidth = ctx->style.window.scrollbar_size.x + ctx->style.window.group_padding.x;
 
-        forceRedrawChats--;
-    }
+        clearHoverRects(MESSAGES_WINDOW);
+        addHoverRect(MESSAGES_WINDOW, nk_rect(listBounds.x + listBounds.w - scrollbarWidth, listBounds.y, scrollbarWidth, listBounds.h));
+
+        // only the rows in view are laid out, however long the transcript is
+        if (nk_list_view_begin(ctx, &messageList, "messages", 0, MESSAGE_ROW_HEIGHT, activeTranscript->rowCount)) {
+
+            nk_layout_row_dynamic(ctx, MESSAGE_ROW_HEIGHT, 1);
+
+            if (messageList.count > 0) {
+
+                short message = transcriptMessageForRow(activeTranscript, messageList.begin);
+                short line = messageList.begin - activeTranscript->messages[message].firstRow;
+                const WrappedText *wrapped = wrapTranscriptMessage(activeTranscript, message, nk_quickdraw_char_width);
 
-    if (forceRedrawMessages) {
+                messagesAnchorSequence = activeTranscript->firstSequence + message;
+                messagesAnchorLine = line;
 
-        forceRedrawMessages--;
+                for (short row = messageList.begin; row < messageList.end; row++) {
+
+                    char *text = &activeTranscript->text[activeTranscript->messages[message].offset];
+
+                    nk_text(ctx, &text[wrapped->lines[line].start], wrapped->lines[line].length, NK_TEXT_ALIGN_LEFT);
+
+                    if (++line == wrapped->lineCount && ++message < activeTranscript->messageCount) {
+
+                        line = 0;
+                        wrapped = wrapTranscriptMessage(activeTranscript, message, nk_quickdraw_char_width);
+                    }
+                }
+            }
+
+            messagesFollowNewest = messageList.end >= activeTranscript->rowCount;
+
+            // scrolled up to the oldest message we have, see if index.js has any before it
+            if (messageList.begin == 0 && activeTranscript->messageCount > 0) {
+
+                scheduleTask(pageTask, TickCount());
+            }
+
+            nk_list_view_end(&messageList);
+        }
+
+        nk_end(ctx);
     }
 }
 
@@ -717,13 +1238,15 @@ struct nk_context* initializeNuklearApp() {
     #endif
 
     activeChat = malloc(sizeof(char) * MAX_FRIENDLY_NAME_LENGTH);
-    activeChatMessages = malloc(sizeof(char) * (MAX_CHAT_MESSAGES * 2048)); // this should match to MAX_ROWS in index.js
-    box_input_buffer = malloc(sizeof(char) * 2048);
-    chatFriendlyNames = malloc(sizeof(char) * (16 * MAX_FRIENDLY_NAME_LENGTH));
+    activeTranscript = malloc(sizeof(Transcript));
+    clearTranscript(activeTranscript, 0);
+    box_input_buffer = malloc(sizeof(char) * MAX_MESSAGE_INPUT_LENGTH);
+    chatFriendlyNames = malloc(sizeof(char) * (MAX_CHATS * MAX_FRIENDLY_NAME_LENGTH));
     ip_input_buffer = malloc(sizeof(char) * 255);
-    jsFunctionResponse = malloc(sizeof(char) * MAX_RECEIVE_SIZE); 
-    chatCountFunctionResponse = malloc(sizeof(char) * MAX_RECEIVE_SIZE);
-    tempChatCountFunctionResponse = malloc(sizeof(char) * MAX_RECEIVE_SIZE);
+    initScratchArena(&callScratch, CALL_SCRATCH_SIZE);
+    syncFunctionResponse = malloc(sizeof(char) * MAX_RECEIVE_SIZE);
+    eventFunctionResponse = malloc(sizeof(char) * MAX_RECEIVE_SIZE);
+    pageFunctionResponse = malloc(sizeof(char) * (MESSAGE_PAGE_BYTES + 64));
     previousChatCountFunctionResponse = malloc(sizeof(char) * MAX_RECEIVE_SIZE);
     new_message_input_buffer = malloc(sizeof(char) * 255);
 
@@ -24,9 +24,20 @@
 #include <Serial.h>
 #include "SerialHelper.h"
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "font_metrics.h"
 
 #define ENABLED_DOUBLE_BUFFERING
 #define COMMAND_CACHING
+// each window gets an offscreen bitmap of its own, so it is only rasterized when its commands change
+// and is otherwise just copied. costs around 30K more for this app's windows, so leave it off on
+// 512K machines. needs ENABLED_DOUBLE_BUFFERING and COMMAND_CACHING
+// #define WINDOW_LAYERS
+#define TEXT_RUN_CACHE_SIZE 16 // text runs kept as bitmaps, about 700 bytes each, 0 turns the cache off
+// the font everything is drawn in. needs a table in font_metrics.h to avoid measuring with CharWidth
+#define NK_QUICKDRAW_FONT_NUMBER 0 // system font, Chicago
+#define NK_QUICKDRAW_FONT_SIZE 12
 #include "nuklear.h"
 // #define NK_QUICKDRAW_GRAPHICS_DEBUGGING
 // #define DRAW_BLIT_LOCATION
@@ -52,7 +63,8 @@ NK_API NkQuickDrawFont* nk_quickdraw_font_create_from_file();
  *
  * ===============================================================
  */
-#define MAX_MEMORY_IN_KB 6
+#define MAX_MEMORY_IN_KB 6 // for each of the two command buffers
+#define MAX_POOL_MEMORY_IN_KB 6 // window, panel and table state, which used to share the command buffer
 #ifdef NK_QUICKDRAW_IMPLEMENTATION
 #ifndef NK_QUICKDRAW_TEXT_MAX
 #define NK_QUICKDRAW_TEXT_MAX 256
@@ -64,8 +76,15 @@ struct NkQuickDrawFont {
 };
 
 int lastEventWasKey = 0;
+
+// nuklear builds each frame in to one of these while the other still holds the previous frame's
+// commands, which nk_quickdraw_render compares against. they swap after every frame that is drawn,
+// so keeping the previous frame costs no allocation or copy
+void *commandBuffers[2];
+short currentCommandBuffer = 0;
 void *last;
-void *buf;
+nk_size lastAllocated = 0;
+void *pool;
 
 // constant keyboard mappings for convenenience
 // See Inside Macintosh: Text pg A-7, A-8
@@ -99,20 +118,30 @@ typedef struct {
     Handle  OrigBits;
 } ShockBitmap;
 
-void NewShockBitmap(ShockBitmap *theMap, short width, short height) {
+// bounds does not have to start at 0, 0: a bitmap covering one window can use the window's own
+// coordinates, so the same drawing code works on it. returns false if there is not enough memory
+Boolean NewShockBitmapWithBounds(ShockBitmap *theMap, const Rect *bounds) {
 
     theMap->bits = 0L;
-    SetRect(&theMap->bounds, 0, 0, width, height);
+    theMap->bounds = *bounds;
     
     theMap->BWBits.bounds = theMap->bounds;
-    theMap->BWBits.rowBytes = ((width+15) >> 4)<<1;         // round to even
-    theMap->BWBits.baseAddr = NewPtr(((long) height * (long) theMap->BWBits.rowBytes));
+    theMap->BWBits.rowBytes = ((bounds->right - bounds->left + 15) >> 4)<<1;         // round to even
+    theMap->BWBits.baseAddr = NewPtr(((long) (bounds->bottom - bounds->top) * (long) theMap->BWBits.rowBytes));
+
+    if (theMap->BWBits.baseAddr == NULL) {
+
+        return false;
+    }
 
     theMap->BWBits.baseAddr = StripAddress(theMap->BWBits.baseAddr);
     
     OpenPort(&theMap->BWPort);
     SetPort(&theMap->BWPort);
     SetPortBits(&theMap->BWBits);
+    theMap->BWPort.portRect = theMap->bounds;
+    TextFont(NK_QUICKDRAW_FONT_NUMBER);
+    TextSize(NK_QUICKDRAW_FONT_SIZE);
 
     SetRectRgn(theMap->BWPort.visRgn, theMap->bounds.left, theMap->bounds.top, theMap->bounds.right, theMap->bounds.bottom);
     SetRectRgn(theMap->BWPort.clipRgn, theMap->bounds.left, theMap->bounds.top, theMap->bounds.right, theMap->bounds.bottom);
@@ -121,6 +150,28 @@ void NewShockBitmap(ShockBitmap *theMap, short width, short height) {
     theMap->Address = theMap->BWBits.baseAddr;
     theMap->RowBytes = (long) theMap->BWBits.rowBytes;
     theMap->bits = (GrafPtr) &theMap->BWPort;
+
+    return true;
+}
+
+void NewShockBitmap(ShockBitmap *theMap, short width, short height) {
+
+    Rect bounds;
+    SetRect(&bounds, 0, 0, width, height);
+
+    NewShockBitmapWithBounds(theMap, &bounds);
+}
+
+void DisposeShockBitmap(ShockBitmap *theMap) {
+
+    ClosePort(&theMap->BWPort);
+    DisposePtr(theMap->BWBits.baseAddr);
+    theMap->bits = 0L;
+}
+
+long ShockBitmapSize(ShockBitmap *theMap) {
+
+    return (long) (theMap->bounds.bottom - theMap->bounds.top) * theMap->RowBytes;
 }
 
 ShockBitmap gMainOffScreen;
@@ -261,139 +312,84 @@ NK_API void nk_quickdraw_del_image(struct nk_image* image) {
     free(image);
 }
 
-// NOTE: you will need to generate this yourself if you want to add additional font support!
-short widthFor12ptFont[128] = {
-    0,
-    10,
-    10,
-    10,
-    10,
-    10,
-    10,
-    10,
-    10,
-    8,
-    10,
-    10,
-    10,
-    0,
-    10,
-    10,
-    10,
-    11,
-    11,
-    9,
-    11,
-    10,
-    10,
-    10,
-    10,
-    10,
-    10,
-    10,
-    10,
-    10,
-    10,
-    10,
-    4,
-    6,
-    7,
-    10,
-    7,
-    11,
-    10,
-    3,
-    5,
-    5,
-    7,
-    7,
-    4,
-    7,
-    4,
-    7,
-    8,
-    8,
-    8,
-    8,
-    8,
-    8,
-    8,
-    8,
-    8,
-    8,
-    4,
-    4,
-    6,
-    8,
-    6,
-    8,
-    11,
-    8,
-    8,
-    8,
-    8,
-    7,
-    7,
-    8,
-    8,
-    6,
-    7,
-    9,
-    7,
-    12,
-    9,
-    8,
-    8,
-    8,
-    8,
-    7,
-    6,
-    8,
-    8,
-    12,
-    8,
-    8,
-    8,
-    5,
-    7,
-    5,
-    8,
-    8,
-    6,
-    8,
-    8,
-    7,
-    8,
-    8,
-    6,
-    8,
-    8,
-    4,
-    6,
-    8,
-    4,
-    12,
-    8,
-    8,
-    8,
-    8,
-    6,
-    7,
-    6,
-    8,
-    8,
-    12,
-    8,
-    8,
-    8,
-    5,
-    5,
-    5,
-    8,
-    8
-};
+// widths come from font_metrics.h, which compile_js.sh generates from font_metrics.json. wrap.c
+// breaks messages in to lines with these too. see font_metrics.js to add fonts or sizes
+unsigned char *fontWidths;
+
+// used when font_metrics.h has no table for our font, everything gets measured on first use
+unsigned char measuredFontWidths[256];
+
+static void nk_quickdraw_select_font_widths(short fontNumber, short size) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: nk_quickdraw_select_font_widths");
+    #endif
+
+    for (short i = 0; i < FONT_METRICS_COUNT; i++) {
+
+        if (fontMetrics[i].fontNumber == fontNumber && fontMetrics[i].size == size) {
+
+            fontWidths = fontMetrics[i].widths;
 
-// doing this in a "fast" way by using a precomputed table for a 12pt font
+            return;
+        }
+    }
+
+    memset(measuredFontWidths, FONT_METRICS_UNKNOWN, sizeof(measuredFontWidths));
+    fontWidths = measuredFontWidths;
+}
+
+// characters the table doesn't know are measured once with CharWidth and remembered. whatever port
+// is current might have a different font set, so switch to ours just for the measurement
+static short nk_quickdraw_measure_char(unsigned char character) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: nk_quickdraw_measure_char");
+    #endif
+
+    GrafPtr port;
+    GetPort(&port);
+
+    short oldFont = port->txFont;
+    short oldSize = port->txSize;
+    short oldFace = port->txFace;
+
+    TextFont(NK_QUICKDRAW_FONT_NUMBER);
+    TextSize(NK_QUICKDRAW_FONT_SIZE);
+    TextFace(0);
+
+    short width = CharWidth(character);
+
+    TextFont(oldFont);
+    TextSize(oldSize);
+    TextFace(oldFace);
+
+    // a width of FONT_METRICS_UNKNOWN would have us measuring this character forever
+    if (width >= FONT_METRICS_UNKNOWN) {
+
+        width = FONT_METRICS_UNKNOWN - 1;
+    }
+
+    fontWidths[character] = width;
+
+    return width;
+}
+
+// text is signed on this compiler, so go through unsigned char or anything past 127 indexes off the
+// front of the table
+static short nk_quickdraw_char_width(char character) {
+
+    short width = fontWidths[(unsigned char)character];
+
+    if (width == FONT_METRICS_UNKNOWN) {
+
+        return nk_quickdraw_measure_char((unsigned char)character);
+    }
+
+    return width;
+}
+
+// doing this in a "fast" way by using a precomputed table for our font
 static short nk_quickdraw_font_get_text_width(nk_handle handle, short height, const char *text, short len) {
 
     // this is going to produce a lot of logging and not a lot of value:
@@ -410,7 +406,7 @@ static short nk_quickdraw_font_get_text_width(nk_handle handle, short height, co
 
     for (short i = 0; i < len; i++) {
 
-        width += widthFor12ptFont[(int)text[i]];
+        width += nk_quickdraw_char_width(text[i]);
     }
 
     return width;
@@ -431,7 +427,7 @@ static int _get_text_width(const char *text, int len) {
 
     for (int i = 0; i < len; i++) {
 
-        width += widthFor12ptFont[(int)text[i]];
+        width += nk_quickdraw_char_width(text[i]);
     }
 
     return width;
@@ -453,11 +449,212 @@ NK_API NkQuickDrawFont* nk_quickdraw_font_create_from_file() {
     return font;
 }
 
-// used for bounds checking
-int mostLeft = WINDOW_WIDTH;
-int mostBottom = 1;
-int mostTop = WINDOW_HEIGHT;
-int mostRight = 1;
+// how far a line of text in NK_QUICKDRAW_FONT_NUMBER at NK_QUICKDRAW_FONT_SIZE reaches above its
+// baseline and how tall it is in all, from GetFontInfo in nk_quickdraw_init. 12 and 15 for Chicago
+short textLineAscent = 12;
+short textLineHeight = 15;
+
+#if TEXT_RUN_CACHE_SIZE > 0
+
+// text that is drawn again, like a chat name or message row that has moved or sits next to a command
+// that changed, is copied from a bitmap of it we rendered earlier instead of being measured, erased
+// and drawn again. each run is a strip of one bitmap, textLineHeight tall. runs that are too wide
+// or too long are just drawn
+#define TEXT_RUN_MAX_WIDTH 336
+#define TEXT_RUN_MAX_LENGTH 128
+
+typedef struct {
+    unsigned long hash; // 0 marks an empty entry
+    short length;
+    short width;
+    short font;
+    short size;
+    Style face;
+    int foreground;
+    unsigned long lastUsed;
+    char string[TEXT_RUN_MAX_LENGTH];
+} TextRun;
+
+TextRun textRuns[TEXT_RUN_CACHE_SIZE];
+ShockBitmap textRunBitmap;
+Boolean textRunBitmapReady = false;
+unsigned long textRunClock = 0;
+
+#ifdef PROFILING
+    unsigned short textRunHits;
+    unsigned short textRunMisses;
+#endif
+
+unsigned long textRunHash(const char *string, short length) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: textRunHash");
+    #endif
+
+    unsigned long hash = 5381;
+
+    while (length-- > 0) {
+
+        hash = ((hash << 5) + hash) + (unsigned char)*string++;
+    }
+
+    return hash == 0 ? 1 : hash;
+}
+
+// the cached run for the text command t, or -1. the string, the font, size and style of the port it
+// is being drawn in to and its color decide what it looks like, and its width comes along with it
+// rather than being measured again
+short findTextRun(const struct nk_command_text *t, unsigned long hash) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: findTextRun");
+    #endif
+
+    GrafPtr port = qd.thePort;
+
+    for (short i = 0; i < TEXT_RUN_CACHE_SIZE; i++) {
+
+        TextRun *run = &textRuns[i];
+
+        if (run->hash == hash && run->length == t->length && run->font == port->txFont && run->size == port->txSize &&
+            run->face == port->txFace && run->foreground == t->foreground && !memcmp(run->string, t->string, t->length)) {
+
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// draws the text command t, whose bounds are destination, from cached run slot, rendering it in to
+// the cache first if slot is -1. returns false if the run cannot be cached, in which case nothing is
+// drawn
+Boolean drawTextRun(const struct nk_command_text *t, unsigned long hash, short slot, const Rect *destination, short mode) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: drawTextRun");
+    #endif
+
+    short width = destination->right - destination->left;
+
+    if (slot < 0 && (!textRunBitmapReady || t->length > TEXT_RUN_MAX_LENGTH || width > TEXT_RUN_MAX_WIDTH ||
+                     destination->bottom - destination->top > textLineHeight)) {
+
+        return false;
+    }
+
+    Rect source;
+
+    if (slot < 0) {
+
+        #ifdef PROFILING
+            textRunMisses++;
+        #endif
+
+        // the least recently used run makes way, an empty one always goes first
+        slot = 0;
+
+        for (short i = 1; i < TEXT_RUN_CACHE_SIZE && textRuns[slot].hash != 0; i++) {
+
+            if (textRuns[i].hash == 0 || textRuns[i].lastUsed < textRuns[slot].lastUsed) {
+
+                slot = i;
+            }
+        }
+
+        GrafPtr destinationPort;
+        GetPort(&destinationPort);
+
+        TextRun *run = &textRuns[slot];
+        run->hash = hash;
+        run->length = t->length;
+        run->width = width;
+        run->font = destinationPort->txFont;
+        run->size = destinationPort->txSize;
+        run->face = destinationPort->txFace;
+        run->foreground = t->foreground;
+        memcpy(run->string, t->string, t->length);
+
+        SetRect(&source, 0, slot * textLineHeight, width, (slot + 1) * textLineHeight);
+
+        // render it without any clipping, in the destination's font, the copy below is clipped like
+        // drawing would have been
+        SetPort(&textRunBitmap.BWPort);
+        TextFont(run->font);
+        TextSize(run->size);
+        TextFace(run->face);
+
+        EraseRect(&source);
+        ForeColor(t->foreground);
+        MoveTo(0, source.top + textLineAscent);
+        PenSize(1.0, 1.0);
+        DrawText((const char*)t->string, 0, t->length);
+
+        SetPort(destinationPort);
+    } else {
+
+        #ifdef PROFILING
+            textRunHits++;
+        #endif
+
+        SetRect(&source, 0, slot * textLineHeight, width, (slot + 1) * textLineHeight);
+    }
+
+    textRuns[slot].lastUsed = ++textRunClock;
+
+    ForeColor(blackColor);
+    BackColor(whiteColor);
+    CopyBits(&textRunBitmap.BWBits, &qd.thePort->portBits, &source, destination, mode, 0L);
+
+    return true;
+}
+#endif
+
+// the areas of the offscreen buffer that were drawn to this frame, and so need to be blitted to the
+// window. rects that overlap or are within DIRTY_RECT_MERGE_DISTANCE pixels of each other are merged,
+// everything else is blitted on its own, so a blinking cursor in one window and a hover change in
+// another no longer blit everything in between
+#define MAX_DIRTY_RECTS 8
+#define DIRTY_RECT_MERGE_DISTANCE 8
+Rect dirtyRects[MAX_DIRTY_RECTS];
+short dirtyRectCount = 0;
+
+// everything drawn is clipped to the last scissor, so nothing outside of it can have changed
+Rect currentScissor = {0, 0, WINDOW_HEIGHT, WINDOW_WIDTH};
+
+#ifdef PROFILING
+    unsigned long pixelsBlitted;
+#endif
+
+Boolean dirtyRectsAreNear(Rect *a, Rect *b) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: dirtyRectsAreNear");
+    #endif
+
+    return a->left <= b->right + DIRTY_RECT_MERGE_DISTANCE &&
+        b->left <= a->right + DIRTY_RECT_MERGE_DISTANCE &&
+        a->top <= b->bottom + DIRTY_RECT_MERGE_DISTANCE &&
+        b->top <= a->bottom + DIRTY_RECT_MERGE_DISTANCE;
+}
+
+long dirtyRectArea(Rect *rect) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: dirtyRectArea");
+    #endif
+
+    return (long)(rect->right - rect->left) * (rect->bottom - rect->top);
+}
+
+void removeDirtyRect(short index) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: removeDirtyRect");
+    #endif
+
+    dirtyRects[index] = dirtyRects[--dirtyRectCount];
+}
 
 void updateBounds(int top, int bottom, int left, int right) {
 
@@ -465,32 +662,392 @@ void updateBounds(int top, int bottom, int left, int right) {
         writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: updateBounds");
     #endif
 
-    if (left < mostLeft) {
+    Rect dirty;
+    dirty.top = top > currentScissor.top ? top : currentScissor.top;
+    dirty.left = left > currentScissor.left ? left : currentScissor.left;
+    dirty.bottom = bottom < currentScissor.bottom ? bottom : currentScissor.bottom;
+    dirty.right = right < currentScissor.right ? right : currentScissor.right;
+
+    if (dirty.top >= dirty.bottom || dirty.left >= dirty.right) {
+
+        return;
+    }
+
+    // merging can grow the new rect in to ones it was not near before, so keep going until it
+    // is not near any of them
+    short i = 0;
+
+    while (i < dirtyRectCount) {
+
+        if (dirtyRectsAreNear(&dirty, &dirtyRects[i])) {
+
+            UnionRect(&dirty, &dirtyRects[i], &dirty);
+            removeDirtyRect(i);
+            i = 0;
+
+            continue;
+        }
+
+        i++;
+    }
+
+    if (dirtyRectCount < MAX_DIRTY_RECTS) {
+
+        dirtyRects[dirtyRectCount++] = dirty;
+
+        return;
+    }
+
+    // out of room, so fold the new rect in to whichever one it grows the least
+    short best = 0;
+    long bestGrowth = 0;
+
+    for (i = 0; i < dirtyRectCount; i++) {
+
+        Rect merged;
+        UnionRect(&dirty, &dirtyRects[i], &merged);
+
+        long growth = dirtyRectArea(&merged) - dirtyRectArea(&dirtyRects[i]);
+
+        if (i == 0 || growth < bestGrowth) {
+
+            best = i;
+            bestGrowth = growth;
+        }
+    }
+
+    UnionRect(&dirty, &dirtyRects[best], &dirty);
+    removeDirtyRect(best);
+    updateBounds(dirty.top, dirty.bottom, dirty.left, dirty.right);
+}
+
+// true if anything already drawn this frame touches bounds
+Boolean intersectsDirtyRects(struct nk_rect bounds) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: intersectsDirtyRects");
+    #endif
+
+    for (short i = 0; i < dirtyRectCount; i++) {
+
+        if (bounds.x < dirtyRects[i].right && bounds.x + bounds.w > dirtyRects[i].left &&
+            bounds.y < dirtyRects[i].bottom && bounds.y + bounds.h > dirtyRects[i].top) {
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// lines, triangles and polygons have no rect of their own, so take the box around their points,
+// widened by the pen which hangs down and to the right of each point
+void updateBoundsForPoint(Rect *bounds, int x, int y, int penSize) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: updateBoundsForPoint");
+    #endif
+
+    if (x < bounds->left) {
 
-        mostLeft = left;
+        bounds->left = x;
     }
 
-    if (right > mostRight) {
+    if (y < bounds->top) {
 
-        mostRight = right;
+        bounds->top = y;
     }
 
-    if (top < mostTop) {
+    if (x + penSize > bounds->right) {
 
-        mostTop = top;
+        bounds->right = x + penSize;
     }
 
-    if (bottom > mostBottom) {
+    if (y + penSize > bounds->bottom) {
 
-        mostBottom = bottom;
+        bounds->bottom = y + penSize;
     }
 }
 
 #ifdef COMMAND_CACHING
-    void runDrawCommand(const struct nk_command *cmd, const struct nk_command *lastCmd) {
-#else
-    void runDrawCommand(const struct nk_command *cmd) {
+    #include "command_cache.h"
+#endif
+
+// each window's command buffer keeps a running checksum of the commands pushed to it (see
+// nk_command_buffer_checksum in nuklear.h). comparing those against the previous frame tells us
+// whether anything changed without reading the whole command buffer, and which windows we can skip
+#define MAX_DRAWN_WINDOWS 8
+
+#ifdef WINDOW_LAYERS
+
+#define MAX_WINDOW_LAYERS 6
+
+typedef struct {
+    nk_hash name; // nuklear frees and remakes windows, but the name stays the same
+    Boolean inUse;
+    ShockBitmap map;
+} WindowLayer;
+
+WindowLayer windowLayers[MAX_WINDOW_LAYERS];
+
+#ifdef PROFILING
+    long windowLayersSize = 0;
 #endif
+
+// finds or makes the layer for a window, remaking it if the window has moved or changed size, in
+// which case fresh is set since there is nothing on it. NULL if there is no memory or no free slot,
+// and the window is drawn straight on to gMainOffScreen instead
+WindowLayer *layerForWindow(struct nk_window *window, Boolean *fresh) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: layerForWindow");
+    #endif
+
+    Rect bounds;
+    SetRect(&bounds, window->bounds.x, window->bounds.y, window->bounds.x + window->bounds.w, window->bounds.y + window->bounds.h);
+
+    WindowLayer *layer = NULL;
+    *fresh = false;
+
+    for (short i = 0; i < MAX_WINDOW_LAYERS; i++) {
+
+        if (windowLayers[i].inUse && windowLayers[i].name == window->name) {
+
+            layer = &windowLayers[i];
+
+            break;
+        }
+
+        if (!windowLayers[i].inUse && layer == NULL) {
+
+            layer = &windowLayers[i];
+        }
+    }
+
+    if (layer == NULL) {
+
+        return NULL;
+    }
+
+    if (layer->inUse) {
+
+        if (EqualRect(&layer->map.bounds, &bounds)) {
+
+            return layer;
+        }
+
+        #ifdef PROFILING
+            windowLayersSize -= ShockBitmapSize(&layer->map);
+        #endif
+
+        DisposeShockBitmap(&layer->map);
+        layer->inUse = false;
+    }
+
+    if (!NewShockBitmapWithBounds(&layer->map, &bounds)) {
+
+        return NULL;
+    }
+
+    layer->name = window->name;
+    layer->inUse = true;
+    *fresh = true;
+
+    #ifdef PROFILING
+        windowLayersSize += ShockBitmapSize(&layer->map);
+
+        char layerMessage[255];
+        sprintf(layerMessage, "PROFILE_LAYER %s: %ld bytes, all layers: %ld bytes", window->name_string, ShockBitmapSize(&layer->map), windowLayersSize);
+        writeSerialPortProfile(layerMessage);
+    #endif
+
+    return layer;
+}
+#endif
+
+typedef struct {
+    struct nk_window *window;
+    nk_size begin;
+    nk_size end;
+    unsigned long checksum;
+    #ifdef WINDOW_LAYERS
+        nk_hash name;
+        Rect bounds;
+        WindowLayer *layer;
+        Boolean freshLayer;
+    #endif
+} DrawnWindow;
+
+DrawnWindow drawnWindows[2][MAX_DRAWN_WINDOWS];
+DrawnWindow *lastDrawnWindows = drawnWindows[0];
+DrawnWindow *currentDrawnWindows = drawnWindows[1];
+short lastDrawnWindowCount = -1;
+short currentDrawnWindowCount = 0;
+
+// the windows nuklear will draw this frame, picked the same way nk_build picks them. -1 if there
+// are too many to keep track of, which is always treated as a change
+short collectDrawnWindows(struct nk_context *ctx) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: collectDrawnWindows");
+    #endif
+
+    short count = 0;
+
+    for (struct nk_window *window = ctx->begin; window; window = window->next) {
+
+        if (window->buffer.last == window->buffer.begin || (window->flags & NK_WINDOW_HIDDEN) || window->seq != ctx->seq) {
+
+            continue;
+        }
+
+        if (count == MAX_DRAWN_WINDOWS) {
+
+            return -1;
+        }
+
+        currentDrawnWindows[count].window = window;
+        currentDrawnWindows[count].begin = window->buffer.begin;
+        currentDrawnWindows[count].end = window->buffer.end;
+        currentDrawnWindows[count].checksum = window->buffer.checksum;
+
+        #ifdef WINDOW_LAYERS
+            // last frame's windows may have been freed by now, so keep what we need to know about them
+            currentDrawnWindows[count].name = window->name;
+            SetRect(&currentDrawnWindows[count].bounds, window->bounds.x, window->bounds.y, window->bounds.x + window->bounds.w, window->bounds.y + window->bounds.h);
+            currentDrawnWindows[count].layer = NULL;
+            currentDrawnWindows[count].freshLayer = false;
+        #endif
+
+        count++;
+    }
+
+    return count;
+}
+
+Boolean drawnWindowsUnchanged() {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: drawnWindowsUnchanged");
+    #endif
+
+    if (currentDrawnWindowCount < 0 || currentDrawnWindowCount != lastDrawnWindowCount) {
+
+        return false;
+    }
+
+    for (short i = 0; i < currentDrawnWindowCount; i++) {
+
+        if (currentDrawnWindows[i].window != lastDrawnWindows[i].window || currentDrawnWindows[i].checksum != lastDrawnWindows[i].checksum) {
+
+            return false;
+        }
+    }
+
+    return true;
+}
+
+Boolean windowDrawnLastFrame(DrawnWindow *drawnWindow) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: windowDrawnLastFrame");
+    #endif
+
+    for (short i = 0; i < lastDrawnWindowCount; i++) {
+
+        if (lastDrawnWindows[i].window == drawnWindow->window) {
+
+            return lastDrawnWindows[i].checksum == drawnWindow->checksum;
+        }
+    }
+
+    return false;
+}
+
+#ifdef WINDOW_LAYERS
+
+// a layer only changes when its own window is rasterized, so it can be copied in to gMainOffScreen
+// wherever anything changed. going from the back window to the front keeps them stacked properly
+void compositeWindowLayers() {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: compositeWindowLayers");
+    #endif
+
+    SetRect(&currentScissor, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    // a window that was drawn last frame and is gone now, like a closed popup, leaves whatever it
+    // covered to be copied back from the layers underneath it
+    for (short i = 0; i < lastDrawnWindowCount; i++) {
+
+        Boolean stillDrawn = false;
+
+        for (short j = 0; j < currentDrawnWindowCount && !stillDrawn; j++) {
+
+            stillDrawn = lastDrawnWindows[i].name == currentDrawnWindows[j].name;
+        }
+
+        for (short j = 0; j < currentDrawnWindowCount && !stillDrawn; j++) {
+
+            Rect covered;
+
+            if (currentDrawnWindows[j].layer && SectRect(&lastDrawnWindows[i].bounds, &currentDrawnWindows[j].bounds, &covered)) {
+
+                updateBounds(covered.top, covered.bottom, covered.left, covered.right);
+            }
+        }
+    }
+
+    SetPort(&gMainOffScreen.BWPort);
+    ClipRect(&gMainOffScreen.bounds);
+
+    for (short i = 0; i < currentDrawnWindowCount; i++) {
+
+        WindowLayer *layer = currentDrawnWindows[i].layer;
+
+        if (layer == NULL) {
+
+            continue;
+        }
+
+        for (short j = 0; j < dirtyRectCount; j++) {
+
+            Rect changed;
+
+            if (SectRect(&dirtyRects[j], &layer->map.bounds, &changed)) {
+
+                CopyBits(&layer->map.BWBits, &gMainOffScreen.BWBits, &changed, &changed, srcCopy, 0L);
+            }
+        }
+    }
+}
+#endif
+
+// which of this frame's windows the command at offset belongs to, starting from the last one found
+// since commands nearly always follow on from the one before
+short findDrawnWindow(nk_size offset, short hint) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: findDrawnWindow");
+    #endif
+
+    if (hint >= 0 && offset >= currentDrawnWindows[hint].begin && offset < currentDrawnWindows[hint].end) {
+
+        return hint;
+    }
+
+    for (short i = 0; i < currentDrawnWindowCount; i++) {
+
+        if (offset >= currentDrawnWindows[i].begin && offset < currentDrawnWindows[i].end) {
+
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+void runDrawCommand(const struct nk_command *cmd) {
     #ifdef DEBUG_FUNCTION_CALLS
         writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: runDrawCommand");
     #endif
@@ -499,9 +1056,6 @@ void updateBounds(int top, int bottom, int left, int right) {
         char x[255];
         sprintf(x, "cmd: %d", cmd->type);
         writeSerialPortDebug(boutRefNum, x);
-        char y[255];
-        sprintf(y, "lastCmd: %d", lastCmd->type);
-        writeSerialPortDebug(boutRefNum, y);
     #endif
 
     switch (cmd->type) {
@@ -526,7 +1080,7 @@ void updateBounds(int top, int bottom, int left, int right) {
                 // there is no point in supressing scissor commands because they only affect
                 // where we can actually draw to:
                 // #ifdef COMMAND_CACHING
-                //     if (memcmp(s, lastCmd, sizeof(struct nk_command_scissor)) == 0) {
+                //     if (alreadyDrawn(last, cmd)) {
 
                 //         #ifdef NK_QUICKDRAW_GRAPHICS_DEBUGGING
                 //             writeSerialPortDebug(boutRefNum, "ALREADY DREW CMD nk_command_scissor");
@@ -543,10 +1097,14 @@ void updateBounds(int top, int bottom, int left, int right) {
                 quickDrawRectangle.right = s->x + s->w;
 
                 #ifdef ENABLED_DOUBLE_BUFFERING
-                    // we use "-8192" here to filter out nuklear "nk_null_rect" which we do not want updating bounds
+                    // a scissor does not draw anything itself, it only limits how much of the buffer the
+                    // commands after it can dirty. nuklear's "nk_null_rect" (-8192) means no clipping at all
                     if (quickDrawRectangle.top != -8192) {
 
-                        updateBounds(quickDrawRectangle.top, quickDrawRectangle.bottom, quickDrawRectangle.left, quickDrawRectangle.right);
+                        currentScissor = quickDrawRectangle;
+                    } else {
+
+                        SetRect(&currentScissor, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
                     }
                 #endif
 
@@ -567,7 +1125,7 @@ void updateBounds(int top, int bottom, int left, int right) {
 
                 #ifdef COMMAND_CACHING
 
-                    if (!lastInputWasBackspace && cmd->type == lastCmd->type && memcmp(r, lastCmd, sizeof(struct nk_command_rect)) == 0) {
+                    if (!lastInputWasBackspace && alreadyDrawn(last, cmd)) {
 
                         #ifdef NK_QUICKDRAW_GRAPHICS_DEBUGGING
                             writeSerialPortDebug(boutRefNum, "ALREADY DREW CMD nk_command_rect");
@@ -621,7 +1179,7 @@ void updateBounds(int top, int bottom, int left, int right) {
 
                 #ifdef COMMAND_CACHING
 
-                    if (!lastInputWasBackspace && cmd->type == lastCmd->type && memcmp(r, lastCmd, sizeof(struct nk_command_rect_filled)) == 0) {
+                    if (!lastInputWasBackspace && alreadyDrawn(last, cmd)) {
 
                         #ifdef NK_QUICKDRAW_GRAPHICS_DEBUGGING
                             writeSerialPortDebug(boutRefNum, "ALREADY DREW CMD nk_command_rect_filled");
@@ -658,7 +1216,7 @@ void updateBounds(int top, int bottom, int left, int right) {
                 const struct nk_command_text *t = (const struct nk_command_text*)cmd;
 
                 #ifdef COMMAND_CACHING
-                    if (!lastInputWasBackspace && t->allowCache && cmd->type == lastCmd->type && memcmp(t, lastCmd, sizeof(struct nk_command_text)) == 0) {
+                    if (!lastInputWasBackspace && t->allowCache && alreadyDrawn(last, cmd)) {
 
                         #ifdef NK_QUICKDRAW_GRAPHICS_DEBUGGING
                             char log[255];
@@ -679,16 +1237,41 @@ void updateBounds(int top, int bottom, int left, int right) {
                     writeSerialPortDebug(boutRefNum, log);
                 #endif
 
+                // the baseline is t->height down, and the line reaches textLineAscent above it
                 Rect quickDrawRectangle;
-                quickDrawRectangle.top = t->y;
+                quickDrawRectangle.top = t->y + t->height - textLineAscent;
                 quickDrawRectangle.left = t->x;
-                quickDrawRectangle.bottom = t->y + 15;
-                quickDrawRectangle.right = t->x + _get_text_width((const char*)t->string, (int)t->length);
+                quickDrawRectangle.bottom = quickDrawRectangle.top + textLineHeight;
+
+                #if TEXT_RUN_CACHE_SIZE > 0
+                    unsigned long textRunKey = textRunHash(t->string, t->length);
+                    short textRun = findTextRun(t, textRunKey);
+
+                    quickDrawRectangle.right = t->x + (textRun >= 0 ? textRuns[textRun].width : _get_text_width((const char*)t->string, (int)t->length));
+                #else
+                    quickDrawRectangle.right = t->x + _get_text_width((const char*)t->string, (int)t->length);
+                #endif
 
                 #ifdef ENABLED_DOUBLE_BUFFERING
                     updateBounds(quickDrawRectangle.top, quickDrawRectangle.bottom, quickDrawRectangle.left, quickDrawRectangle.right);
                 #endif
 
+                #if TEXT_RUN_CACHE_SIZE > 0
+
+                    // the cached run has the erased background in it, so it is copied over whatever is
+                    // there when we would have erased, and or'd on to it like DrawText when we would not
+                    #ifdef COMMAND_CACHING
+                        short textRunMode = srcCopy;
+                    #else
+                        short textRunMode = srcOr;
+                    #endif
+
+                    if (drawTextRun(t, textRunKey, textRun, &quickDrawRectangle, textRunMode)) {
+
+                        break;
+                    }
+                #endif
+
                 #ifdef COMMAND_CACHING
                     EraseRect(&quickDrawRectangle);
                 #endif
@@ -712,7 +1295,7 @@ void updateBounds(int top, int bottom, int left, int right) {
 
                 #ifdef COMMAND_CACHING
 
-                    if (!lastInputWasBackspace && cmd->type == lastCmd->type && memcmp(l, lastCmd, sizeof(struct nk_command_line)) == 0) {
+                    if (!lastInputWasBackspace && alreadyDrawn(last, cmd)) {
 
                         #ifdef NK_QUICKDRAW_GRAPHICS_DEBUGGING
                             writeSerialPortDebug(boutRefNum, "ALREADY DREW CMD nk_command_line");
@@ -723,6 +1306,13 @@ void updateBounds(int top, int bottom, int left, int right) {
                 #endif
 
                 // great reference: http://mirror.informatimago.com/next/developer.apple.com/documentation/mac/QuickDraw/QuickDraw-60.html
+                #ifdef ENABLED_DOUBLE_BUFFERING
+                    Rect lineBounds = {l->begin.y, l->begin.x, l->begin.y, l->begin.x};
+                    updateBoundsForPoint(&lineBounds, l->begin.x, l->begin.y, l->line_thickness);
+                    updateBoundsForPoint(&lineBounds, l->end.x, l->end.y, l->line_thickness);
+                    updateBounds(lineBounds.top, lineBounds.bottom, lineBounds.left, lineBounds.right);
+                #endif
+
                 ForeColor(l->color);
                 PenSize(l->line_thickness, l->line_thickness);
                 MoveTo(l->begin.x, l->begin.y);
@@ -740,7 +1330,7 @@ void updateBounds(int top, int bottom, int left, int right) {
                 const struct nk_command_circle *c = (const struct nk_command_circle *)cmd;
 
                 #ifdef COMMAND_CACHING
-                    if (!lastInputWasBackspace && cmd->type == lastCmd->type && memcmp(c, lastCmd, sizeof(struct nk_command_circle)) == 0) {
+                    if (!lastInputWasBackspace && alreadyDrawn(last, cmd)) {
 
                         #ifdef NK_QUICKDRAW_GRAPHICS_DEBUGGING
                             writeSerialPortDebug(boutRefNum, "ALREADY DREW CMD nk_command_circle");
@@ -775,7 +1365,7 @@ void updateBounds(int top, int bottom, int left, int right) {
                 const struct nk_command_circle_filled *c = (const struct nk_command_circle_filled *)cmd;
 
                 #ifdef COMMAND_CACHING
-                    if (!lastInputWasBackspace && cmd->type == lastCmd->type && memcmp(c, lastCmd, sizeof(struct nk_command_circle_filled)) == 0) {
+                    if (!lastInputWasBackspace && alreadyDrawn(last, cmd)) {
 
                         #ifdef NK_QUICKDRAW_GRAPHICS_DEBUGGING
                             writeSerialPortDebug(boutRefNum, "ALREADY DREW CMD nk_command_circle_filled");
@@ -814,7 +1404,7 @@ void updateBounds(int top, int bottom, int left, int right) {
                 const struct nk_command_triangle *t = (const struct nk_command_triangle*)cmd;
 
                 #ifdef COMMAND_CACHING
-                    if (!lastInputWasBackspace && cmd->type == lastCmd->type && memcmp(t, lastCmd, sizeof(struct nk_command_triangle)) == 0) {
+                    if (!lastInputWasBackspace && alreadyDrawn(last, cmd)) {
 
                         #ifdef NK_QUICKDRAW_GRAPHICS_DEBUGGING
                             writeSerialPortDebug(boutRefNum, "ALREADY DREW CMD nk_command_triangle");
@@ -824,6 +1414,14 @@ void updateBounds(int top, int bottom, int left, int right) {
                     }
                 #endif
                 
+                #ifdef ENABLED_DOUBLE_BUFFERING
+                    Rect triangleBounds = {t->a.y, t->a.x, t->a.y, t->a.x};
+                    updateBoundsForPoint(&triangleBounds, t->a.x, t->a.y, t->line_thickness);
+                    updateBoundsForPoint(&triangleBounds, t->b.x, t->b.y, t->line_thickness);
+                    updateBoundsForPoint(&triangleBounds, t->c.x, t->c.y, t->line_thickness);
+                    updateBounds(triangleBounds.top, triangleBounds.bottom, triangleBounds.left, triangleBounds.right);
+                #endif
+
                 ForeColor(t->color);
                 PenSize(t->line_thickness, t->line_thickness);
 
@@ -844,7 +1442,7 @@ void updateBounds(int top, int bottom, int left, int right) {
                 const struct nk_command_triangle_filled *t = (const struct nk_command_triangle_filled *)cmd;
 
                 #ifdef COMMAND_CACHING
-                    if (!lastInputWasBackspace && cmd->type == lastCmd->type && memcmp(t, lastCmd, sizeof(struct nk_command_triangle_filled)) == 0) {
+                    if (!lastInputWasBackspace && alreadyDrawn(last, cmd)) {
 
                         #ifdef NK_QUICKDRAW_GRAPHICS_DEBUGGING
                             writeSerialPortDebug(boutRefNum, "ALREADY DREW CMD nk_command_triangle_filled");
@@ -854,6 +1452,14 @@ void updateBounds(int top, int bottom, int left, int right) {
                     }
                 #endif
 
+                #ifdef ENABLED_DOUBLE_BUFFERING
+                    Rect triangleBounds = {t->a.y, t->a.x, t->a.y, t->a.x};
+                    updateBoundsForPoint(&triangleBounds, t->a.x, t->a.y, 1);
+                    updateBoundsForPoint(&triangleBounds, t->b.x, t->b.y, 1);
+                    updateBoundsForPoint(&triangleBounds, t->c.x, t->c.y, 1);
+                    updateBounds(triangleBounds.top, triangleBounds.bottom, triangleBounds.left, triangleBounds.right);
+                #endif
+
                 PenSize(1.0, 1.0);
                 // BackPat(&colorPattern); // inside macintosh: imaging with quickdraw 3-48
                 ForeColor(blackColor);
@@ -880,7 +1486,7 @@ void updateBounds(int top, int bottom, int left, int right) {
                 const struct nk_command_polygon *p = (const struct nk_command_polygon*)cmd;
 
                 #ifdef COMMAND_CACHING
-                    if (!lastInputWasBackspace && cmd->type == lastCmd->type && memcmp(p, lastCmd, sizeof(struct nk_command_polygon)) == 0) {
+                    if (!lastInputWasBackspace && alreadyDrawn(last, cmd)) {
 
                         #ifdef NK_QUICKDRAW_GRAPHICS_DEBUGGING
                             writeSerialPortDebug(boutRefNum, "ALREADY DREW CMD nk_command_polygon");
@@ -893,6 +1499,17 @@ void updateBounds(int top, int bottom, int left, int right) {
                 ForeColor(p->color);
                 int i;
 
+                #ifdef ENABLED_DOUBLE_BUFFERING
+                    Rect polygonBounds = {p->points[0].y, p->points[0].x, p->points[0].y, p->points[0].x};
+
+                    for (i = 0; i < p->point_count; i++) {
+
+                        updateBoundsForPoint(&polygonBounds, p->points[i].x, p->points[i].y, p->line_thickness);
+                    }
+
+                    updateBounds(polygonBounds.top, polygonBounds.bottom, polygonBounds.left, polygonBounds.right);
+                #endif
+
                 for (i = 0; i < p->point_count; i++) {
 
                     if (i == 0) {
@@ -920,7 +1537,7 @@ void updateBounds(int top, int bottom, int left, int right) {
                 const struct nk_command_polygon_filled *p = (const struct nk_command_polygon_filled*)cmd;
 
                 #ifdef COMMAND_CACHING
-                    if (!lastInputWasBackspace && cmd->type == lastCmd->type && memcmp(p, lastCmd, sizeof(struct nk_command_polygon_filled)) == 0) {
+                    if (!lastInputWasBackspace && alreadyDrawn(last, cmd)) {
 
                         #ifdef NK_QUICKDRAW_GRAPHICS_DEBUGGING
                             writeSerialPortDebug(boutRefNum, "ALREADY DREW CMD nk_command_polygon_filled");
@@ -934,6 +1551,17 @@ void updateBounds(int top, int bottom, int left, int right) {
                 ForeColor(blackColor);
                 int i;
 
+                #ifdef ENABLED_DOUBLE_BUFFERING
+                    Rect polygonBounds = {p->points[0].y, p->points[0].x, p->points[0].y, p->points[0].x};
+
+                    for (i = 0; i < p->point_count; i++) {
+
+                        updateBoundsForPoint(&polygonBounds, p->points[i].x, p->points[i].y, 1);
+                    }
+
+                    updateBounds(polygonBounds.top, polygonBounds.bottom, polygonBounds.left, polygonBounds.right);
+                #endif
+
                 PolyHandle trianglePolygon = OpenPoly(); 
                 for (i = 0; i < p->point_count; i++) {
 
@@ -969,7 +1597,7 @@ void updateBounds(int top, int bottom, int left, int right) {
                 const struct nk_command_polygon *p = (const struct nk_command_polygon*)cmd;
 
                 #ifdef COMMAND_CACHING
-                    if (!lastInputWasBackspace && cmd->type == lastCmd->type && memcmp(p, lastCmd, sizeof(struct nk_command_polygon)) == 0) {
+                    if (!lastInputWasBackspace && alreadyDrawn(last, cmd)) {
 
                         #ifdef NK_QUICKDRAW_GRAPHICS_DEBUGGING
                             writeSerialPortDebug(boutRefNum, "ALREADY DREW CMD nk_command_polygon");
@@ -982,6 +1610,17 @@ void updateBounds(int top, int bottom, int left, int right) {
                 ForeColor(p->color);
                 int i;
 
+                #ifdef ENABLED_DOUBLE_BUFFERING
+                    Rect polygonBounds = {p->points[0].y, p->points[0].x, p->points[0].y, p->points[0].x};
+
+                    for (i = 0; i < p->point_count; i++) {
+
+                        updateBoundsForPoint(&polygonBounds, p->points[i].x, p->points[i].y, p->line_thickness);
+                    }
+
+                    updateBounds(polygonBounds.top, polygonBounds.bottom, polygonBounds.left, polygonBounds.right);
+                #endif
+
                 for (i = 0; i < p->point_count; i++) {
 
                     if (i == 0) {
@@ -1009,6 +1648,15 @@ void updateBounds(int top, int bottom, int left, int right) {
                 Point p3 = { (int)q->ctrl[1].x, (int)q->ctrl[1].y};
                 Point p4 = { (int)q->end.x, (int)q->end.y};
 
+                // the curve never leaves the box around its control points
+                #ifdef ENABLED_DOUBLE_BUFFERING
+                    Rect curveBounds = {p1.v, p1.h, p1.v, p1.h};
+                    updateBoundsForPoint(&curveBounds, p2.h, p2.v, 1);
+                    updateBoundsForPoint(&curveBounds, p3.h, p3.v, 1);
+                    updateBoundsForPoint(&curveBounds, p4.h, p4.v, 1);
+                    updateBounds(curveBounds.top, curveBounds.bottom, curveBounds.left, curveBounds.right);
+                #endif
+
                 BezierCurve(p1, p2, p3, p4);
             }
 
@@ -1032,6 +1680,10 @@ void updateBounds(int top, int bottom, int left, int right) {
                 int y2 = (int)a->cy + (int)a->r;
                 SetRect(&arcBoundingBoxRectangle, x1, y1, x2, y2);
 
+                #ifdef ENABLED_DOUBLE_BUFFERING
+                    updateBounds(y1, y2 + 1, x1, x2 + 1);
+                #endif
+
                 FrameArc(&arcBoundingBoxRectangle, a->a[0], a->a[1]);
             }
 
@@ -1087,10 +1739,6 @@ void updateBounds(int top, int bottom, int left, int right) {
     #endif
 }
 
-#ifdef COMMAND_CACHING
-    const struct nk_command *lastCmd;
-#endif
-
 NK_API void nk_quickdraw_render(WindowPtr window, struct nk_context *ctx) {
 
     #ifdef DEBUG_FUNCTION_CALLS
@@ -1102,24 +1750,31 @@ NK_API void nk_quickdraw_render(WindowPtr window, struct nk_context *ctx) {
     #endif
 
     #ifdef PROFILING
-        PROFILE_START("get cmds and memcmp them");
+        PROFILE_START("compare window checksums");
     #endif
 
     void *cmds = nk_buffer_memory(&ctx->memory);
 
-    // do not render if the buffer did not change from the previous rendering run
-    if (!memcmp(cmds, last, ctx->memory.allocated)) {
+    currentDrawnWindowCount = collectDrawnWindows(ctx);
+
+    // do not render if no window's commands changed from the previous rendering run
+    if (drawnWindowsUnchanged()) {
 
         #ifdef NK_QUICKDRAW_GRAPHICS_DEBUGGING
 
             writeSerialPortDebug(boutRefNum, "NO RENDER BUFFER CHANGE, ABORT");
         #endif
 
+        #ifdef PROFILING
+            PROFILE_END("compare window checksums");
+            PROFILE_END("IN nk_quickdraw_render");
+        #endif
+
         return;
     }
 
     #ifdef PROFILING
-        PROFILE_END("get cmds and memcmp them");
+        PROFILE_END("compare window checksums");
     #endif
 
     const struct nk_command *cmd = 0;
@@ -1128,6 +1783,10 @@ NK_API void nk_quickdraw_render(WindowPtr window, struct nk_context *ctx) {
         OpenPort(&gMainOffScreen.BWPort);
         SetPort(&gMainOffScreen.BWPort);
         SetPortBits(&gMainOffScreen.BWBits);
+
+        // OpenPort puts the port back to the system font
+        TextFont(NK_QUICKDRAW_FONT_NUMBER);
+        TextSize(NK_QUICKDRAW_FONT_SIZE);
     #endif
 
     #ifdef PROFILING
@@ -1135,50 +1794,110 @@ NK_API void nk_quickdraw_render(WindowPtr window, struct nk_context *ctx) {
     #endif
 
     #ifdef COMMAND_CACHING
-        lastCmd = nk_ptr_add_const(struct nk_command, last, 0);
+        #ifdef PROFILING
+            commandCacheHits = 0;
+            commandCacheMisses = 0;
+        #endif
+    #endif
+
+    #if TEXT_RUN_CACHE_SIZE > 0
+        #ifdef PROFILING
+            textRunHits = 0;
+            textRunMisses = 0;
+        #endif
+    #endif
+
+    #ifdef COMMAND_CACHING
+        short drawnWindow = -1;
+        Boolean skipWindow = false;
     #endif
 
     nk_foreach(cmd, ctx) {
 
         #ifdef COMMAND_CACHING
-            runDrawCommand(cmd, lastCmd);
-        #else
-            runDrawCommand(cmd);
-        #endif
 
-        #ifdef COMMAND_CACHING
+            // a window whose commands are exactly what they were last frame is still on the offscreen
+            // buffer, unless something drawn earlier this frame has gone over it
+            short windowForCommand = findDrawnWindow((const char *)cmd - (const char *)cmds, drawnWindow);
 
-            #ifdef NK_QUICKDRAW_GRAPHICS_DEBUGGING
-                writeSerialPortDebug(boutRefNum, "COMMAND_CACHING: get next cached command");
-            #endif
+            if (windowForCommand != drawnWindow) {
 
-            if (lastCmd && lastCmd->next) {
+                drawnWindow = windowForCommand;
+                skipWindow = drawnWindow >= 0 && !lastInputWasBackspace && windowDrawnLastFrame(&currentDrawnWindows[drawnWindow]);
 
-                #ifdef NK_QUICKDRAW_GRAPHICS_DEBUGGING
-                    writeSerialPortDebug(boutRefNum, "COMMAND_CACHING: inside conditional");
+                #ifdef WINDOW_LAYERS
+
+                    // nothing else draws on a window's layer, so an unchanged window never needs drawing
+                    // again unless its layer is new
+                    DrawnWindow *current = drawnWindow >= 0 ? &currentDrawnWindows[drawnWindow] : NULL;
+
+                    if (current && current->layer == NULL && !current->freshLayer) {
+
+                        current->layer = layerForWindow(current->window, &current->freshLayer);
+                    }
+
+                    if (current && current->layer) {
+
+                        skipWindow = skipWindow && !current->freshLayer;
+                        commandCacheBypassed = current->freshLayer;
+                        SetPort(&current->layer->map.BWPort);
+                    } else {
+
+                        skipWindow = skipWindow && !intersectsDirtyRects(current->window->bounds);
+                        commandCacheBypassed = false;
+                        SetPort(&gMainOffScreen.BWPort);
+                    }
+                #elif defined(ENABLED_DOUBLE_BUFFERING)
+                    skipWindow = skipWindow && !intersectsDirtyRects(currentDrawnWindows[drawnWindow].window->bounds);
                 #endif
+            }
 
-                lastCmd = nk_ptr_add_const(struct nk_command, last, lastCmd->next);
+            if (!skipWindow) {
+
+                runDrawCommand(cmd);
             }
 
-            #ifdef NK_QUICKDRAW_GRAPHICS_DEBUGGING
-                writeSerialPortDebug(boutRefNum, "COMMAND_CACHING: done getting lastCmd");
-            #endif
+            rememberCommand(cmds, cmd);
+        #else
+            runDrawCommand(cmd);
         #endif
     }
 
-    #ifdef PROFILING
-        PROFILE_START("memcpy commands");
+    #ifdef WINDOW_LAYERS
+        commandCacheBypassed = false;
+        compositeWindowLayers();
     #endif
 
-    free(last);
-    last = calloc(1, MAX_MEMORY_IN_KB * 1024);
-    memcpy(last, cmds, ctx->memory.allocated);
+    DrawnWindow *swapDrawnWindows = lastDrawnWindows;
+    lastDrawnWindows = currentDrawnWindows;
+    currentDrawnWindows = swapDrawnWindows;
+    lastDrawnWindowCount = currentDrawnWindowCount;
 
-    #ifdef PROFILING
-        PROFILE_END("memcpy commands");
+    #ifdef COMMAND_CACHING
+        swapCommandHashTables();
+
+        #ifdef PROFILING
+            char cacheMessage[255];
+            sprintf(cacheMessage, "PROFILE_COMMAND_CACHE hits: %u, misses: %u", commandCacheHits, commandCacheMisses);
+            writeSerialPortProfile(cacheMessage);
+        #endif
+    #endif
+
+    #if TEXT_RUN_CACHE_SIZE > 0
+        #ifdef PROFILING
+            char textRunMessage[255];
+            sprintf(textRunMessage, "PROFILE_TEXT_RUN_CACHE hits: %u, misses: %u", textRunHits, textRunMisses);
+            writeSerialPortProfile(textRunMessage);
+        #endif
     #endif
 
+    // what we just drew becomes the previous frame, and the next frame is built in the other buffer.
+    // nk_clear resets the buffer's offsets before then, so swapping the pointer is all it takes
+    last = cmds;
+    lastAllocated = ctx->memory.allocated;
+    currentCommandBuffer = !currentCommandBuffer;
+    ctx->memory.memory.ptr = commandBuffers[currentCommandBuffer];
+
     #ifdef PROFILING
         PROFILE_END("rendering loop and switch");
     #endif
@@ -1195,28 +1914,35 @@ NK_API void nk_quickdraw_render(WindowPtr window, struct nk_context *ctx) {
 
         SetPort(window);
 
-        Rect quickDrawRectangle;
-        quickDrawRectangle.top = mostTop;
-        quickDrawRectangle.left = mostLeft;
-        quickDrawRectangle.bottom = mostBottom;
-        quickDrawRectangle.right = mostRight;
+        #ifdef PROFILING
+            pixelsBlitted = 0;
+        #endif
 
-        CopyBits(&gMainOffScreen.bits->portBits, &window->portBits, &quickDrawRectangle, &quickDrawRectangle, srcCopy, 0L);
+        for (short i = 0; i < dirtyRectCount; i++) {
 
-        #ifdef DRAW_BLIT_LOCATION
-            ForeColor(blackColor);
-            // FillRoundRect(&quickDrawRectangle, 0, 0, &qd.ltGray);
-            FrameRoundRect(&quickDrawRectangle, 0, 0);
-        #endif
+            CopyBits(&gMainOffScreen.bits->portBits, &window->portBits, &dirtyRects[i], &dirtyRects[i], srcCopy, 0L);
 
-        mostLeft = WINDOW_WIDTH;
-        mostBottom = 1;
-        mostTop = WINDOW_HEIGHT;
-        mostRight = 1;
+            #ifdef PROFILING
+                pixelsBlitted += dirtyRectArea(&dirtyRects[i]);
+            #endif
+
+            #ifdef DRAW_BLIT_LOCATION
+                ForeColor(blackColor);
+                // FillRoundRect(&dirtyRects[i], 0, 0, &qd.ltGray);
+                FrameRoundRect(&dirtyRects[i], 0, 0);
+            #endif
+        }
 
         #ifdef PROFILING
             PROFILE_END("copy bits");
+
+            char profileMessage[255];
+            sprintf(profileMessage, "PROFILE_BLIT rects: %d, pixels: %lu of %ld", dirtyRectCount, pixelsBlitted, (long)WINDOW_WIDTH * WINDOW_HEIGHT);
+            writeSerialPortProfile(profileMessage);
         #endif
+
+        dirtyRectCount = 0;
+        SetRect(&currentScissor, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
     #endif
 
     #ifdef PROFILING
@@ -1484,24 +2210,44 @@ NK_API struct nk_context* nk_quickdraw_init(unsigned int width, unsigned int hei
     // needed to calculate bezier info, see mactech article.
     setupBezier();
 
+    // with double buffering nothing is drawn in the window's port, but its font still gives us the
+    // line height
+    FontInfo fontInfo;
+
+    TextFont(NK_QUICKDRAW_FONT_NUMBER);
+    TextSize(NK_QUICKDRAW_FONT_SIZE);
+    TextFace(0);
+    GetFontInfo(&fontInfo);
+    textLineAscent = fontInfo.ascent;
+    textLineHeight = fontInfo.ascent + fontInfo.descent;
+
+    #if TEXT_RUN_CACHE_SIZE > 0
+        Rect textRunBounds;
+        SetRect(&textRunBounds, 0, 0, TEXT_RUN_MAX_WIDTH, TEXT_RUN_CACHE_SIZE * textLineHeight);
+        textRunBitmapReady = NewShockBitmapWithBounds(&textRunBitmap, &textRunBounds);
+    #endif
+
     #ifdef ENABLED_DOUBLE_BUFFERING
         NewShockBitmap(&gMainOffScreen, width, height);
-    #else
-        TextFont(0);
-        TextSize(12);
-        TextFace(0);
     #endif
 
+    nk_quickdraw_select_font_widths(NK_QUICKDRAW_FONT_NUMBER, NK_QUICKDRAW_FONT_SIZE);
+
     NkQuickDrawFont *quickdrawfont = nk_quickdraw_font_create_from_file();
     struct nk_user_font *font = &quickdrawfont->nk;
 
-    #ifdef COMMAND_CACHING
-        lastCmd = malloc(sizeof(struct nk_command));
-    #endif
-
-    last = calloc(1, MAX_MEMORY_IN_KB * 1024);
-    buf = calloc(1, MAX_MEMORY_IN_KB * 1024);
-    nk_init_fixed(&quickdraw.nuklear_context, buf, MAX_MEMORY_IN_KB * 1024, font);
+    // windows live in their own pool rather than at the back of the command buffer, so that the
+    // command buffers can be swapped without taking the windows with them
+    commandBuffers[0] = calloc(1, MAX_MEMORY_IN_KB * 1024);
+    commandBuffers[1] = calloc(1, MAX_MEMORY_IN_KB * 1024);
+    pool = calloc(1, MAX_POOL_MEMORY_IN_KB * 1024);
+    last = commandBuffers[1];
+
+    struct nk_buffer commandBuffer;
+    struct nk_buffer poolBuffer;
+    nk_buffer_init_fixed(&commandBuffer, commandBuffers[0], MAX_MEMORY_IN_KB * 1024);
+    nk_buffer_init_fixed(&poolBuffer, pool, MAX_POOL_MEMORY_IN_KB * 1024);
+    nk_init_custom(&quickdraw.nuklear_context, &commandBuffer, &poolBuffer, font);
 
     nk_style_push_font(&quickdraw.nuklear_context, font);
 
@@ -0,0 +1,191 @@
+#include "SerialHelper.h"
+#include "scheduler.h"
+
+// there are only ever a handful of tasks, so they are kept in a table and looked through every
+// turn rather than sorted in to a heap or a timer wheel
+ScheduledTask scheduledTasks[MAX_SCHEDULED_TASKS];
+short scheduledTaskCount = 0;
+
+// returns the task's handle, or -1 if the table is full. due is when it first runs
+short addScheduledTask(const char *name, ScheduledTaskFunction run, long period, long jitter, Boolean needsSerial, long due) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: addScheduledTask");
+    #endif
+
+    if (scheduledTaskCount == MAX_SCHEDULED_TASKS) {
+
+        return -1;
+    }
+
+    ScheduledTask *task = &scheduledTasks[scheduledTaskCount];
+
+    task->name = name;
+    task->run = run;
+    task->period = period;
+    task->jitter = jitter;
+    task->needsSerial = needsSerial;
+    task->pending = period > 0;
+    task->due = due;
+    task->lastRun = due - period;
+    task->runs = 0;
+    task->overruns = 0;
+    task->worstLateness = 0;
+
+    return scheduledTaskCount++;
+}
+
+// runs a task at due instead of whenever it was going to run next. a periodic task carries on at
+// its period from there
+void scheduleTask(short task, long due) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: scheduleTask");
+    #endif
+
+    if (task < 0 || task >= scheduledTaskCount) {
+
+        return;
+    }
+
+    scheduledTasks[task].due = due;
+    scheduledTasks[task].pending = true;
+}
+
+// the next run moves to a period after the last one
+void setScheduledTaskPeriod(short task, long period) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: setScheduledTaskPeriod");
+    #endif
+
+    if (task < 0 || task >= scheduledTaskCount || scheduledTasks[task].period == period) {
+
+        return;
+    }
+
+    scheduledTasks[task].period = period;
+
+    if (period > 0) {
+
+        scheduledTasks[task].due = scheduledTasks[task].lastRun + period;
+        scheduledTasks[task].pending = true;
+    }
+}
+
+static Boolean runTask(ScheduledTask *task, long now) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: runTask");
+    #endif
+
+    long lateness = now - task->due;
+
+    task->runs++;
+    task->lastRun = now;
+
+    if (lateness > task->worstLateness) {
+
+        task->worstLateness = lateness;
+    }
+
+    if (lateness > task->jitter) {
+
+        task->overruns++;
+    }
+
+    // counted from when it actually ran, so a task that fell behind does not then run back to back
+    // to catch up
+    if (task->period > 0) {
+
+        task->due = now + task->period;
+    } else {
+
+        task->pending = false;
+    }
+
+    return task->run();
+}
+
+// called once per event loop turn. every task that is due runs, except that only one serial task
+// may start a coprocessor call. when several are waiting, the one closest to running out of jitter
+// goes first and the others keep until a later turn
+void runDueTasks(long now) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: runDueTasks");
+    #endif
+
+    for (short i = 0; i < scheduledTaskCount; i++) {
+
+        ScheduledTask *task = &scheduledTasks[i];
+
+        if (task->pending && !task->needsSerial && task->due <= now) {
+
+            runTask(task, now);
+        }
+    }
+
+    Boolean tried[MAX_SCHEDULED_TASKS] = {false};
+
+    while (true) {
+
+        ScheduledTask *next = NULL;
+        short nextIndex = -1;
+
+        for (short i = 0; i < scheduledTaskCount; i++) {
+
+            ScheduledTask *task = &scheduledTasks[i];
+
+            if (tried[i] || !task->pending || !task->needsSerial || task->due > now) {
+
+                continue;
+            }
+
+            if (next == NULL || task->due + task->jitter < next->due + next->jitter) {
+
+                next = task;
+                nextIndex = i;
+            }
+        }
+
+        if (next == NULL) {
+
+            return;
+        }
+
+        tried[nextIndex] = true;
+
+        if (runTask(next, now)) {
+
+            return;
+        }
+    }
+}
+
+// how long until a task is due, but no more than limit
+long ticksUntilNextTask(long now, long limit) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: ticksUntilNextTask");
+    #endif
+
+    long sleep = limit;
+
+    for (short i = 0; i < scheduledTaskCount; i++) {
+
+        if (!scheduledTasks[i].pending) {
+
+            continue;
+        }
+
+        long until = scheduledTasks[i].due > now ? scheduledTasks[i].due - now : 0;
+
+        if (until < sleep) {
+
+            sleep = until;
+        }
+    }
+
+    return sleep;
+}
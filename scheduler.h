@@ -0,0 +1,36 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <MacTypes.h>
+
+// background work for the event loop, run when it comes due. times are in ticks
+#define MAX_SCHEDULED_TASKS 8
+
+// for a task that needs serial, returns true if it did use the port. a task that finds it has
+// nothing to send returns false, and another serial task gets to go this turn instead
+typedef Boolean (*ScheduledTaskFunction)(void);
+
+typedef struct ScheduledTask {
+    const char *name;
+    ScheduledTaskFunction run;
+    long period; // 0 for a task that only runs when scheduleTask asks for it
+    long jitter; // how late it can run before that counts as an overrun
+    Boolean needsSerial; // talks to the coprocessor, at most one of these starts per turn
+    Boolean pending;
+    long due;
+    long lastRun;
+    unsigned long runs;
+    unsigned long overruns;
+    long worstLateness;
+} ScheduledTask;
+
+extern ScheduledTask scheduledTasks[MAX_SCHEDULED_TASKS];
+extern short scheduledTaskCount;
+
+short addScheduledTask(const char *name, ScheduledTaskFunction run, long period, long jitter, Boolean needsSerial, long due);
+void scheduleTask(short task, long due);
+void setScheduledTaskPeriod(short task, long period);
+void runDueTasks(long now);
+long ticksUntilNextTask(long now, long limit);
+
+#endif
@@ -0,0 +1,83 @@
+#include <stdlib.h>
+#include "SerialHelper.h"
+#include "scratch.h"
+
+// allocations are rounded up to a long so that whatever is put in them is aligned, the 68000
+// faults on word access to an odd address
+#define SCRATCH_ALIGNMENT 4
+
+Boolean initScratchArena(ScratchArena *arena, long size) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: initScratchArena");
+    #endif
+
+    arena->base = malloc(size);
+    arena->size = arena->base == NULL ? 0 : size;
+    arena->used = 0;
+    arena->highWater = 0;
+
+    return arena->base != NULL;
+}
+
+// returns NULL rather than growing if there is not enough room left
+void *scratchAlloc(ScratchArena *arena, long size) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: scratchAlloc");
+    #endif
+
+    size = (size + SCRATCH_ALIGNMENT - 1) & ~(long)(SCRATCH_ALIGNMENT - 1);
+
+    if (size > arena->size - arena->used) {
+
+        #ifdef MESSAGES_FOR_MACINTOSH_DEBUGGING
+            writeSerialPortDebug(boutRefNum, "ERROR: scratch arena is full");
+        #endif
+
+        return NULL;
+    }
+
+    void *allocation = &arena->base[arena->used];
+
+    arena->used += size;
+
+    if (arena->used > arena->highWater) {
+
+        arena->highWater = arena->used;
+    }
+
+    return allocation;
+}
+
+// everything allocated after a mark is given back by releasing it
+long scratchMark(ScratchArena *arena) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: scratchMark");
+    #endif
+
+    return arena->used;
+}
+
+void scratchRelease(ScratchArena *arena, long mark) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: scratchRelease");
+    #endif
+
+    if (mark >= 0 && mark < arena->used) {
+
+        arena->used = mark;
+    }
+}
+
+// called once per event loop iteration, so anything a caller forgot to release only lives until then
+void resetScratchArena(ScratchArena *arena) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: resetScratchArena");
+    #endif
+
+    arena->used = 0;
+}
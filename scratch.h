@@ -0,0 +1,22 @@
+#ifndef SCRATCH_H
+#define SCRATCH_H
+
+#include <MacTypes.h>
+
+// a block of memory that is handed out front to back and given back all at once, for buffers that
+// only live as long as one coprocessor call or one trip round the event loop. the block is
+// allocated once at startup, so using it never touches the Memory Manager's heap
+typedef struct ScratchArena {
+    char *base;
+    long size;
+    long used;
+    long highWater; // the most that has ever been in use, worth watching when changing size
+} ScratchArena;
+
+Boolean initScratchArena(ScratchArena *arena, long size);
+void *scratchAlloc(ScratchArena *arena, long size);
+long scratchMark(ScratchArena *arena);
+void scratchRelease(ScratchArena *arena, long mark);
+void resetScratchArena(ScratchArena *arena);
+
+#endif
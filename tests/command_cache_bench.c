@@ -0,0 +1,211 @@
+// replays frames laid out the way nuklear_app.c lays out the chat list and transcript through the
+// command cache in command_cache.h, and counts how many commands it would skip drawing. the same
+// frames are compared command by command at the same position, which is how the cache used to work,
+// so the two hit rates can be put side by side. run with run_tests.sh
+#define NK_ZERO_COMMAND_MEMORY
+#define NK_INCLUDE_FIXED_TYPES
+#define NK_INCLUDE_STANDARD_IO
+#define NK_INCLUDE_DEFAULT_ALLOCATOR
+#define NK_IMPLEMENTATION
+#define NK_MEMSET memset
+#define NK_MEMCPY memcpy
+#include <stdlib.h>
+#include <string.h>
+#include "check.h"
+#include "toolbox_stub.h"
+#include "../nuklear.h"
+#include "../command_cache.h"
+
+#define MAX_MEMORY_IN_KB 16
+#define MAX_POOL_MEMORY_IN_KB 16
+#define MAX_FRAME_COMMANDS 512
+#define MESSAGE_ROW_HEIGHT 11
+
+// what is on screen in one frame
+typedef struct Frame {
+    const char *chats[12];
+    short chatCount;
+    const char *title;
+    short firstMessage;
+    short messageCount;
+} Frame;
+
+typedef struct Counts {
+    long commands;
+    long positionHits;
+    long hashHits;
+} Counts;
+
+static const char *messages[] = {
+    "Jane Doe: are we still on for tonight?",
+    "me: yes, 7 at the usual place",
+    "Jane Doe: great, I will bring the pictures",
+    "me: the ones from the lake?",
+    "Jane Doe: those and the ones from the wedding",
+    "me: can not wait",
+    "Jane Doe: did you hear back about the job",
+    "me: not yet, they said by friday",
+    "Jane Doe: fingers crossed",
+    "me: thanks, see you at 7"
+};
+
+static struct nk_context ctx;
+static struct nk_user_font font;
+static void *commandBuffers[2];
+static short currentCommandBuffer = 0;
+static void *last;
+static nk_size lastOffsets[MAX_FRAME_COMMANDS];
+static short lastCommandCount = 0;
+
+// every character of the system font is close enough to 6 pixels for laying out
+static short textWidth(nk_handle handle, short height, const char *text, short len) {
+
+    return len * 6;
+}
+
+static void layOutFrame(const Frame *frame) {
+
+    if (nk_begin(&ctx, "Chats", nk_rect(0, 0, 180, 342), NK_WINDOW_BORDER|NK_WINDOW_NO_SCROLLBAR)) {
+
+        nk_layout_row_begin(&ctx, NK_STATIC, 25, 1);
+
+        for (short i = 0; i < frame->chatCount; i++) {
+
+            nk_layout_row_push(&ctx, 169);
+            nk_button_label(&ctx, frame->chats[i]);
+        }
+
+        nk_layout_row_end(&ctx);
+        nk_end(&ctx);
+    }
+
+    if (nk_begin_titled(&ctx, "Message", frame->title, nk_rect(180, 0, 330, 306), NK_WINDOW_BORDER|NK_WINDOW_TITLE|NK_WINDOW_NO_SCROLLBAR)) {
+
+        nk_layout_row_dynamic(&ctx, MESSAGE_ROW_HEIGHT, 1);
+
+        for (short i = frame->firstMessage; i < frame->firstMessage + frame->messageCount; i++) {
+
+            const char *text = messages[i % (sizeof(messages) / sizeof(messages[0]))];
+
+            nk_text(&ctx, text, strlen(text), NK_TEXT_ALIGN_LEFT);
+        }
+
+        nk_end(&ctx);
+    }
+}
+
+// goes through the frame's commands the way nk_quickdraw_render does, counting the ones either
+// cache would have skipped, then swaps the command buffers over for the next frame
+static void renderFrame(const Frame *frame, Counts *counts) {
+
+    static nk_size offsets[MAX_FRAME_COMMANDS];
+    const struct nk_command *cmd;
+    short count = 0;
+
+    layOutFrame(frame);
+
+    void *cmds = nk_buffer_memory(&ctx.memory);
+
+    nk_foreach(cmd, &ctx) {
+
+        if (cmd->type != NK_COMMAND_SCISSOR) {
+
+            counts->commands++;
+
+            if (alreadyDrawn(last, cmd)) {
+
+                counts->hashHits++;
+            }
+
+            if (count < lastCommandCount && commandsDrawTheSame(nk_ptr_add_const(struct nk_command, last, lastOffsets[count]), cmd)) {
+
+                counts->positionHits++;
+            }
+        }
+
+        if (count < MAX_FRAME_COMMANDS) {
+
+            offsets[count++] = (const char *)cmd - (const char *)cmds;
+        }
+
+        rememberCommand(cmds, cmd);
+    }
+
+    swapCommandHashTables();
+    memcpy(lastOffsets, offsets, sizeof(offsets[0]) * count);
+    lastCommandCount = count;
+
+    last = cmds;
+    currentCommandBuffer = !currentCommandBuffer;
+    ctx.memory.memory.ptr = commandBuffers[currentCommandBuffer];
+    nk_clear(&ctx);
+}
+
+// draws before, then after, and reports how much of after was already on screen
+static void replay(const char *name, const Frame *before, const Frame *after, Counts *counts) {
+
+    Counts ignored = {0};
+
+    memset(counts, 0, sizeof(*counts));
+    renderFrame(before, &ignored);
+    renderFrame(after, counts);
+
+    printf("  %-36s %3ld commands, skipped by position: %3ld (%3ld%%), by hash: %3ld (%3ld%%)\n", name, counts->commands,
+           counts->positionHits, counts->positionHits * 100 / counts->commands, counts->hashHits, counts->hashHits * 100 / counts->commands);
+
+    // the hash finds everything the old positional compare did
+    CHECK(counts->hashHits >= counts->positionHits);
+}
+
+int main() {
+
+    static char pool[MAX_POOL_MEMORY_IN_KB * 1024];
+    struct nk_buffer commandBuffer;
+    struct nk_buffer poolBuffer;
+    Counts counts;
+
+    Frame idle = {{"Jane Doe", "John Doe", "Mum", "Book club", "Alex", "Sam", "Work", "Chris"}, 8, "Jane Doe", 0, 24};
+    Frame newChat = {{"Pat (1 new) ", "Jane Doe", "John Doe", "Mum", "Book club", "Alex", "Sam", "Work", "Chris"}, 9, "Jane Doe", 0, 24};
+    Frame unread = {{"Jane Doe", "John Doe", "Mum (2 new) ", "Book club", "Alex", "Sam", "Work", "Chris"}, 8, "Jane Doe", 0, 24};
+    Frame shortChat = {{"Jane Doe", "John Doe", "Mum", "Book club", "Alex", "Sam", "Work", "Chris"}, 8, "Jane Doe", 0, 6};
+    Frame shortChatAnswered = {{"Jane Doe", "John Doe", "Mum", "Book club", "Alex", "Sam", "Work", "Chris"}, 8, "Jane Doe", 0, 7};
+    Frame newMessage = {{"Jane Doe", "John Doe", "Mum", "Book club", "Alex", "Sam", "Work", "Chris"}, 8, "Jane Doe", 1, 24};
+    Frame otherChat = {{"Jane Doe", "John Doe", "Mum", "Book club", "Alex", "Sam", "Work", "Chris"}, 8, "John Doe", 3, 24};
+
+    commandBuffers[0] = calloc(1, MAX_MEMORY_IN_KB * 1024);
+    commandBuffers[1] = calloc(1, MAX_MEMORY_IN_KB * 1024);
+    last = commandBuffers[1];
+
+    font.height = 12;
+    font.width = textWidth;
+
+    nk_buffer_init_fixed(&commandBuffer, commandBuffers[0], MAX_MEMORY_IN_KB * 1024);
+    nk_buffer_init_fixed(&poolBuffer, pool, sizeof(pool));
+    nk_init_custom(&ctx, &commandBuffer, &poolBuffer, &font);
+
+    // nuklear puts the windows in their lasting order on the frame after they are made
+    renderFrame(&idle, &counts);
+
+    printf("commands already on screen after a change:\n");
+
+    replay("nothing changed", &idle, &idle, &counts);
+    CHECK(counts.hashHits == counts.commands);
+
+    // the transcript comes first in the command buffer, so a row added to the bottom of it pushes
+    // every one of the chat list's commands along. the positional compare redrew all of them
+    replay("a message added to a short chat", &shortChat, &shortChatAnswered, &counts);
+    CHECK(counts.hashHits > counts.positionHits);
+    CHECK(counts.commands - counts.hashHits <= 2);
+
+    // the names all move down a button, so each button's background is found but not its name
+    replay("a new chat at the top of the list", &idle, &newChat, &counts);
+
+    replay("an unread count on one chat", &idle, &unread, &counts);
+
+    // every row moves up, so only the chat list is still where it was
+    replay("a new message, following the newest", &idle, &newMessage, &counts);
+
+    replay("another chat opened", &idle, &otherChat, &counts);
+
+    return checkFailures;
+}
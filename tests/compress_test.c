@@ -0,0 +1,254 @@
+// decodes what coprocessor/frame.js compressed (see compress_vectors.js) with the Mac's decoder,
+// whole and cut short at every point, and times it. run with run_tests.sh
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "check.h"
+#include "toolbox_stub.h"
+#include "../coprocessorjs.h"
+
+#define MAX_VECTOR_SIZE 65536
+#define GUARD_SIZE 16
+#define BENCHMARK_CLOCKS (CLOCKS_PER_SEC / 20) // decode each vector over and over for this long
+
+// rough 68000 costs of the decoder's three kinds of work, from the instruction timings in the
+// 68000 user's manual. literals go through memcpy a long word at a time (a move.l (a0)+,(a1)+ and
+// a dbra, 30 cycles for four bytes). matches go a byte at a time (a move.b (a0)+,(a1)+, a subq.l
+// and a bne, 30 cycles a byte). each sequence calls receiveRingByte for its token and offset, and
+// memcpy twice in copyRingBytes, with the checks around them, which comes to a few hundred
+#define LITERAL_CYCLES_PER_BYTE 8
+#define MATCH_CYCLES_PER_BYTE 30
+#define CYCLES_PER_SEQUENCE 500
+
+void pumpSerialReceive();
+void encodeFrameHeader(unsigned char *bytes, CoprocessorFrameHeader *header);
+Boolean peekFrameInReceiveRing(CoprocessorFrameHeader *header);
+long consumeFrame(CoprocessorFrameHeader *header, char *output, long outputSize);
+long decompressFromReceiveRing(char *output, long outputSize, unsigned long start, unsigned long end);
+
+extern unsigned short application_id;
+extern unsigned long receiveRingTail;
+
+static long readFile(const char *directory, const char *name, const char *extension, char *bytes) {
+
+    char path[1024];
+
+    snprintf(path, sizeof(path), "%s/%s.%s", directory, name, extension);
+
+    FILE *file = fopen(path, "rb");
+
+    if (file == NULL) {
+
+        return -1;
+    }
+
+    long length = fread(bytes, 1, MAX_VECTOR_SIZE, file);
+
+    fclose(file);
+
+    return length;
+}
+
+// walks a block the same way decompressFromReceiveRing does, adding up how much of each kind of
+// work it holds, so that the decoder's time can be estimated for a 68000
+static long estimate68000Cycles(const unsigned char *block, long blockLength) {
+
+    long position = 4;
+    long cycles = 0;
+
+    while (position < blockLength) {
+
+        unsigned char token = block[position++];
+        long literalLength = token >> 4;
+        long matchLength = token & 0x0F;
+
+        if (literalLength == 15) {
+
+            while (position < blockLength && block[position] == 255) {
+
+                literalLength += block[position++];
+            }
+
+            literalLength += block[position++];
+        }
+
+        position += literalLength;
+        cycles += CYCLES_PER_SEQUENCE + literalLength * LITERAL_CYCLES_PER_BYTE;
+
+        if (position >= blockLength) {
+
+            break;
+        }
+
+        position += 2;
+
+        if (matchLength == 15) {
+
+            while (position < blockLength && block[position] == 255) {
+
+                matchLength += block[position++];
+            }
+
+            matchLength += block[position++];
+        }
+
+        cycles += (matchLength + 4) * MATCH_CYCLES_PER_BYTE;
+    }
+
+    return cycles;
+}
+
+// puts a compressed frame in the ring and leaves it there for the caller to decode
+static void receiveCompressedFrame(const char *block, long blockLength, CoprocessorFrameHeader *header) {
+
+    static unsigned char frame[COPROCESSOR_FRAME_HEADER_SIZE + MAX_VECTOR_SIZE];
+
+    header->version = COPROCESSOR_FRAME_VERSION;
+    header->opcode = COPROCESSOR_OPCODE_FUNCTION;
+    header->status = COPROCESSOR_STATUS_SUCCESS;
+    header->flags = COPROCESSOR_FLAG_COMPRESSED;
+    header->applicationId = application_id;
+    header->callId = 1;
+    header->payloadLength = blockLength;
+
+    encodeFrameHeader(frame, header);
+    memcpy(&frame[COPROCESSOR_FRAME_HEADER_SIZE], block, blockLength);
+
+    stubSerialReset();
+    stubSerialInstantReads = true;
+    stubSerialArrive(frame, COPROCESSOR_FRAME_HEADER_SIZE + blockLength);
+
+    while (!peekFrameInReceiveRing(header)) {
+
+        pumpSerialReceive();
+    }
+}
+
+static void testVector(const char *directory, const char *name) {
+
+    static char raw[MAX_VECTOR_SIZE];
+    static char block[MAX_VECTOR_SIZE];
+    static char output[MAX_VECTOR_SIZE + GUARD_SIZE];
+    long rawLength = readFile(directory, name, "raw", raw);
+    long blockLength = readFile(directory, name, "lz", block);
+    CoprocessorFrameHeader header;
+    int failuresBefore = checkFailures;
+
+    CHECK(rawLength >= 0 && blockLength > 0);
+
+    if (rawLength < 0 || blockLength <= 0) {
+
+        return;
+    }
+
+    receiveCompressedFrame(block, blockLength, &header);
+
+    unsigned long payloadStart = receiveRingTail + COPROCESSOR_FRAME_HEADER_SIZE;
+
+    // every way of cutting the block short has to be turned down, unless all that went was the
+    // empty sequence at the end, and nothing may be written past the end of the output on the way
+    // there. the big vectors are cut at a stride to save time
+    long stride = blockLength > 2048 ? 7 : 1;
+
+    for (long cut = 0; cut < blockLength; cut += stride) {
+
+        memset(output, 'G', sizeof(output));
+
+        long decoded = decompressFromReceiveRing(output, rawLength + 1, payloadStart, payloadStart + cut);
+
+        CHECK(decoded == -1 || (decoded == rawLength && !memcmp(output, raw, rawLength)));
+
+        for (long i = rawLength + 1; i < rawLength + 1 + GUARD_SIZE; i++) {
+
+            CHECK(output[i] == 'G');
+        }
+
+        if (checkFailures != failuresBefore) {
+
+            printf("  %s cut to %ld bytes of %ld\n", name, cut, blockLength);
+
+            break;
+        }
+    }
+
+    // decoded whole over and over, for the time it takes
+    clock_t start = clock();
+    long decodes = 0;
+
+    while (clock() - start < BENCHMARK_CLOCKS) {
+
+        CHECK(decompressFromReceiveRing(output, rawLength + 1, payloadStart, payloadStart + blockLength) == rawLength);
+        decodes++;
+    }
+
+    double nanoseconds = (double)(clock() - start) * 1000000000 / CLOCKS_PER_SEC / decodes;
+    long cycles = estimate68000Cycles((const unsigned char *)block, blockLength);
+
+    // and once more, through the same path a real response takes
+    memset(output, 'G', sizeof(output));
+    CHECK(consumeFrame(&header, output, rawLength + 1) == rawLength);
+    CHECK(!memcmp(output, raw, rawLength));
+    CHECK(output[rawLength] == '\0');
+
+    if (rawLength > 0) {
+
+        printf("  %-12s %6ld bytes compressed to %6ld, decoded at %5.2f ns a byte, about %3ld 68000 cycles a byte\n",
+               name, rawLength, blockLength, nanoseconds / rawLength, cycles / rawLength);
+    } else {
+
+        printf("  %-12s %6ld bytes compressed to %6ld\n", name, rawLength, blockLength);
+    }
+
+    if (checkFailures != failuresBefore) {
+
+        printf("  in vector %s\n", name);
+    }
+}
+
+// a match whose extended length runs off the end of the block. the truncated marker used to be
+// added to the length and wrap round to a short match, which then decoded as if nothing was wrong
+static void testTruncatedMatchLength() {
+
+    // 8 decoded bytes: one literal `a`, then a match at offset 1 with length 15 + 4 and more to come
+    const char block[] = {0, 0, 0, 8, 0x1F, 'a', 0, 1};
+    static char output[64];
+    CoprocessorFrameHeader header;
+
+    receiveCompressedFrame(block, sizeof(block), &header);
+
+    unsigned long payloadStart = receiveRingTail + COPROCESSOR_FRAME_HEADER_SIZE;
+
+    CHECK(decompressFromReceiveRing(output, sizeof(output), payloadStart, payloadStart + sizeof(block)) == -1);
+    consumeFrame(&header, output, sizeof(output));
+    CHECK(output[0] == '\0');
+}
+
+int main(int argc, char **argv) {
+
+    char names[1024];
+    const char *directory = argc > 1 ? argv[1] : ".";
+    short vectorCount = 0;
+
+    setupCoprocessor("nuklear", "modem");
+
+    printf("decoding each vector, here and estimated for a 68000:\n");
+
+    snprintf(names, sizeof(names), "%s/vectors.txt", directory);
+
+    FILE *vectors = fopen(names, "r");
+
+    CHECK(vectors != NULL);
+
+    while (vectors != NULL && fgets(names, sizeof(names), vectors) != NULL) {
+
+        names[strcspn(names, "\n")] = '\0';
+        testVector(directory, names);
+        vectorCount++;
+    }
+
+    CHECK(vectorCount > 0);
+
+    testTruncatedMatchLength();
+
+    return checkFailures;
+}
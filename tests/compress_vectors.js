@@ -0,0 +1,90 @@
+// compresses some real payloads with coprocessor/frame.js and writes them out for compress_test.c,
+// which decodes them with the Mac's decoder and checks it gets the originals back. run with
+// run_tests.sh:
+//
+//   node compress_vectors.js <directory>
+//
+// writes <name>.raw and <name>.lz for each payload, and their names, one per line, to vectors.txt
+const assert = require(`assert`)
+const fs = require(`fs`)
+const path = require(`path`)
+const vm = require(`vm`)
+const frame = require(`../coprocessor/frame.js`)
+
+const JS_DIRECTORY = path.join(__dirname, `..`, `JS`)
+
+// the test transcript from index.js, repeated out to as many messages as it keeps, in the form
+// splitMessages sends it
+const transcript = () => {
+
+  const source = fs.readFileSync(path.join(JS_DIRECTORY, `index.js`), `utf8`)
+  const messages = vm.runInNewContext(source.match(/let TEST_MESSAGES = (\[[\s\S]*?\n\])/)[1])
+  const rows = []
+
+  for (let i = 0; i < 500; i++) {
+
+    const message = messages[i % messages.length]
+
+    rows.push(`${message.chatter}: ${message.text}`)
+  }
+
+  return Buffer.from(rows.join(`ENDLASTMESSAGE`), `latin1`)
+}
+
+// the JS program the way compile_js.sh bundles it
+const program = () => {
+
+  return Buffer.concat(fs.readdirSync(JS_DIRECTORY).filter((filename) => /\.js/.test(filename)).sort().map((filename) => {
+
+    return Buffer.concat([Buffer.from(`${filename}@@@\n`), fs.readFileSync(path.join(JS_DIRECTORY, filename)), Buffer.from(`&&&\n`)])
+  }))
+}
+
+// random bytes do not compress, so this is all literals with long literal lengths
+const random = (length) => {
+
+  const bytes = Buffer.alloc(length)
+  let state = 12345
+
+  for (let i = 0; i < length; i++) {
+
+    state = (Math.imul(state, 1103515245) + 12345) >>> 0
+    bytes[i] = state >>> 24
+  }
+
+  return bytes
+}
+
+const payloads = {
+  empty: Buffer.alloc(0),
+  short: Buffer.from(`false`),
+  run: Buffer.alloc(3000, `a`), // one match at offset 1 that overlaps itself
+  chatCounts: Buffer.from(Array.from({length: 10}, (_, i) => `friend ${i},${i % 3}`).join(`,`)),
+  transcript: transcript(),
+  program: program(),
+  random: random(20000)
+}
+
+const [directory] = process.argv.slice(2)
+
+if (!directory) {
+
+  console.log(`usage: node compress_vectors.js <directory>`)
+  process.exit(1)
+}
+
+const names = []
+
+for (const [name, payload] of Object.entries(payloads)) {
+
+  const compressed = frame.compress(payload)
+
+  // the JS side has to be able to read its own output before the Mac gets a go
+  assert.ok(frame.decompress(compressed).equals(payload), `${name}: decompress(compress(payload))`)
+
+  fs.writeFileSync(path.join(directory, `${name}.raw`), payload)
+  fs.writeFileSync(path.join(directory, `${name}.lz`), compressed)
+  names.push(name)
+}
+
+fs.writeFileSync(path.join(directory, `vectors.txt`), `${names.join(`\n`)}\n`)
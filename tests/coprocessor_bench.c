@@ -0,0 +1,221 @@
+// counts what the event loop's background polling costs on the serial port, and what each response
+// costs on its way out of the receive ring, using coprocessorjs.c and the fake serial driver. the
+// coprocessor is played by answerIdle below, which answers every call the way index.js does when
+// nothing has changed. run with run_tests.sh
+#include <stdlib.h>
+#include <string.h>
+#include "check.h"
+#include "toolbox_stub.h"
+#include "../coprocessorjs.h"
+
+#define MINUTE_TICKS 3600
+
+void encodeFrameHeader(unsigned char *bytes, CoprocessorFrameHeader *header);
+
+extern unsigned short application_id;
+
+static long answeredLength = 0;
+static char *fixedAnswer = NULL; // when set, every call gets this for an answer
+
+static void answerIdle(const unsigned char *written, long length) {
+
+    while (length - answeredLength >= COPROCESSOR_FRAME_HEADER_SIZE) {
+
+        const unsigned char *frame = &written[answeredLength];
+        const char *payload = (const char *)&frame[COPROCESSOR_FRAME_HEADER_SIZE];
+        long payloadLength = ((long)frame[10] << 24) | ((long)frame[11] << 16) | ((long)frame[12] << 8) | frame[13];
+
+        if (length - answeredLength < COPROCESSOR_FRAME_HEADER_SIZE + payloadLength) {
+
+            return;
+        }
+
+        // a batch gets a `<length>:<result>` for each call in it, which is a count we can not be
+        // bothered to work out here, so every batch is taken to be the event loop's two
+        const char *answer = fixedAnswer != NULL ? fixedAnswer : !strncmp(payload, "5:batch", 7) ? "5:false5:false" : "false";
+        static unsigned char response[COPROCESSOR_FRAME_HEADER_SIZE + 32768];
+        CoprocessorFrameHeader header;
+
+        header.version = COPROCESSOR_FRAME_VERSION;
+        header.opcode = frame[3];
+        header.status = COPROCESSOR_STATUS_SUCCESS;
+        header.flags = 0;
+        header.applicationId = application_id;
+        header.callId = (frame[8] << 8) | frame[9];
+        header.payloadLength = strlen(answer);
+
+        encodeFrameHeader(response, &header);
+        memcpy(&response[COPROCESSOR_FRAME_HEADER_SIZE], answer, header.payloadLength);
+        stubSerialArrive(response, COPROCESSOR_FRAME_HEADER_SIZE + header.payloadLength);
+
+        answeredLength += COPROCESSOR_FRAME_HEADER_SIZE + payloadLength;
+    }
+}
+
+static void resetCounts() {
+
+    memset(&coprocessorStats, 0, sizeof(coprocessorStats));
+    stubSerialReset();
+    stubSerialInstantReads = true;
+    stubCoprocessor = answerIdle;
+    answeredLength = 0;
+    fixedAnswer = NULL;
+}
+
+static void report(const char *name) {
+
+    printf("  %-40s round trips: %3lu, bytes written: %5lu, bytes received: %5lu\n", name,
+           coprocessorStats.roundTrips, coprocessorStats.bytesWritten, coprocessorStats.bytesReceived);
+}
+
+// calls functionName with chat as its one argument, or with none if chat is NULL
+static void call(char *functionName, char *chat) {
+
+    static char output[256];
+    char buffer[96];
+    CoprocessorArguments arguments;
+    CoprocessorCall call;
+
+    beginCoprocessorArguments(&arguments, buffer, sizeof(buffer));
+
+    if (chat != NULL) {
+
+        addCoprocessorStringArgument(&arguments, chat);
+    }
+
+    callFunctionOnCoprocessorAsync(functionName, &arguments, output, sizeof(output), &call);
+    waitForCoprocessorCall(&call);
+}
+
+// getNewMessages' arguments, as syncWithCoprocessor in nuklear_app.c gives them
+static CoprocessorArguments *newMessagesArguments(char *buffer, long size, CoprocessorArguments *arguments) {
+
+    beginCoprocessorArguments(arguments, buffer, size);
+    addCoprocessorStringArgument(arguments, "Jane Doe");
+    addCoprocessorNumberArgument(arguments, 0);
+    addCoprocessorNumberArgument(arguments, 41);
+
+    return arguments;
+}
+
+// a minute of polling, the way the event loop did it before the sync batch: its own round trip for
+// hasNewMessagesInChat every 300 ticks and for getChatCounts every 500
+static void pollSeparately() {
+
+    long lastMessagesInChat = 0;
+    long lastChatCounts = 0;
+
+    for (long now = 0; now < MINUTE_TICKS; now++) {
+
+        if (now - lastMessagesInChat > 300) {
+
+            call("hasNewMessagesInChat", "Jane Doe");
+            lastMessagesInChat = now;
+        }
+
+        if (now - lastChatCounts > 500) {
+
+            call("getChatCounts", NULL);
+            lastChatCounts = now;
+        }
+    }
+}
+
+// the same minute with both asked in one batch every interval ticks, see syncWithCoprocessor in
+// nuklear_app.c. interval is SYNC_INTERVAL_TICKS, or SYNC_INTERVAL_PUSHED_TICKS once the
+// coprocessor has shown that it pushes events
+static void pollBatched(long interval) {
+
+    static char output[256];
+    char buffer[96];
+    CoprocessorArguments arguments;
+
+    for (long now = interval; now <= MINUTE_TICKS; now += interval) {
+
+        CoprocessorBatch batch;
+        CoprocessorCall call;
+
+        beginCoprocessorBatch(&batch);
+        addFunctionToCoprocessorBatch(&batch, "getChatCounts", NULL);
+        addFunctionToCoprocessorBatch(&batch, "getNewMessages", newMessagesArguments(buffer, sizeof(buffer), &arguments));
+        callBatchOnCoprocessorViewAsync(&batch, output, sizeof(output), &call);
+        waitForCoprocessorCall(&call);
+        releaseCoprocessorView(&call);
+    }
+}
+
+static void benchmarkIdlePolling() {
+
+    printf("a minute of idle polling:\n");
+
+    resetCounts();
+    pollSeparately();
+    report("separate calls");
+
+    unsigned long separateRoundTrips = coprocessorStats.roundTrips;
+
+    resetCounts();
+    pollBatched(300);
+    report("one batch every 300 ticks");
+
+    CHECK(coprocessorStats.roundTrips < separateRoundTrips);
+
+    resetCounts();
+    pollBatched(3600);
+    report("one batch a minute, coprocessor pushes");
+
+    CHECK(coprocessorStats.roundTrips == 1);
+}
+
+// how much of each response gets copied on its way to the caller. the copying calls move every
+// byte out of the receive ring in to the caller's buffer, the view calls leave it where it landed.
+// (before the receive ring, a call cleared and copied its 32 KB buffers five times over, whatever
+// the size of the response)
+static void benchmarkResponseCopies() {
+
+    static char output[32768];
+    static char transcript[2048];
+    char buffer[96];
+    CoprocessorArguments arguments;
+    char *answers[] = {"false", transcript};
+
+    memset(transcript, 'm', sizeof(transcript) - 1);
+    transcript[sizeof(transcript) - 1] = '\0';
+
+    printf("bytes copied out of the receive ring per call:\n");
+
+    for (short i = 0; i < 2; i++) {
+
+        CoprocessorCall call;
+
+        resetCounts();
+        fixedAnswer = answers[i];
+        callFunctionOnCoprocessorAsync("getNewMessages", newMessagesArguments(buffer, sizeof(buffer), &arguments), output, sizeof(output), &call);
+        waitForCoprocessorCall(&call);
+
+        unsigned long copied = coprocessorStats.bytesCopied;
+
+        resetCounts();
+        fixedAnswer = answers[i];
+        callFunctionOnCoprocessorViewAsync("getNewMessages", newMessagesArguments(buffer, sizeof(buffer), &arguments), output, sizeof(output), &call);
+        waitForCoprocessorCall(&call);
+
+        CHECK(call.view.length == (long)strlen(answers[i]));
+        CHECK(!memcmp(call.view.data, answers[i], call.view.length));
+        CHECK(coprocessorStats.bytesCopied == 0);
+
+        printf("  %4ld byte response: copied %4lu, as a view %4lu\n", (long)strlen(answers[i]), copied, coprocessorStats.bytesCopied);
+
+        releaseCoprocessorView(&call);
+    }
+}
+
+int main() {
+
+    setupCoprocessor("nuklear", "modem");
+
+    benchmarkIdlePolling();
+    benchmarkResponseCopies();
+
+    return checkFailures;
+}
@@ -0,0 +1,503 @@
+// coprocessorjs.c against the fake serial driver in host/toolbox_stub.c. run with run_tests.sh
+#include <stdlib.h>
+#include <string.h>
+#include "check.h"
+#include "toolbox_stub.h"
+#include "../coprocessorjs.h"
+
+// not in coprocessorjs.h, the event loop has no business calling these directly
+#define RECEIVE_RING_SIZE 32768
+
+void pumpSerialReceive();
+void dispatchReceivedFrames();
+void encodeFrameHeader(unsigned char *bytes, CoprocessorFrameHeader *header);
+Boolean peekFrameInReceiveRing(CoprocessorFrameHeader *header);
+long consumeFrame(CoprocessorFrameHeader *header, char *output, long outputSize);
+
+extern unsigned short application_id;
+extern unsigned long receiveRingHead;
+extern unsigned long receiveRingTail;
+
+static char output[RECEIVE_RING_SIZE + 1];
+
+static long buildFrame(unsigned char *frame, unsigned char opcode, unsigned char status, unsigned short callId, const char *payload, long payloadLength) {
+
+    CoprocessorFrameHeader header;
+
+    header.version = COPROCESSOR_FRAME_VERSION;
+    header.opcode = opcode;
+    header.status = status;
+    header.flags = 0;
+    header.applicationId = application_id;
+    header.callId = callId;
+    header.payloadLength = payloadLength;
+
+    encodeFrameHeader(frame, &header);
+    memcpy(&frame[COPROCESSOR_FRAME_HEADER_SIZE], payload, payloadLength);
+
+    return COPROCESSOR_FRAME_HEADER_SIZE + payloadLength;
+}
+
+// one pump and one interrupt: the read goes out, then the driver finishes it
+static void deliver() {
+
+    pumpSerialReceive();
+    stubSerialInterrupt();
+    pumpSerialReceive();
+}
+
+static void testReadStaysPendingUntilTheDriverFinishesIt() {
+
+    unsigned char frame[64];
+    CoprocessorFrameHeader header;
+    long length = buildFrame(frame, COPROCESSOR_OPCODE_FUNCTION, COPROCESSOR_STATUS_SUCCESS, 1, "hello", 5);
+
+    stubSerialReset();
+    stubSerialArrive(frame, length);
+
+    unsigned long head = receiveRingHead;
+
+    pumpSerialReceive();
+    CHECK(stubSerialReadPending());
+    CHECK(receiveRingHead == head);
+
+    // polling again while the read is in progress must not start another one or move the head
+    pumpSerialReceive();
+    CHECK(stubSerialReadPending());
+    CHECK(stubSerialOverlappingReads == 0);
+    CHECK(receiveRingHead == head);
+    CHECK(!peekFrameInReceiveRing(&header));
+
+    stubSerialInterrupt();
+    pumpSerialReceive();
+    CHECK(receiveRingHead == head + length);
+    CHECK(peekFrameInReceiveRing(&header));
+    CHECK(consumeFrame(&header, output, sizeof(output)) == 5);
+    CHECK(!strcmp(output, "hello"));
+}
+
+static void testFrameArrivingInPiecesIsReassembled() {
+
+    unsigned char frame[64];
+    CoprocessorFrameHeader header;
+    long length = buildFrame(frame, COPROCESSOR_OPCODE_FUNCTION, COPROCESSOR_STATUS_SUCCESS, 2, "a;;;b&&&c", 9);
+
+    stubSerialReset();
+
+    // half a header, then the rest of the header, then the payload a byte at a time
+    stubSerialArrive(frame, 7);
+    deliver();
+    CHECK(!peekFrameInReceiveRing(&header));
+
+    stubSerialArrive(&frame[7], COPROCESSOR_FRAME_HEADER_SIZE - 7);
+    deliver();
+    CHECK(!peekFrameInReceiveRing(&header));
+    CHECK(header.payloadLength == 9);
+
+    for (long i = COPROCESSOR_FRAME_HEADER_SIZE; i < length; i++) {
+
+        CHECK(!peekFrameInReceiveRing(&header));
+        stubSerialArrive(&frame[i], 1);
+        deliver();
+    }
+
+    CHECK(peekFrameInReceiveRing(&header));
+    CHECK(header.callId == 2);
+    CHECK(consumeFrame(&header, output, sizeof(output)) == 9);
+    CHECK(!strcmp(output, "a;;;b&&&c"));
+    CHECK(receiveRingHead == receiveRingTail);
+}
+
+static void testBytesOutsideOfAFrameAreSkipped() {
+
+    unsigned char frame[64];
+    CoprocessorFrameHeader header;
+    long length = buildFrame(frame, COPROCESSOR_OPCODE_FUNCTION, COPROCESSOR_STATUS_SUCCESS, 3, "ok", 2);
+
+    stubSerialReset();
+    stubSerialArrive("xxC", 3);
+    stubSerialArrive(frame, length);
+    deliver();
+
+    CHECK(peekFrameInReceiveRing(&header));
+    CHECK(header.callId == 3);
+    CHECK(consumeFrame(&header, output, sizeof(output)) == 2);
+    CHECK(!strcmp(output, "ok"));
+}
+
+static void testFramesSurviveTheRingWrapping() {
+
+    static unsigned char frame[RECEIVE_RING_SIZE];
+    static char payload[5000];
+    CoprocessorFrameHeader header;
+
+    stubSerialReset();
+
+    // enough frames of an awkward size to go round the ring a few times, with every payload different
+    for (short i = 0; i < 20; i++) {
+
+        for (short j = 0; j < (short)sizeof(payload); j++) {
+
+            payload[j] = 'a' + (i + j) % 26;
+        }
+
+        long length = buildFrame(frame, COPROCESSOR_OPCODE_FUNCTION, COPROCESSOR_STATUS_SUCCESS, 100 + i, payload, sizeof(payload));
+
+        stubSerialArrive(frame, length);
+
+        while (!peekFrameInReceiveRing(&header)) {
+
+            deliver();
+        }
+
+        CHECK(header.callId == 100 + i);
+        CHECK(consumeFrame(&header, output, sizeof(output)) == (long)sizeof(payload));
+        CHECK(!memcmp(output, payload, sizeof(payload)));
+    }
+
+    CHECK(receiveRingHead > RECEIVE_RING_SIZE * 2);
+    CHECK(stubSerialUnread() == 0);
+}
+
+static void testFrameTooLargeForTheRingIsDropped() {
+
+    static unsigned char frame[RECEIVE_RING_SIZE * 2];
+    static char payload[RECEIVE_RING_SIZE + 100];
+    CoprocessorFrameHeader header;
+
+    memset(payload, 'z', sizeof(payload));
+
+    stubSerialReset();
+    stubSerialArrive(frame, buildFrame(frame, COPROCESSOR_OPCODE_FUNCTION, COPROCESSOR_STATUS_SUCCESS, 7, payload, sizeof(payload)));
+    stubSerialArrive(frame, buildFrame(frame, COPROCESSOR_OPCODE_FUNCTION, COPROCESSOR_STATUS_SUCCESS, 8, "after", 5));
+
+    while (!peekFrameInReceiveRing(&header)) {
+
+        deliver();
+    }
+
+    CHECK(header.callId == 7);
+    CHECK(header.status == COPROCESSOR_STATUS_FAILURE);
+    CHECK(header.payloadLength == 0);
+    consumeFrame(&header, NULL, 0);
+
+    while (!peekFrameInReceiveRing(&header)) {
+
+        deliver();
+    }
+
+    CHECK(header.callId == 8);
+    CHECK(consumeFrame(&header, output, sizeof(output)) == 5);
+    CHECK(!strcmp(output, "after"));
+}
+
+// answers every FUNCTION frame the Mac writes with the function name in capitals, newest first, so
+// that responses come back in a different order to the calls
+static long answeredLength = 0;
+
+static void answerNewestFirst(const unsigned char *written, long length) {
+
+    static unsigned char requests[4][COPROCESSOR_FRAME_HEADER_SIZE + 64];
+    static short requestCount = 0;
+
+    while (length - answeredLength >= COPROCESSOR_FRAME_HEADER_SIZE) {
+
+        const unsigned char *frame = &written[answeredLength];
+        long payloadLength = ((long)frame[12] << 8) | frame[13];
+
+        if (length - answeredLength < COPROCESSOR_FRAME_HEADER_SIZE + payloadLength) {
+
+            return;
+        }
+
+        memcpy(requests[requestCount++], frame, COPROCESSOR_FRAME_HEADER_SIZE + payloadLength);
+        answeredLength += COPROCESSOR_FRAME_HEADER_SIZE + payloadLength;
+    }
+
+    if (requestCount < 2) {
+
+        return;
+    }
+
+    for (short i = requestCount - 1; i >= 0; i--) {
+
+        unsigned char answer[COPROCESSOR_FRAME_HEADER_SIZE + 64];
+        char name[64];
+        char *payload = (char *)&requests[i][COPROCESSOR_FRAME_HEADER_SIZE];
+        char *nameStart = strchr(payload, ':') + 1;
+        long nameLength = atol(payload);
+
+        for (long j = 0; j < nameLength; j++) {
+
+            name[j] = nameStart[j] - 'a' + 'A';
+        }
+
+        stubSerialArrive(answer, buildFrame(answer, requests[i][3], COPROCESSOR_STATUS_SUCCESS, (requests[i][8] << 8) | requests[i][9], name, nameLength));
+    }
+
+    requestCount = 0;
+}
+
+static void testResponsesAreRoutedByCallId() {
+
+    static char firstOutput[64];
+    static char secondOutput[64];
+    CoprocessorCall first;
+    CoprocessorCall second;
+
+    stubSerialReset();
+    stubSerialInstantReads = true;
+    stubCoprocessor = answerNewestFirst;
+    answeredLength = 0;
+
+    char buffer[16];
+    CoprocessorArguments arguments;
+
+    beginCoprocessorArguments(&arguments, buffer, sizeof(buffer));
+    addCoprocessorStringArgument(&arguments, "x");
+
+    callFunctionOnCoprocessorAsync("first", NULL, firstOutput, sizeof(firstOutput), &first);
+    callFunctionOnCoprocessorAsync("second", &arguments, secondOutput, sizeof(secondOutput), &second);
+    CHECK(coprocessorCallInFlight());
+
+    waitForCoprocessorCall(&first);
+    CHECK(first.state == COPROCESSOR_CALL_COMPLETE);
+    CHECK(!strcmp(firstOutput, "FIRST"));
+
+    // the second answer came in first, so it was already sitting there
+    CHECK(second.state == COPROCESSOR_CALL_COMPLETE);
+    CHECK(!strcmp(secondOutput, "SECOND"));
+    CHECK(!coprocessorCallInFlight());
+}
+
+// answers every FUNCTION frame with "ok"
+static void answerOk(const unsigned char *written, long length) {
+
+    while (length - answeredLength >= COPROCESSOR_FRAME_HEADER_SIZE) {
+
+        const unsigned char *frame = &written[answeredLength];
+        long payloadLength = ((long)frame[12] << 8) | frame[13];
+        unsigned char answer[COPROCESSOR_FRAME_HEADER_SIZE + 2];
+
+        if (length - answeredLength < COPROCESSOR_FRAME_HEADER_SIZE + payloadLength) {
+
+            return;
+        }
+
+        stubSerialArrive(answer, buildFrame(answer, frame[3], COPROCESSOR_STATUS_SUCCESS, (frame[8] << 8) | frame[9], "ok", 2));
+        answeredLength += COPROCESSOR_FRAME_HEADER_SIZE + payloadLength;
+    }
+}
+
+// the same payload as function_arguments in frame_vectors.txt, which frame_test.js checks
+// decodeArguments in coprocessor/frame.js against
+static void testFunctionArgumentsAreLengthPrefixed() {
+
+    static const char expected[] = "16:sendMessageSince8:Jane Doe2:415:a&&&b";
+    static char output[64];
+    char buffer[32];
+    char small[12];
+    CoprocessorArguments arguments;
+    CoprocessorCall call;
+    long writtenLength;
+
+    stubSerialReset();
+    stubSerialInstantReads = true;
+    stubCoprocessor = answerOk;
+    answeredLength = 0;
+
+    beginCoprocessorArguments(&arguments, buffer, sizeof(buffer));
+    CHECK(addCoprocessorStringArgument(&arguments, "Jane Doe"));
+    CHECK(addCoprocessorNumberArgument(&arguments, 41));
+    CHECK(addCoprocessorArgument(&arguments, "a&&&b", 5));
+    CHECK(arguments.count == 3);
+
+    callFunctionOnCoprocessorAsync("sendMessageSince", &arguments, output, sizeof(output), &call);
+    waitForCoprocessorCall(&call);
+    CHECK(call.status == COPROCESSOR_STATUS_SUCCESS);
+    CHECK(!strcmp(output, "ok"));
+
+    const unsigned char *written = stubSerialWritten(&writtenLength);
+
+    CHECK(writtenLength == COPROCESSOR_FRAME_HEADER_SIZE + (long)strlen(expected));
+    CHECK(!memcmp(&written[COPROCESSOR_FRAME_HEADER_SIZE], expected, strlen(expected)));
+
+    // an argument that does not fit leaves the others as they were, and the call is never made
+    beginCoprocessorArguments(&arguments, small, sizeof(small));
+    CHECK(addCoprocessorStringArgument(&arguments, "Jane Doe"));
+    CHECK(!addCoprocessorNumberArgument(&arguments, 41));
+    CHECK(arguments.full);
+    CHECK(arguments.length == 10);
+
+    callFunctionOnCoprocessorAsync("sendMessageSince", &arguments, output, sizeof(output), &call);
+    CHECK(call.state == COPROCESSOR_CALL_COMPLETE);
+    CHECK(call.status == COPROCESSOR_STATUS_FAILURE);
+    stubSerialWritten(&writtenLength);
+    CHECK(writtenLength == COPROCESSOR_FRAME_HEADER_SIZE + (long)strlen(expected));
+}
+
+// a batch is the flat list index.js's batch function takes: each call's name, its argument count
+// and its arguments, every one of them length prefixed
+static void testBatchArguments() {
+
+    char buffer[32];
+    CoprocessorArguments arguments;
+    CoprocessorBatch batch;
+
+    beginCoprocessorArguments(&arguments, buffer, sizeof(buffer));
+    addCoprocessorStringArgument(&arguments, "Jane Doe");
+    addCoprocessorNumberArgument(&arguments, 0);
+
+    beginCoprocessorBatch(&batch);
+    CHECK(addFunctionToCoprocessorBatch(&batch, "getChatCounts", NULL));
+    CHECK(addFunctionToCoprocessorBatch(&batch, "getNewMessages", &arguments));
+    CHECK(batch.callCount == 2);
+    CHECK(batch.arguments.length == (long)strlen("13:getChatCounts1:014:getNewMessages1:28:Jane Doe1:0"));
+    CHECK(!memcmp(batch.payload, "13:getChatCounts1:014:getNewMessages1:28:Jane Doe1:0", batch.arguments.length));
+
+    // a call that does not fit is left out altogether
+    static char large[COPROCESSOR_BATCH_PAYLOAD_SIZE];
+    CoprocessorArguments largeArguments;
+
+    beginCoprocessorArguments(&largeArguments, large, sizeof(large));
+    addCoprocessorArgument(&largeArguments, large, sizeof(large) - 8);
+
+    CHECK(!addFunctionToCoprocessorBatch(&batch, "getMessages", &largeArguments));
+    CHECK(batch.callCount == 2);
+    CHECK(batch.arguments.length == (long)strlen("13:getChatCounts1:014:getNewMessages1:28:Jane Doe1:0"));
+    CHECK(!batch.arguments.full);
+}
+
+// plays a coprocessor that answers the program hash probe with probeStatus, or not at all if it is
+// negative
+static short probeStatus = 0;
+
+static void answerProbe(const unsigned char *written, long length) {
+
+    if (probeStatus < 0 || length - answeredLength < COPROCESSOR_FRAME_HEADER_SIZE + 64) {
+
+        return;
+    }
+
+    unsigned char answer[COPROCESSOR_FRAME_HEADER_SIZE + 16];
+    const unsigned char *request = &written[answeredLength];
+
+    stubSerialArrive(answer, buildFrame(answer, request[3], probeStatus, (request[8] << 8) | request[9], "loaded", probeStatus == COPROCESSOR_STATUS_SUCCESS ? 6 : 0));
+    answeredLength = length;
+}
+
+static void testProgramHashProbe() {
+
+    static char probeOutput[32767];
+    const char *hash = "9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08";
+
+    stubSerialReset();
+    stubSerialInstantReads = true;
+    stubCoprocessor = answerProbe;
+    answeredLength = 0;
+
+    probeStatus = COPROCESSOR_STATUS_SUCCESS;
+    CHECK(sendProgramHashToCoprocessor(hash, probeOutput));
+    CHECK(!strcmp(probeOutput, "loaded"));
+
+    // a host without PROGRAM_HASH has to cost us a round trip, not the timeout
+    long start = stubTicks;
+
+    probeStatus = COPROCESSOR_STATUS_UNKNOWN_OPCODE;
+    CHECK(!sendProgramHashToCoprocessor(hash, probeOutput));
+    CHECK(stubTicks - start < 60);
+
+    start = stubTicks;
+    probeStatus = COPROCESSOR_STATUS_FAILURE;
+    CHECK(!sendProgramHashToCoprocessor(hash, probeOutput));
+    CHECK(stubTicks - start < 60);
+
+    // nor does a probe that could not be sent
+    start = stubTicks;
+    probeStatus = COPROCESSOR_STATUS_SUCCESS;
+    stubSerialWriteResult = abortErr;
+    CHECK(!sendProgramHashToCoprocessor(hash, probeOutput));
+    CHECK(stubTicks - start < 60);
+    CHECK(!coprocessorCallInFlight());
+    stubSerialWriteResult = noErr;
+
+    // only silence waits
+    start = stubTicks;
+    probeStatus = -1;
+    CHECK(!sendProgramHashToCoprocessor(hash, probeOutput));
+    CHECK(stubTicks - start >= 300);
+    CHECK(!coprocessorCallInFlight());
+}
+
+// runs the tokenizer over text and checks it comes out as the tokens, joined by | for short
+static void checkTokens(const char *text, const char *delimiter, const char *expected) {
+
+    char joined[256] = "";
+    CoprocessorTokenizer tokenizer;
+    CoprocessorView token;
+    short count = 0;
+
+    beginTokenizer(&tokenizer, text, strlen(text), delimiter);
+
+    while (nextToken(&tokenizer, &token) && count++ < 32) {
+
+        snprintf(&joined[strlen(joined)], sizeof(joined) - strlen(joined), "%s%.*s", count > 1 ? "|" : "", (int)token.length, token.data);
+    }
+
+    CHECK(!strcmp(joined, expected));
+
+    if (strcmp(joined, expected)) {
+
+        printf("  \"%s\" split on \"%s\" gave \"%s\", not \"%s\"\n", text, delimiter, joined, expected);
+    }
+}
+
+// the tokenizer splits the way strtokm did, and the way String.split does on the other side:
+// empty tokens are kept, so an empty response is one empty token and a trailing delimiter ends
+// with one
+static void testTokenizer() {
+
+    CoprocessorTokenizer tokenizer;
+    CoprocessorView token;
+
+    checkTokens("", ",", "");
+    checkTokens(",", ",", "|");
+    checkTokens("a,,b", ",", "a||b");
+    checkTokens("a,b,", ",", "a|b|");
+    checkTokens("Jane Doe,John Doe", ",", "Jane Doe|John Doe");
+
+    // multi-character delimiters, including the ones that only start like one
+    checkTokens("1&&&2&&&3", "&&&", "1|2|3");
+    checkTokens("1&&2&&&&3", "&&&", "1&&2|&3");
+    checkTokens("a&&&&&&b&&&", "&&&", "a||b|");
+    checkTokens("Jane: hiENDLASTMESSAGEJohn: ENDLASTMESSAGE", "ENDLASTMESSAGE", "Jane: hi|John: |");
+    checkTokens("ENDLASTMESSAG", "ENDLASTMESSAGE", "ENDLASTMESSAG");
+
+    // an empty delimiter gives nothing rather than looping forever
+    beginTokenizer(&tokenizer, "abc", 3, "");
+    CHECK(!nextToken(&tokenizer, &token));
+
+    // and the tokenizer stops at the length it was given, not at a NUL
+    beginTokenizer(&tokenizer, "a,b,c", 3, ",");
+    CHECK(nextToken(&tokenizer, &token) && viewEquals(&token, "a"));
+    CHECK(nextToken(&tokenizer, &token) && viewEquals(&token, "b"));
+    CHECK(!nextToken(&tokenizer, &token));
+}
+
+int main() {
+
+    setupCoprocessor("nuklear", "modem");
+
+    testReadStaysPendingUntilTheDriverFinishesIt();
+    testFrameArrivingInPiecesIsReassembled();
+    testBytesOutsideOfAFrameAreSkipped();
+    testFramesSurviveTheRingWrapping();
+    testFrameTooLargeForTheRingIsDropped();
+    testResponsesAreRoutedByCallId();
+    testFunctionArgumentsAreLengthPrefixed();
+    testBatchArguments();
+    testProgramHashProbe();
+    testTokenizer();
+
+    return checkFailures;
+}
@@ -0,0 +1,251 @@
+// frame_pacer.c, and a typist run through it against a simulated tick clock to see how long each
+// keystroke takes to reach the screen, with the frame pacer and without it. run with run_tests.sh
+#include <stdlib.h>
+#include <string.h>
+#include "check.h"
+#include "toolbox_stub.h"
+#include "../frame_pacer.h"
+
+#define INPUT_FRAME_TICKS 1 // only the message input is laid out and drawn
+#define SIMULATED_TICKS 1200
+#define TYPING_TICKS 600 // ten seconds of typing, then ten with nothing
+#define KEY_INTERVAL_TICKS 6 // ten keys a second, a quick typist
+#define INVALIDATION_INTERVAL_TICKS 45 // new messages, unread counts and so on coming in
+#define MAX_WAITING_KEYS 64
+
+typedef struct Latency {
+    unsigned long histogram[INPUT_LATENCY_BUCKETS];
+    unsigned long keys;
+    long worst;
+    long worstWindowWait; // from a window being invalidated to the full frame that draws it
+    unsigned long fullFrames;
+    unsigned long inputFrames;
+} Latency;
+
+static void resetPacer() {
+
+    frameInputOpen = false;
+    frameInputKeysOnly = true;
+    frameInputTickCount = 0;
+    lastFrameTickCount = 0;
+    lastFullFrameTicks = 0;
+    lastFullFrameTickCount = 0;
+    lastKeyTickCount = -TYPING_PAUSE_TICKS;
+}
+
+static void testInputAndPacing() {
+
+    resetPacer();
+
+    // nothing to draw, and so no reason to wake up for one
+    CHECK(ticksUntilFrame(100, false) == -1);
+    CHECK(frameToDraw(100, false) == NO_FRAME);
+
+    // the first input opens the frame's input and is the one its latency is counted from
+    CHECK(openFrameInput(100, true));
+    CHECK(!openFrameInput(101, true));
+    CHECK(frameInputTickCount == 100);
+    CHECK(frameInputKeysOnly);
+    CHECK(!openFrameInput(101, false));
+    CHECK(!frameInputKeysOnly);
+
+    CHECK(frameToDraw(101, false) == FULL_FRAME);
+    frameDrawn(FULL_FRAME, 101, 103);
+    CHECK(!frameInputOpen);
+    CHECK(lastFullFrameTicks == 2);
+
+    // the next can not start until FRAME_TICKS after this one did
+    CHECK(ticksUntilFrame(102, true) == FRAME_TICKS - 1);
+    CHECK(frameToDraw(102, true) == NO_FRAME);
+    CHECK(frameToDraw(101 + FRAME_TICKS, true) == FULL_FRAME);
+
+    // over budget, a frame with only keys in it draws just the input, and a redraw waits for a pause
+    frameDrawn(FULL_FRAME, 110, 110 + FRAME_BUDGET_TICKS + 1);
+    lastKeyTickCount = 120;
+    openFrameInput(120, true);
+    CHECK(frameToDraw(120, true) == INPUT_FRAME);
+    frameDrawn(INPUT_FRAME, 120, 121);
+    CHECK(lastFullFrameTicks == FRAME_BUDGET_TICKS + 1);
+    CHECK(ticksUntilFrame(121, true) == TYPING_PAUSE_TICKS - 1);
+    CHECK(frameToDraw(120 + TYPING_PAUSE_TICKS, true) == FULL_FRAME);
+
+    // a click mixed in with the keys gets a full frame
+    openFrameInput(122, true);
+    openFrameInput(122, false);
+    CHECK(frameToDraw(122, true) == FULL_FRAME);
+    frameDrawn(FULL_FRAME, 200, 200 + FRAME_BUDGET_TICKS + 1);
+
+    // typing without a break only holds a redraw back until MAX_FULL_FRAME_DEFERRAL_TICKS after the
+    // last full frame, and then keys get a full frame too
+    long now = 200 + MAX_FULL_FRAME_DEFERRAL_TICKS - 1;
+
+    lastKeyTickCount = now;
+    CHECK(ticksUntilFrame(now, true) == 1);
+    openFrameInput(now, true);
+    CHECK(frameToDraw(now, true) == INPUT_FRAME);
+    frameDrawn(INPUT_FRAME, now, now + 1);
+    lastKeyTickCount = now + 2;
+    openFrameInput(now + 2, true);
+    CHECK(frameToDraw(now + 2, false) == INPUT_FRAME);
+    CHECK(frameToDraw(now + 2, true) == FULL_FRAME);
+}
+
+static void testLatencyBuckets() {
+
+    CHECK(inputLatencyBucket(-1) == 0);
+    CHECK(inputLatencyBucket(0) == 0);
+    CHECK(inputLatencyBucket(3) == 3);
+    CHECK(inputLatencyBucket(4) == 4);
+    CHECK(inputLatencyBucket(7) == 4);
+    CHECK(inputLatencyBucket(8) == 5);
+    CHECK(inputLatencyBucket(15) == 5);
+    CHECK(inputLatencyBucket(16) == 6);
+    CHECK(inputLatencyBucket(31) == 6);
+    CHECK(inputLatencyBucket(32) == 7);
+    CHECK(inputLatencyBucket(10000) == 7);
+}
+
+// the event loop with keys and invalidations coming in. input is taken first, then a frame is drawn
+// if there is one to draw, and anything that comes in while it is drawing waits for it to finish.
+// unpaced is the loop as it was, a full frame whenever there was input or something to redraw
+static void typeFor(long fullFrameTicks, Boolean paced, Latency *latency) {
+
+    long waitingKeys[MAX_WAITING_KEYS];
+    short waitingKeyCount = 0;
+    long nextKey = 1;
+    long nextInvalidation = 10;
+    long invalidatedAt = 0;
+    Boolean invalidated = true;
+    long now = 0;
+
+    memset(latency, 0, sizeof(*latency));
+    resetPacer();
+
+    while (now < SIMULATED_TICKS) {
+
+        while (nextKey <= now && nextKey < TYPING_TICKS) {
+
+            if (waitingKeyCount < MAX_WAITING_KEYS) {
+
+                waitingKeys[waitingKeyCount++] = nextKey;
+            }
+
+            openFrameInput(nextKey, true);
+            lastKeyTickCount = now;
+            nextKey += KEY_INTERVAL_TICKS;
+        }
+
+        while (nextInvalidation <= now) {
+
+            if (!invalidated) {
+
+                invalidated = true;
+                invalidatedAt = nextInvalidation;
+            }
+
+            nextInvalidation += INVALIDATION_INTERVAL_TICKS;
+        }
+
+        short frame;
+
+        if (paced) {
+
+            frame = frameToDraw(now, invalidated);
+        } else {
+
+            frame = waitingKeyCount > 0 || invalidated ? FULL_FRAME : NO_FRAME;
+        }
+
+        if (frame == NO_FRAME) {
+
+            now++;
+
+            continue;
+        }
+
+        long finished = now + (frame == FULL_FRAME ? fullFrameTicks : INPUT_FRAME_TICKS);
+
+        for (short i = 0; i < waitingKeyCount; i++) {
+
+            long ticks = finished - waitingKeys[i];
+
+            latency->histogram[inputLatencyBucket(ticks)]++;
+            latency->keys++;
+
+            if (ticks > latency->worst) {
+
+                latency->worst = ticks;
+            }
+        }
+
+        waitingKeyCount = 0;
+
+        if (frame == FULL_FRAME) {
+
+            if (invalidated && finished - invalidatedAt > latency->worstWindowWait) {
+
+                latency->worstWindowWait = finished - invalidatedAt;
+            }
+
+            invalidated = false;
+            latency->fullFrames++;
+        } else {
+
+            latency->inputFrames++;
+        }
+
+        frameDrawn(frame, now, finished);
+        now = finished;
+    }
+
+    // every key reached the screen once, and so did every change
+    CHECK(latency->keys == (TYPING_TICKS - 1 + KEY_INTERVAL_TICKS - 1) / KEY_INTERVAL_TICKS);
+    CHECK(!invalidated || now - invalidatedAt <= fullFrameTicks);
+
+    unsigned long *histogram = latency->histogram;
+
+    printf("  %2ld tick full frames, %-8s ticks 0: %lu, 1: %lu, 2: %lu, 3: %lu, 4-7: %lu, 8-15: %lu, 16-31: %lu, 32+: %lu, worst %ld\n",
+           fullFrameTicks, paced ? "paced:" : "unpaced:", histogram[0], histogram[1], histogram[2], histogram[3],
+           histogram[4], histogram[5], histogram[6], histogram[7], latency->worst);
+}
+
+static void testTypingLatency() {
+
+    Latency unpaced;
+    Latency paced;
+
+    printf("keystroke to screen latency, %d keys a second:\n", 60 / KEY_INTERVAL_TICKS);
+
+    // frames that fit the budget are drawn as they always were, held apart by at most FRAME_TICKS
+    typeFor(FRAME_BUDGET_TICKS - 1, false, &unpaced);
+    typeFor(FRAME_BUDGET_TICKS - 1, true, &paced);
+    CHECK(paced.inputFrames == 0);
+    CHECK(paced.worst <= unpaced.worst + FRAME_TICKS - 1);
+
+    // on a slow machine a full frame takes longer than the gap between keys, so without the pacer
+    // every key waits behind one. with it, keys only wait for the message input to be drawn, and
+    // changes to the other windows are drawn once typing pauses
+    typeFor(10, false, &unpaced);
+    typeFor(10, true, &paced);
+
+    unsigned long quick = paced.histogram[0] + paced.histogram[1] + paced.histogram[2] + paced.histogram[3];
+
+    CHECK(unpaced.worst >= 10);
+    CHECK(paced.worst < unpaced.worst);
+    CHECK(quick * 100 / paced.keys >= 95);
+    CHECK(paced.inputFrames > paced.fullFrames);
+
+    // but not for longer than MAX_FULL_FRAME_DEFERRAL_TICKS, give or take the input frame it may
+    // have to wait for and the full frame itself
+    printf("  with the pacer, windows waited up to %ld ticks while typing, %ld without it\n", paced.worstWindowWait, unpaced.worstWindowWait);
+    CHECK(paced.worstWindowWait <= MAX_FULL_FRAME_DEFERRAL_TICKS + INPUT_FRAME_TICKS + 10);
+}
+
+int main() {
+
+    testInputAndPacing();
+    testLatencyBuckets();
+    testTypingLatency();
+
+    return checkFailures;
+}
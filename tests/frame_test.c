@@ -0,0 +1,119 @@
+// runs frame_vectors.txt through the Mac's receive ring, see frame_test.js for the other side.
+// run with run_tests.sh
+#include <stdlib.h>
+#include <string.h>
+#include "check.h"
+#include "toolbox_stub.h"
+#include "../coprocessorjs.h"
+
+#define MAX_VECTOR_BYTES 1024
+
+void pumpSerialReceive();
+Boolean peekFrameInReceiveRing(CoprocessorFrameHeader *header);
+long consumeFrame(CoprocessorFrameHeader *header, char *output, long outputSize);
+
+extern unsigned long receiveRingHead;
+extern unsigned long receiveRingTail;
+extern unsigned long receiveDiscardRemaining;
+
+static long fromHex(const char *hex, unsigned char *bytes) {
+
+    if (!strcmp(hex, "-")) {
+
+        return 0;
+    }
+
+    long length = strlen(hex) / 2;
+
+    for (long i = 0; i < length; i++) {
+
+        unsigned int byte;
+
+        sscanf(&hex[i * 2], "%2x", &byte);
+        bytes[i] = byte;
+    }
+
+    return length;
+}
+
+static void runVector(char *line) {
+
+    static unsigned char bytes[MAX_VECTOR_BYTES];
+    static unsigned char payload[MAX_VECTOR_BYTES];
+    static char output[MAX_VECTOR_BYTES + 1];
+    char *name = strtok(line, " \n");
+    char *expect = strtok(NULL, " \n");
+    long length = fromHex(strtok(NULL, " \n"), bytes);
+    CoprocessorFrameHeader header;
+    int failuresBefore = checkFailures;
+
+    // start every vector with an empty ring
+    receiveRingTail = receiveRingHead;
+    receiveDiscardRemaining = 0;
+    stubSerialReset();
+    stubSerialInstantReads = true;
+    stubSerialArrive(bytes, length);
+
+    // the read that picks up the last bytes is only accounted for on the pump after it finishes
+    while (stubSerialUnread() > 0) {
+
+        pumpSerialReceive();
+    }
+
+    pumpSerialReceive();
+
+    if (!strcmp(expect, "none")) {
+
+        CHECK(!peekFrameInReceiveRing(&header));
+    } else {
+
+        long opcode = atol(strtok(NULL, " \n"));
+        long status = atol(strtok(NULL, " \n"));
+        long flags = atol(strtok(NULL, " \n"));
+        long applicationId = atol(strtok(NULL, " \n"));
+        long callId = atol(strtok(NULL, " \n"));
+        long payloadLength = fromHex(strtok(NULL, " \n"), payload);
+
+        CHECK(peekFrameInReceiveRing(&header));
+        CHECK(header.version == COPROCESSOR_FRAME_VERSION);
+        CHECK(header.opcode == opcode);
+        CHECK(header.status == status);
+        CHECK(header.flags == flags);
+        CHECK(header.applicationId == applicationId);
+        CHECK(header.callId == callId);
+        CHECK(header.payloadLength == (unsigned long)payloadLength);
+        CHECK(consumeFrame(&header, output, sizeof(output)) == payloadLength);
+        CHECK(!memcmp(output, payload, payloadLength));
+        CHECK(!peekFrameInReceiveRing(&header));
+    }
+
+    if (checkFailures != failuresBefore) {
+
+        printf("  in vector %s\n", name);
+    }
+}
+
+int main(int argc, char **argv) {
+
+    static char line[MAX_VECTOR_BYTES * 4];
+    FILE *vectors = fopen(argc > 1 ? argv[1] : "frame_vectors.txt", "r");
+    short vectorCount = 0;
+
+    setupCoprocessor("nuklear", "modem");
+    CHECK(vectors != NULL);
+
+    while (vectors != NULL && fgets(line, sizeof(line), vectors) != NULL) {
+
+        if (line[0] == '#' || line[0] == '\n') {
+
+            continue;
+        }
+
+        runVector(line);
+        vectorCount++;
+    }
+
+    CHECK(vectorCount > 0);
+
+    return checkFailures;
+}
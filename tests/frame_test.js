@@ -0,0 +1,122 @@
+// runs frame_vectors.txt through coprocessor/frame.js. frame_test.c runs the same vectors through
+// the Mac's receive ring, so the two sides agree on every byte of the header. run with run_tests.sh
+const assert = require(`assert`)
+const fs = require(`fs`)
+const path = require(`path`)
+const frame = require(`../coprocessor/frame.js`)
+
+const fromHex = (hex) => Buffer.from(hex === `-` ? `` : hex, `hex`)
+
+const readVectors = () => {
+
+  return fs.readFileSync(path.join(__dirname, `frame_vectors.txt`), `utf8`)
+    .split(`\n`)
+    .filter((line) => line.length > 0 && !line.startsWith(`#`))
+    .map((line) => {
+
+      const [name, expect, frameHex, opcode, status, flags, applicationId, callId, payload] = line.split(` `)
+
+      return {
+        name,
+        expect,
+        bytes: fromHex(frameHex),
+        fields: expect === `frame` ? {
+          opcode: parseInt(opcode, 10),
+          status: parseInt(status, 10),
+          flags: parseInt(flags, 10),
+          applicationId: parseInt(applicationId, 10),
+          callId: parseInt(callId, 10),
+          payload: fromHex(payload)
+        } : undefined
+      }
+    })
+}
+
+const checkFrames = (vector, frames) => {
+
+  if (vector.expect === `none`) {
+
+    assert.strictEqual(frames.length, 0, `${vector.name}: expected no frames`)
+
+    return
+  }
+
+  assert.strictEqual(frames.length, 1, `${vector.name}: expected one frame`)
+
+  const [decoded] = frames
+
+  assert.strictEqual(decoded.version, frame.VERSION, `${vector.name}: version`)
+
+  for (const field of [`opcode`, `status`, `flags`, `applicationId`, `callId`]) {
+
+    assert.strictEqual(decoded[field], vector.fields[field], `${vector.name}: ${field}`)
+  }
+
+  assert.strictEqual(decoded.payloadLength, vector.fields.payload.length, `${vector.name}: payloadLength`)
+  assert.ok(decoded.payload.equals(vector.fields.payload), `${vector.name}: payload`)
+}
+
+let failures = 0
+
+for (const vector of readVectors()) {
+
+  try {
+
+    if (vector.expect === `frame`) {
+
+      const encoded = frame.encodeFrame(vector.fields)
+
+      assert.strictEqual(encoded.toString(`hex`), vector.bytes.toString(`hex`), `${vector.name}: encodeFrame`)
+    }
+
+    // all at once, then a byte at a time the way a slow serial port would hand it over
+    checkFrames(vector, new frame.FrameReader().push(vector.bytes))
+
+    const reader = new frame.FrameReader()
+    const frames = []
+
+    for (let i = 0; i < vector.bytes.length; i++) {
+
+      frames.push(...reader.push(vector.bytes.slice(i, i + 1)))
+    }
+
+    checkFrames(vector, frames)
+  } catch (error) {
+
+    console.log(error.message)
+    failures++
+  }
+}
+
+// the Mac folds the name it was set up with the same way, and drops events that do not match
+try {
+
+  assert.strictEqual(frame.applicationIdFor(`nuklear`), 59630, `applicationIdFor`)
+  assert.strictEqual(frame.decodeHeader(frame.encodeEvent(`nuklear`, `newMessages`, `1`)).applicationId, 59630, `encodeEvent by name`)
+  assert.strictEqual(frame.decodeHeader(frame.encodeEvent(59630, `newMessages`, `1`)).applicationId, 59630, `encodeEvent by id`)
+} catch (error) {
+
+  console.log(error.message)
+  failures++
+}
+
+// function arguments are length prefixed, so a message keeps whatever delimiters it holds
+try {
+
+  const vectors = readVectors()
+  const payloadOf = (name) => vectors.find((vector) => vector.name === name).fields.payload
+
+  assert.ok(frame.encodeArguments(`getChats`).equals(payloadOf(`function_call`)), `encodeArguments with none`)
+  assert.ok(frame.encodeArguments(`sendMessageSince`, [`Jane Doe`, 41, `a&&&b`]).equals(payloadOf(`function_arguments`)), `encodeArguments`)
+  assert.deepStrictEqual(frame.decodeArguments(payloadOf(`function_call`)), [`getChats`], `decodeArguments with none`)
+  assert.deepStrictEqual(frame.decodeArguments(payloadOf(`function_arguments`)), [`sendMessageSince`, `Jane Doe`, `41`, `a&&&b`], `decodeArguments`)
+  assert.deepStrictEqual(frame.decodeArguments(frame.encodeArguments(`f`, [``, `1:2`])), [`f`, ``, `1:2`], `decodeArguments round trip`)
+  assert.throws(() => frame.decodeArguments(`8:getChat`), /runs past/, `decodeArguments cut short`)
+  assert.throws(() => frame.decodeArguments(`getChats&&&`), /no length/, `decodeArguments unprefixed`)
+} catch (error) {
+
+  console.log(error.message)
+  failures++
+}
+
+process.exit(failures)
@@ -0,0 +1 @@
+#include "MacTypes.h"
@@ -0,0 +1,106 @@
+// just enough of the Toolbox for coprocessorjs.c, scheduler.c, scratch.c, wrap.c and nuklear.h to
+// build and run on the machine doing the building, so that their logic can be tested without a Mac.
+// Serial.h and Devices.h both land here. see toolbox_stub.c for the fake serial driver behind it
+#ifndef HOST_MACTYPES_H
+#define HOST_MACTYPES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef short OSErr;
+typedef unsigned char Boolean;
+typedef char *Ptr;
+typedef Ptr *Handle;
+typedef const unsigned char *ConstStr255Param;
+
+#define noErr 0
+#define readErr -19
+#define abortErr -27
+
+typedef struct Cursor {
+    short data[16];
+} Cursor, *CursPtr, **CursHandle;
+
+typedef struct Pattern {
+    unsigned char pat[8];
+} Pattern;
+
+struct QDGlobals {
+    Pattern dkGray;
+    Pattern ltGray;
+    Pattern gray;
+    Pattern black;
+    Pattern white;
+    Cursor arrow;
+};
+
+#define blackColor 33
+#define whiteColor 30
+
+extern struct QDGlobals qd;
+
+#define watchCursor 4
+
+long TickCount(void);
+CursHandle GetCursor(short cursorID);
+void SetCursor(const Cursor *cursor);
+
+// serial and device manager
+typedef struct ParamBlockRec *ParmBlkPtr;
+typedef void (*IOCompletionUPP)(ParmBlkPtr paramBlock);
+
+typedef struct IOParam {
+    void *qLink;
+    short qType;
+    short ioTrap;
+    Ptr ioCmdAddr;
+    IOCompletionUPP ioCompletion;
+    volatile OSErr ioResult; // positive while an asynchronous call is in progress
+    void *ioNamePtr;
+    short ioVRefNum;
+    short ioRefNum;
+    char ioVersNum;
+    char ioPermssn;
+    Ptr ioMisc;
+    Ptr ioBuffer;
+    long ioReqCount;
+    long ioActCount;
+    short ioPosMode;
+    long ioPosOffset;
+} IOParam;
+
+typedef struct CntrlParam {
+    void *qLink;
+    short qType;
+    short ioTrap;
+    Ptr ioCmdAddr;
+    IOCompletionUPP ioCompletion;
+    volatile OSErr ioResult;
+    void *ioNamePtr;
+    short ioVRefNum;
+    short ioCRefNum;
+    short csCode;
+    short csParam[11];
+} CntrlParam;
+
+typedef struct ParamBlockRec {
+    IOParam ioParam;
+} ParamBlockRec;
+
+#define stop10 0x4000
+#define noParity 0x2000
+#define data8 0x0C00
+#define baud28800 0x0002
+
+OSErr MacOpenDriver(ConstStr255Param name, short *refNum);
+OSErr MacCloseDriver(short refNum);
+OSErr PBControl(ParmBlkPtr paramBlock, Boolean async);
+OSErr PBRead(ParmBlkPtr paramBlock, Boolean async);
+OSErr PBWrite(ParmBlkPtr paramBlock, Boolean async);
+OSErr SerGetBuf(short refNum, long *count);
+OSErr SerSetBuf(short refNum, Ptr serBPtr, short serBLen);
+
+// only referenced when DEBUG_FUNCTION_CALLS is defined
+extern short boutRefNum;
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+// each test file keeps its own count and returns it from main, run_tests.sh reports the rest
+static int checkFailures = 0;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+        checkFailures++; \
+    } \
+} while (0)
+
+#endif
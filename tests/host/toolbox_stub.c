@@ -0,0 +1,171 @@
+#include <string.h>
+#include "toolbox_stub.h"
+
+#define STUB_SERIAL_BUFFER_SIZE (1024 * 1024)
+
+struct QDGlobals qd;
+short boutRefNum = 0;
+long stubTicks = 0;
+
+Boolean stubSerialInstantReads = false;
+long stubSerialOverlappingReads = 0;
+OSErr stubSerialWriteResult = noErr;
+StubCoprocessor stubCoprocessor = NULL;
+
+static unsigned char incoming[STUB_SERIAL_BUFFER_SIZE];
+static long incomingLength = 0;
+static long incomingRead = 0;
+static unsigned char written[STUB_SERIAL_BUFFER_SIZE];
+static long writtenLength = 0;
+static ParmBlkPtr pendingRead = NULL;
+static Cursor watch;
+static CursPtr watchPointer = &watch;
+
+void stubSerialReset(void) {
+
+    incomingLength = 0;
+    incomingRead = 0;
+    writtenLength = 0;
+    pendingRead = NULL;
+    stubSerialInstantReads = false;
+    stubSerialOverlappingReads = 0;
+    stubSerialWriteResult = noErr;
+    stubCoprocessor = NULL;
+}
+
+void stubSerialArrive(const void *bytes, long length) {
+
+    memcpy(&incoming[incomingLength], bytes, length);
+    incomingLength += length;
+}
+
+Boolean stubSerialReadPending(void) {
+
+    return pendingRead != NULL;
+}
+
+long stubSerialUnread(void) {
+
+    return incomingLength - incomingRead;
+}
+
+const unsigned char *stubSerialWritten(long *length) {
+
+    *length = writtenLength;
+
+    return written;
+}
+
+// the driver only finishes a read once it has all of the bytes that were asked for, and the Mac
+// side only ever asks for what SerGetBuf said was there
+void stubSerialInterrupt(void) {
+
+    if (pendingRead == NULL) {
+
+        return;
+    }
+
+    IOParam *read = &pendingRead->ioParam;
+    long count = read->ioReqCount < incomingLength - incomingRead ? read->ioReqCount : incomingLength - incomingRead;
+
+    memcpy(read->ioBuffer, &incoming[incomingRead], count);
+    incomingRead += count;
+    read->ioActCount = count;
+    read->ioResult = count == read->ioReqCount ? noErr : readErr;
+
+    ParmBlkPtr finished = pendingRead;
+
+    pendingRead = NULL;
+
+    if (read->ioCompletion != NULL) {
+
+        read->ioCompletion(finished);
+    }
+}
+
+OSErr PBRead(ParmBlkPtr paramBlock, Boolean async) {
+
+    // a parameter block can only be used for one call at a time
+    if (pendingRead != NULL) {
+
+        stubSerialOverlappingReads++;
+    }
+
+    paramBlock->ioParam.ioResult = 1;
+    pendingRead = paramBlock;
+
+    if (!async || stubSerialInstantReads) {
+
+        stubSerialInterrupt();
+    }
+
+    return async ? noErr : paramBlock->ioParam.ioResult;
+}
+
+OSErr PBWrite(ParmBlkPtr paramBlock, Boolean async) {
+
+    IOParam *write = &paramBlock->ioParam;
+
+    if (stubSerialWriteResult != noErr) {
+
+        write->ioActCount = 0;
+        write->ioResult = stubSerialWriteResult;
+
+        return stubSerialWriteResult;
+    }
+
+    memcpy(&written[writtenLength], write->ioBuffer, write->ioReqCount);
+    writtenLength += write->ioReqCount;
+    write->ioActCount = write->ioReqCount;
+    write->ioResult = noErr;
+
+    if (stubCoprocessor != NULL) {
+
+        stubCoprocessor(written, writtenLength);
+    }
+
+    return noErr;
+}
+
+OSErr SerGetBuf(short refNum, long *count) {
+
+    *count = incomingLength - incomingRead;
+
+    return noErr;
+}
+
+OSErr SerSetBuf(short refNum, Ptr serBPtr, short serBLen) {
+
+    return noErr;
+}
+
+OSErr PBControl(ParmBlkPtr paramBlock, Boolean async) {
+
+    return noErr;
+}
+
+OSErr MacOpenDriver(ConstStr255Param name, short *refNum) {
+
+    *refNum = -6;
+
+    return noErr;
+}
+
+OSErr MacCloseDriver(short refNum) {
+
+    return noErr;
+}
+
+long TickCount(void) {
+
+    return stubTicks++;
+}
+
+CursHandle GetCursor(short cursorID) {
+
+    return &watchPointer;
+}
+
+void SetCursor(const Cursor *cursor) {
+
+}
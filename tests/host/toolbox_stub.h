@@ -0,0 +1,30 @@
+#ifndef TOOLBOX_STUB_H
+#define TOOLBOX_STUB_H
+
+#include "MacTypes.h"
+
+// the fake serial driver. bytes the coprocessor sends are queued with stubSerialArrive, and an
+// asynchronous PBRead stays in progress (ioResult > 0) until stubSerialInterrupt finishes it, the
+// way the real driver would at interrupt time. with stubSerialInstantReads set reads finish as
+// soon as they are made, which is what tests that go through waitForCoprocessorCall want
+void stubSerialReset(void);
+void stubSerialArrive(const void *bytes, long length);
+void stubSerialInterrupt(void);
+Boolean stubSerialReadPending(void);
+long stubSerialUnread(void);
+const unsigned char *stubSerialWritten(long *length);
+
+extern Boolean stubSerialInstantReads;
+extern long stubSerialOverlappingReads; // PBReads made while one was still in progress, always a bug
+extern OSErr stubSerialWriteResult; // what PBWrite says happened, nothing is written unless noErr
+
+// called after every PBWrite with everything the Mac has written so far, so a test can play the
+// coprocessor and queue up answers
+typedef void (*StubCoprocessor)(const unsigned char *written, long length);
+
+extern StubCoprocessor stubCoprocessor;
+
+// TickCount hands this back and moves it on by one, so that timeouts come due in busy loops
+extern long stubTicks;
+
+#endif
@@ -0,0 +1,184 @@
+// plays the Mac against coprocessor/host.js: uploads a small program the way compile_js.sh bundles
+// one, calls its functions, and checks every request gets the answer coprocessorjs.c expects.
+// run with run_tests.sh
+const assert = require(`assert`)
+const fs = require(`fs`)
+const os = require(`os`)
+const path = require(`path`)
+const frame = require(`../coprocessor/frame.js`)
+const {unpackProgram, CoprocessorHost} = require(`../coprocessor/host.js`)
+
+const APPLICATION_ID = frame.applicationIdFor(`nuklear`)
+
+// the same layout compile_js.sh writes, the last file without its `&&&\n`. index.js holds `&&&`
+// and `@@@` of its own, the way the real one does
+const PROGRAM = Buffer.from([
+  `index.js@@@\n`,
+  `const greeting = require('./greeting.json').greeting\n`,
+  `let listener\n`,
+  `class Program {\n`,
+  `  echo (...args) { return args.join('|') }\n`,
+  `  delta (chat) { return \`\${chat}&&&0&&&@@@\` }\n`,
+  `  greet () { return greeting }\n`,
+  `  nothing () {}\n`,
+  `  fail () { throw new Error('failed') }\n`,
+  `  setEventListener (eventListener) { listener = eventListener }\n`,
+  `  push (name, data) { listener(name, data); return 'pushed' }\n`,
+  `}\n`,
+  `module.exports = Program\n`,
+  `&&&\n`,
+  `greeting.json@@@\n`,
+  `{"greeting": "hello"}\n`
+].join(``))
+
+let failures = 0
+let callId = 0
+
+const check = (name, test) => {
+
+  try {
+
+    test()
+  } catch (error) {
+
+    console.log(`${name}: ${error.message}`)
+    failures++
+  }
+}
+
+const request = (opcode, payload, flags = 0) => {
+
+  return frame.encodeFrame({opcode, flags, applicationId: APPLICATION_ID, callId: ++callId, payload})
+}
+
+// pushes the requests in one byte at a time, the way a slow serial port might hand them over, and
+// gives back everything the host wrote. answers can come back in any order, so they are put in call
+// id order, with events first
+const exchange = async (host, written, ...requests) => {
+
+  written.length = 0
+
+  const bytes = Buffer.concat(requests)
+  const handled = []
+
+  for (let i = 0; i < bytes.length; i++) {
+
+    handled.push(host.push(bytes.slice(i, i + 1)))
+  }
+
+  await Promise.all(handled)
+
+  return new frame.FrameReader().push(Buffer.concat(written)).sort((a, b) => a.callId - b.callId)
+}
+
+const main = async () => {
+
+  const directory = fs.mkdtempSync(path.join(os.tmpdir(), `host_test`))
+  const written = []
+  const installed = []
+  const host = new CoprocessorHost({
+    write: (bytes) => written.push(bytes),
+    programDirectory: directory,
+    install: (programDirectory) => installed.push(programDirectory),
+    log: () => {}
+  })
+
+  check(`unpackProgram`, () => {
+
+    const files = unpackProgram(PROGRAM)
+
+    assert.deepStrictEqual(files.map((file) => file.filename), [`index.js`, `greeting.json`])
+    assert.ok(files[0].contents.includes(`&&&0&&&@@@`))
+    assert.ok(files[0].contents.endsWith(`module.exports = Program\n`))
+    assert.strictEqual(files[1].contents, `{"greeting": "hello"}\n`)
+  })
+
+  // a probe before the program was ever uploaded is a miss
+  let responses = await exchange(host, written, request(frame.OPCODES.PROGRAM_HASH, frame.programHash(PROGRAM)))
+
+  check(`probe miss`, () => {
+
+    assert.strictEqual(responses.length, 1)
+    assert.strictEqual(responses[0].status, frame.STATUS.FAILURE)
+    assert.strictEqual(responses[0].callId, callId)
+  })
+
+  // uploaded compressed, as sendCompressedProgramToCoprocessor does
+  responses = await exchange(host, written, request(frame.OPCODES.PROGRAM, frame.compress(PROGRAM), frame.FLAGS.COMPRESSED))
+
+  check(`program`, () => {
+
+    assert.strictEqual(responses.length, 1)
+    assert.strictEqual(responses[0].opcode, frame.OPCODES.PROGRAM)
+    assert.strictEqual(responses[0].status, frame.STATUS.SUCCESS)
+    assert.strictEqual(installed.length, 1)
+    assert.ok(fs.existsSync(path.join(installed[0], `greeting.json`)))
+  })
+
+  responses = await exchange(host, written,
+    request(frame.OPCODES.FUNCTION, frame.encodeArguments(`echo`, [`Jane Doe`, 41, `a&&&b;;;c`])),
+    request(frame.OPCODES.FUNCTION, frame.encodeArguments(`delta`, [`Jane Doe`])),
+    request(frame.OPCODES.FUNCTION, frame.encodeArguments(`greet`)),
+    request(frame.OPCODES.FUNCTION, frame.encodeArguments(`nothing`)))
+
+  check(`functions`, () => {
+
+    assert.deepStrictEqual(responses.map((response) => response.status), [0, 0, 0, 0])
+    assert.deepStrictEqual(responses.map((response) => response.callId), [callId - 3, callId - 2, callId - 1, callId])
+    assert.deepStrictEqual(responses.map((response) => `${response.payload}`), [`Jane Doe|41|a&&&b;;;c`, `Jane Doe&&&0&&&@@@`, `hello`, ``])
+  })
+
+  // none of these leave the Mac waiting out a timeout
+  responses = await exchange(host, written,
+    request(frame.OPCODES.FUNCTION, frame.encodeArguments(`missing`)),
+    request(frame.OPCODES.FUNCTION, frame.encodeArguments(`constructor`)),
+    request(frame.OPCODES.FUNCTION, frame.encodeArguments(`fail`)),
+    request(frame.OPCODES.FUNCTION, `getChats&&&`),
+    request(99, ``))
+
+  check(`failures`, () => {
+
+    assert.deepStrictEqual(responses.map((response) => response.status), [1, 1, 1, 1, frame.STATUS.UNKNOWN_OPCODE])
+    assert.strictEqual(`${responses[2].payload}`, `failed`)
+  })
+
+  // events go out with no call id, to the application that uploaded the program
+  responses = await exchange(host, written, request(frame.OPCODES.FUNCTION, frame.encodeArguments(`push`, [`newMessages`, `Jane Doe&&&1`])))
+
+  check(`events`, () => {
+
+    assert.strictEqual(responses.length, 2)
+    assert.strictEqual(responses[0].opcode, frame.OPCODES.EVENT)
+    assert.strictEqual(responses[0].callId, 0)
+    assert.strictEqual(responses[0].applicationId, APPLICATION_ID)
+    assert.strictEqual(`${responses[0].payload}`, `newMessages&&&Jane Doe&&&1`)
+    assert.strictEqual(`${responses[1].payload}`, `pushed`)
+  })
+
+  responses = await exchange(host, written, request(frame.OPCODES.EVAL, `6 * 7`))
+
+  check(`eval`, () => {
+
+    assert.strictEqual(responses[0].status, frame.STATUS.SUCCESS)
+    assert.strictEqual(`${responses[0].payload}`, `42`)
+  })
+
+  // a new host, as if the coprocessor had restarted, runs the program out of its cache
+  const restarted = new CoprocessorHost({write: (bytes) => written.push(bytes), programDirectory: directory, install: () => {}, log: () => {}})
+
+  responses = await exchange(restarted, written,
+    request(frame.OPCODES.PROGRAM_HASH, frame.programHash(PROGRAM)),
+    request(frame.OPCODES.FUNCTION, frame.encodeArguments(`greet`)))
+
+  check(`probe hit`, () => {
+
+    assert.deepStrictEqual(responses.map((response) => response.status), [0, 0])
+    assert.strictEqual(`${responses[1].payload}`, `hello`)
+  })
+
+  fs.rmSync(directory, {recursive: true, force: true})
+
+  process.exit(failures)
+}
+
+main()
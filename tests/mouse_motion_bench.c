@@ -0,0 +1,220 @@
+// moves the mouse along a few paths over windows laid out the way nuklear_app.c lays them out, and
+// counts the frames drawn for each second of movement. before is the event loop as it was, a pass
+// through nuklear and a render for every tick the mouse had moved. after is the event loop now, a
+// pass only when the mouse crosses the edge of something in the hover map in hover_map.h, or the
+// button is down, held to FRAME_TICKS apart. run with run_tests.sh
+#define NK_ZERO_COMMAND_MEMORY
+#define NK_INCLUDE_FIXED_TYPES
+#define NK_INCLUDE_STANDARD_IO
+#define NK_INCLUDE_DEFAULT_ALLOCATOR
+#define NK_IMPLEMENTATION
+#define NK_MEMSET memset
+#define NK_MEMCPY memcpy
+#include <stdlib.h>
+#include <string.h>
+#include "check.h"
+#include "toolbox_stub.h"
+#include "../nuklear.h"
+
+// the same as nuklear_app.c and mac_main.c
+#define CHATS_WINDOW 0
+#define MESSAGE_INPUT_WINDOW 1
+#define MESSAGES_WINDOW 2
+#define DIALOG_WINDOW 3
+#define APP_WINDOWS 4
+#define WINDOW_WIDTH 502
+#define WINDOW_HEIGHT 294
+#define FRAME_TICKS 2
+
+#include "../hover_map.h"
+
+#define MAX_MEMORY_IN_KB 16
+#define MAX_POOL_MEMORY_IN_KB 16
+
+// a mouse path, in window coordinates, moved along at an even speed
+typedef struct Path {
+    const char *name;
+    short fromX;
+    short fromY;
+    short toX;
+    short toY;
+    short ticks;
+    Boolean buttonDown;
+} Path;
+
+static struct nk_context ctx;
+static struct nk_user_font font;
+static char inputBuffer[64];
+static short inputLength = 0;
+
+static short textWidth(nk_handle handle, short height, const char *text, short len) {
+
+    return len * 6;
+}
+
+// the chat list, message input and messages windows, filling in the hover map as nuklearApp does
+static void layOutWindows() {
+
+    static const char *chats[] = {"Jane Doe", "John Doe", "Mum", "Book club", "Alex", "Sam", "Work", "Chris"};
+
+    if (nk_begin(&ctx, "Chats", nk_rect(0, 0, 180, WINDOW_HEIGHT), NK_WINDOW_BORDER|NK_WINDOW_NO_SCROLLBAR)) {
+
+        clearHoverRects(CHATS_WINDOW);
+        nk_layout_row_begin(&ctx, NK_STATIC, 25, 1);
+
+        for (short i = 0; i < (short)(sizeof(chats) / sizeof(chats[0])); i++) {
+
+            nk_layout_row_push(&ctx, 169);
+            addHoverRect(CHATS_WINDOW, nk_widget_bounds(&ctx));
+            nk_button_label(&ctx, chats[i]);
+        }
+
+        nk_layout_row_end(&ctx);
+        nk_end(&ctx);
+    }
+
+    if (nk_begin(&ctx, "Message Input", nk_rect(180, WINDOW_HEIGHT - 36, 330, 36), NK_WINDOW_BORDER|NK_WINDOW_NO_SCROLLBAR)) {
+
+        nk_layout_row_begin(&ctx, NK_STATIC, 28, 1);
+        nk_layout_row_push(&ctx, 312);
+        clearHoverRects(MESSAGE_INPUT_WINDOW);
+        addHoverRect(MESSAGE_INPUT_WINDOW, nk_widget_bounds(&ctx));
+        nk_edit_string(&ctx, NK_EDIT_FIELD, inputBuffer, &inputLength, sizeof(inputBuffer), nk_filter_default);
+        nk_layout_row_end(&ctx);
+        nk_end(&ctx);
+    }
+
+    if (nk_begin_titled(&ctx, "Message", "Jane Doe", nk_rect(180, 0, 330, WINDOW_HEIGHT - 36), NK_WINDOW_BORDER|NK_WINDOW_TITLE|NK_WINDOW_NO_SCROLLBAR)) {
+
+        struct nk_rect content = nk_window_get_content_region(&ctx);
+
+        nk_layout_row_dynamic(&ctx, content.h - ctx.style.window.spacing.y, 1);
+
+        struct nk_rect listBounds = nk_widget_bounds(&ctx);
+        float scrollbarWidth = ctx.style.window.scrollbar_size.x + ctx.style.window.group_padding.x;
+
+        clearHoverRects(MESSAGES_WINDOW);
+        addHoverRect(MESSAGES_WINDOW, nk_rect(listBounds.x + listBounds.w - scrollbarWidth, listBounds.y, scrollbarWidth, listBounds.h));
+        nk_spacing(&ctx, 1);
+        nk_end(&ctx);
+    }
+
+    nk_clear(&ctx);
+}
+
+static void positionAt(const Path *path, short tick, short *x, short *y) {
+
+    *x = path->fromX + (path->toX - path->fromX) * tick / path->ticks;
+    *y = path->fromY + (path->toY - path->fromY) * tick / path->ticks;
+}
+
+// the loop goes round at least once a tick while the mouse is moving, and only where the mouse has
+// got to by then is seen
+static void movePath(const Path *path, double *beforeFps, double *afterFps) {
+
+    short lastX;
+    short lastY;
+    long beforeFrames = 0;
+    long afterFrames = 0;
+    long lastFrameTick = -FRAME_TICKS;
+    Boolean passWaiting = false;
+
+    positionAt(path, 0, &lastX, &lastY);
+
+    for (short tick = 1; tick <= path->ticks; tick++) {
+
+        short x;
+        short y;
+
+        positionAt(path, tick, &x, &y);
+
+        if (x != lastX || y != lastY) {
+
+            beforeFrames++;
+
+            if (path->buttonDown || hoverRectAt(lastX, lastY) != hoverRectAt(x, y)) {
+
+                passWaiting = true;
+            }
+        }
+
+        // the frame pacer, motion that comes in while it holds a frame back goes in the same one
+        if (passWaiting && tick - lastFrameTick >= FRAME_TICKS) {
+
+            afterFrames++;
+            lastFrameTick = tick;
+            passWaiting = false;
+        }
+
+        lastX = x;
+        lastY = y;
+    }
+
+    *beforeFps = (double)beforeFrames * 60 / path->ticks;
+    *afterFps = (double)afterFrames * 60 / path->ticks;
+
+    printf("  %-38s before: %4.1f fps, after: %4.1f fps\n", path->name, *beforeFps, *afterFps);
+}
+
+int main() {
+
+    static char commands[MAX_MEMORY_IN_KB * 1024];
+    static char pool[MAX_POOL_MEMORY_IN_KB * 1024];
+    struct nk_buffer commandBuffer;
+    struct nk_buffer poolBuffer;
+    double before;
+    double after;
+
+    // two seconds each, about the pace of a hand moving the mouse across the screen
+    Path downTheChats = {"down the chat list", 90, 2, 90, WINDOW_HEIGHT - 2, 120, false};
+    Path acrossTheText = {"across the messages", 190, 120, 460, 140, 120, false};
+    Path acrossTheWindow = {"corner to corner", 2, 2, WINDOW_WIDTH - 2, WINDOW_HEIGHT - 2, 120, false};
+    Path dragging = {"dragging across the messages", 190, 120, 460, 140, 120, true};
+
+    font.height = 12;
+    font.width = textWidth;
+
+    nk_buffer_init_fixed(&commandBuffer, commands, sizeof(commands));
+    nk_buffer_init_fixed(&poolBuffer, pool, sizeof(pool));
+    nk_init_custom(&ctx, &commandBuffer, &poolBuffer, &font);
+
+    layOutWindows();
+
+    // every chat, the message input and the messages scrollbar
+    CHECK(hoverRectCounts[CHATS_WINDOW] == 8);
+    CHECK(hoverRectCounts[MESSAGE_INPUT_WINDOW] == 1);
+    CHECK(hoverRectCounts[MESSAGES_WINDOW] == 1);
+    CHECK(hoverRectAt(90, 20) == CHATS_WINDOW * MAX_HOVER_RECTS);
+    CHECK(hoverRectAt(300, 120) == -1);
+    CHECK(hoverRectAt(300, WINDOW_HEIGHT - 18) == MESSAGE_INPUT_WINDOW * MAX_HOVER_RECTS);
+
+    printf("frames drawn for each second of continuous mouse movement:\n");
+
+    // each chat button it passes lights up and goes out again
+    movePath(&downTheChats, &before, &after);
+    CHECK(after > 0 && after < before / 4);
+
+    // nothing over the transcript reacts to the mouse but the scrollbar, so nothing is drawn at all
+    movePath(&acrossTheText, &before, &after);
+    CHECK(before == 60);
+    CHECK(after == 0);
+
+    movePath(&acrossTheWindow, &before, &after);
+    CHECK(after < before / 4);
+
+    // with the button down everything is passed on, but no faster than the frame pacer allows
+    movePath(&dragging, &before, &after);
+    CHECK(after == 60 / FRAME_TICKS);
+
+    // a window nuklearApp has nothing to draw in is begun with NK_WINDOW_SKIP_RENDER, which gives it
+    // no commands but keeps nk_clear from freeing it
+    struct nk_window *messages = nk_window_find(&ctx, "Message");
+
+    CHECK(!nk_begin_titled(&ctx, "Message", "Jane Doe", nk_rect(180, 0, 330, WINDOW_HEIGHT - 36), NK_WINDOW_BORDER|NK_WINDOW_TITLE|NK_WINDOW_NO_SCROLLBAR|NK_WINDOW_SKIP_RENDER));
+    CHECK(nk__begin(&ctx) == NULL);
+    nk_clear(&ctx);
+    CHECK(messages != NULL && nk_window_find(&ctx, "Message") == messages);
+    CHECK(!(messages->flags & NK_WINDOW_SKIP_RENDER));
+
+    return checkFailures;
+}
@@ -0,0 +1,79 @@
+#!/bin/bash
+# builds the parts of the Mac app that do not draw anything for the machine you are on, against the
+# Toolbox stand-ins in tests/host, and runs their tests along with the JS ones. the app itself still
+# has to be built with Retro68, see CMakeLists.txt
+# requires cc
+# requires node
+
+cd "$(dirname "$0")"
+
+BUILD=$(mktemp -d)
+trap 'rm -rf "$BUILD"' EXIT
+
+CFLAGS="-std=gnu99 -O2 -Ihost -I.. -Wno-multichar"
+failures=0
+
+run() {
+	echo "== $1"
+
+	if ! "${@:2}"; then
+		echo "== $1 FAILED"
+		failures=$((failures + 1))
+	fi
+}
+
+# test name, then the sources it needs besides itself and the Toolbox stubs. anything after -- is
+# passed to the test
+build_and_run() {
+	local name=$1
+	local sources=()
+	shift
+
+	while [ $# -gt 0 ] && [ "$1" != "--" ]; do
+		sources+=("$1")
+		shift
+	done
+
+	[ "$1" == "--" ] && shift
+
+	# the app's sources use Pascal string literals ("\p..."), which only matter on the Mac
+	if ! cc $CFLAGS -o "$BUILD/$name" "$name.c" host/toolbox_stub.c "${sources[@]}" 2> "$BUILD/$name.log"; then
+		cat "$BUILD/$name.log"
+		echo "== $name did not build"
+		failures=$((failures + 1))
+
+		return
+	fi
+
+	run "$name" "$BUILD/$name" "$@"
+}
+
+build_and_run coprocessor_test ../coprocessorjs.c
+build_and_run frame_test ../coprocessorjs.c
+build_and_run coprocessor_bench ../coprocessorjs.c
+build_and_run tokenizer_bench ../coprocessorjs.c
+build_and_run command_cache_bench
+build_and_run mouse_motion_bench
+build_and_run scratch_test ../scratch.c ../coprocessorjs.c
+build_and_run scheduler_test ../scheduler.c
+build_and_run frame_pacer_test ../frame_pacer.c
+
+# payloads compressed by coprocessor/frame.js, decoded by the Mac
+mkdir "$BUILD/compressed"
+run compress_vectors.js node compress_vectors.js "$BUILD/compressed"
+build_and_run compress_test ../coprocessorjs.c -- "$BUILD/compressed"
+
+# messages wrapped by the old shortenText from index.js, wrapped again by the Mac
+mkdir "$BUILD/wrapped"
+run wrap_vectors.js node wrap_vectors.js "$BUILD/wrapped"
+build_and_run wrap_test ../wrap.c -- "$BUILD/wrapped"
+
+run frame_test.js node frame_test.js
+run host_test.js node host_test.js
+
+if [ $failures -gt 0 ]; then
+	echo "$failures failed"
+	exit 1
+fi
+
+echo "all passed"
@@ -0,0 +1,341 @@
+// scheduler.c against a simulated tick clock, with tasks set up the way mac_main.c and nuklear_app.c
+// set up theirs. run with run_tests.sh
+#include <stdlib.h>
+#include <string.h>
+#include "check.h"
+#include "toolbox_stub.h"
+#include "../scheduler.h"
+
+// the same as mac_main.c and nuklear_app.c
+#define MAX_EVENT_SLEEP_TICKS 30
+#define PUSHED_EVENT_SLEEP_TICKS 6
+#define CURSOR_HIDDEN_TICKS 20
+#define SYNC_INTERVAL_TICKS 300
+#define SYNC_JITTER_TICKS 60
+#define MESSAGE_PAGE_JITTER_TICKS 6
+
+#define HOUR_TICKS (60L * 60 * 60)
+
+static Boolean syncWithCoprocessor() {
+
+    return true;
+}
+
+static Boolean requestOlderMessages() {
+
+    return true;
+}
+
+static Boolean showCursorAfterTyping() {
+
+    return false;
+}
+
+static void resetScheduler() {
+
+    memset(scheduledTasks, 0, sizeof(scheduledTasks));
+    scheduledTaskCount = 0;
+}
+
+// what ran, in order, as a string of task letters
+static char ran[64];
+
+static void recordRun(char letter) {
+
+    long length = strlen(ran);
+
+    if (length < (long)sizeof(ran) - 1) {
+
+        ran[length] = letter;
+        ran[length + 1] = '\0';
+    }
+}
+
+static Boolean sendA() {
+
+    recordRun('a');
+
+    return true;
+}
+
+static Boolean sendB() {
+
+    recordRun('b');
+
+    return true;
+}
+
+static Boolean sendC() {
+
+    recordRun('c');
+
+    return true;
+}
+
+static Boolean nothingToSendD() {
+
+    recordRun('d');
+
+    return false;
+}
+
+static Boolean localE() {
+
+    recordRun('e');
+
+    return false;
+}
+
+static Boolean localF() {
+
+    recordRun('f');
+
+    return false;
+}
+
+static void runTurn(long now) {
+
+    ran[0] = '\0';
+    runDueTasks(now);
+}
+
+static void testOneSerialTaskPerTurn() {
+
+    resetScheduler();
+
+    // b has the least jitter left when they are all due, then c, then a
+    addScheduledTask("a", sendA, 100, 30, true, 10);
+    addScheduledTask("e", localE, 100, 30, false, 10);
+    addScheduledTask("b", sendB, 100, 5, true, 10);
+    addScheduledTask("c", sendC, 100, 20, true, 8);
+    addScheduledTask("f", localF, 100, 30, false, 10);
+
+    // every task that does not need serial runs, in the order they were added, then one serial task
+    runTurn(10);
+    CHECK(!strcmp(ran, "efb"));
+
+    runTurn(11);
+    CHECK(!strcmp(ran, "c"));
+
+    runTurn(12);
+    CHECK(!strcmp(ran, "a"));
+
+    runTurn(13);
+    CHECK(!strcmp(ran, ""));
+
+    // each is next due a period after it actually ran, not after it was due
+    CHECK(scheduledTasks[0].due == 112);
+    CHECK(scheduledTasks[2].due == 110);
+    CHECK(scheduledTasks[3].due == 111);
+}
+
+// a serial task with nothing to send does not use up the turn
+static void testSerialTaskWithNothingToSendGivesWay() {
+
+    resetScheduler();
+
+    addScheduledTask("d", nothingToSendD, 100, 0, true, 10);
+    addScheduledTask("a", sendA, 100, 30, true, 10);
+    addScheduledTask("b", sendB, 100, 30, true, 10);
+
+    runTurn(10);
+    CHECK(!strcmp(ran, "da"));
+    CHECK(scheduledTasks[0].runs == 1);
+    CHECK(scheduledTasks[0].due == 110);
+
+    runTurn(11);
+    CHECK(!strcmp(ran, "b"));
+}
+
+// a one-shot task runs once when scheduled, and can be brought forward or pushed back
+static void testOneShotTasks() {
+
+    resetScheduler();
+
+    short page = addScheduledTask("a", sendA, 0, 6, true, 0);
+
+    runTurn(100);
+    CHECK(!strcmp(ran, ""));
+
+    scheduleTask(page, 105);
+    runTurn(104);
+    CHECK(!strcmp(ran, ""));
+    runTurn(105);
+    CHECK(!strcmp(ran, "a"));
+    runTurn(106);
+    CHECK(!strcmp(ran, ""));
+    CHECK(scheduledTasks[page].runs == 1);
+
+    // handles that were never given out are ignored
+    scheduleTask(-1, 0);
+    scheduleTask(MAX_SCHEDULED_TASKS, 0);
+    setScheduledTaskPeriod(7, 10);
+}
+
+// tasks that collide wait a turn for each other, which shows up as lateness, and as an overrun
+// once a task is kept waiting past its jitter
+static void testContentionIsCountedAsLateness() {
+
+    resetScheduler();
+
+    // three on the same period all come due at 0. the one with no jitter to spare goes first and
+    // the others follow on the next two ticks. as each counts its period from when it ran, they
+    // stay a tick apart from then on and never collide again
+    short tight = addScheduledTask("a", sendA, 300, 0, true, 0);
+    short loose = addScheduledTask("b", sendB, 300, 60, true, 0);
+    short relaxed = addScheduledTask("c", sendC, 300, 60, true, 0);
+
+    for (long now = 0; now < HOUR_TICKS; now++) {
+
+        runDueTasks(now);
+    }
+
+    printf("  an hour of three serial tasks on one period, worst lateness: %ld, %ld and %ld ticks\n",
+           scheduledTasks[tight].worstLateness, scheduledTasks[loose].worstLateness, scheduledTasks[relaxed].worstLateness);
+
+    CHECK(scheduledTasks[tight].worstLateness == 0);
+    CHECK(scheduledTasks[loose].worstLateness == 1);
+    CHECK(scheduledTasks[relaxed].worstLateness == 2);
+    CHECK(scheduledTasks[tight].overruns + scheduledTasks[loose].overruns + scheduledTasks[relaxed].overruns == 0);
+    CHECK(scheduledTasks[tight].runs == HOUR_TICKS / 300);
+    CHECK(scheduledTasks[loose].runs == HOUR_TICKS / 300);
+    CHECK(scheduledTasks[relaxed].runs == HOUR_TICKS / 300);
+
+    // the messages list asking for a page on the very tick the sync is due, every time. the page
+    // has the user waiting on it, so has less jitter and goes first, and the sync is a tick late
+    for (short pass = 0; pass < 2; pass++) {
+
+        resetScheduler();
+
+        short syncTask = addScheduledTask("sync", sendA, SYNC_INTERVAL_TICKS, pass == 0 ? SYNC_JITTER_TICKS : 0, true, 0);
+        short pageTask = addScheduledTask("messagePage", sendB, 0, pass == 0 ? MESSAGE_PAGE_JITTER_TICKS : 0, true, 0);
+
+        for (long now = 0; now < HOUR_TICKS; now++) {
+
+            if (scheduledTasks[syncTask].due == now) {
+
+                scheduleTask(pageTask, now);
+            }
+
+            runDueTasks(now);
+        }
+
+        CHECK(scheduledTasks[syncTask].runs >= HOUR_TICKS / (SYNC_INTERVAL_TICKS + 1));
+        CHECK(scheduledTasks[pageTask].runs == scheduledTasks[syncTask].runs);
+
+        if (pass == 0) {
+
+            CHECK(scheduledTasks[pageTask].worstLateness == 0);
+            CHECK(scheduledTasks[syncTask].worstLateness == 1);
+            CHECK(scheduledTasks[syncTask].overruns == 0);
+        } else {
+
+            // with no jitter on either, the one added first goes first and the other overruns
+            // every time it is kept waiting
+            CHECK(scheduledTasks[syncTask].worstLateness == 0);
+            CHECK(scheduledTasks[pageTask].worstLateness == 1);
+            CHECK(scheduledTasks[pageTask].overruns == scheduledTasks[pageTask].runs);
+        }
+    }
+}
+
+static void testTableFull() {
+
+    resetScheduler();
+
+    for (short i = 0; i < MAX_SCHEDULED_TASKS; i++) {
+
+        CHECK(addScheduledTask("e", localE, 100, 0, false, 0) == i);
+    }
+
+    CHECK(addScheduledTask("f", localF, 100, 0, false, 0) == -1);
+    CHECK(scheduledTaskCount == MAX_SCHEDULED_TASKS);
+}
+
+// with nothing pending the loop sleeps as long as it is allowed to, and never past a deadline
+static void testSleepIsTheTimeToTheNextTask() {
+
+    resetScheduler();
+
+    CHECK(ticksUntilNextTask(1000, MAX_EVENT_SLEEP_TICKS) == MAX_EVENT_SLEEP_TICKS);
+
+    short syncTask = addScheduledTask("sync", syncWithCoprocessor, SYNC_INTERVAL_TICKS, SYNC_JITTER_TICKS, true, 1010);
+    short cursorTask = addScheduledTask("cursor", showCursorAfterTyping, 0, 0, false, 0);
+
+    // a one-shot task that has not been scheduled does not wake anyone
+    CHECK(ticksUntilNextTask(1000, MAX_EVENT_SLEEP_TICKS) == 10);
+    CHECK(ticksUntilNextTask(1000, 4) == 4);
+
+    scheduleTask(cursorTask, 1000 + 3);
+    CHECK(ticksUntilNextTask(1000, MAX_EVENT_SLEEP_TICKS) == 3);
+
+    // anything overdue means no sleep at all
+    CHECK(ticksUntilNextTask(1020, MAX_EVENT_SLEEP_TICKS) == 0);
+
+    runDueTasks(1020);
+    CHECK(ticksUntilNextTask(1020, MAX_EVENT_SLEEP_TICKS) == MAX_EVENT_SLEEP_TICKS);
+    CHECK(ticksUntilNextTask(1020 + SYNC_INTERVAL_TICKS - 5, MAX_EVENT_SLEEP_TICKS) == 5);
+
+    // the longer interval once the coprocessor pushes events counts from the last run
+    setScheduledTaskPeriod(syncTask, 3600);
+    CHECK(ticksUntilNextTask(1020, 5000) == 3600);
+}
+
+// an idle hour: the loop sleeps for as long as ticksUntilNextTask says, up to maxSleep, then runs
+// whatever is due. every deadline should be met on its tick, with the loop waking up no more than
+// it has to. maxSleep is also how late a pushed event can be noticed
+static void testIdleHour(long maxSleep) {
+
+    resetScheduler();
+
+    short syncTask = addScheduledTask("sync", syncWithCoprocessor, SYNC_INTERVAL_TICKS, SYNC_JITTER_TICKS, true, 0);
+    short pageTask = addScheduledTask("messagePage", requestOlderMessages, 0, MESSAGE_PAGE_JITTER_TICKS, true, 0);
+    short cursorTask = addScheduledTask("cursor", showCursorAfterTyping, 0, 0, false, 0);
+    long nextKeyPress = 0;
+    unsigned long wakeups = 0;
+    long now = 0;
+
+    while (now < HOUR_TICKS) {
+
+        runDueTasks(now);
+
+        // a key press every ten minutes hides the cursor for a while
+        if (now >= nextKeyPress) {
+
+            scheduleTask(cursorTask, now + CURSOR_HIDDEN_TICKS);
+            nextKeyPress += 36000;
+        }
+
+        long sleep = ticksUntilNextTask(now, maxSleep);
+
+        CHECK(sleep > 0 && sleep <= maxSleep);
+
+        now += sleep > 0 ? sleep : 1;
+        wakeups++;
+    }
+
+    CHECK(scheduledTasks[syncTask].runs == HOUR_TICKS / SYNC_INTERVAL_TICKS);
+    CHECK(scheduledTasks[syncTask].worstLateness == 0);
+    CHECK(scheduledTasks[cursorTask].runs == 6);
+    CHECK(scheduledTasks[cursorTask].worstLateness == 0);
+    CHECK(scheduledTasks[pageTask].runs == 0);
+    CHECK(wakeups <= HOUR_TICKS / maxSleep + scheduledTasks[syncTask].runs + scheduledTasks[cursorTask].runs * 2);
+
+    printf("  an idle hour, sleeping up to %ld ticks: %lu wakeups, %.1f a second\n", maxSleep, wakeups, (double)wakeups / (HOUR_TICKS / 60));
+}
+
+int main() {
+
+    testOneSerialTaskPerTurn();
+    testSerialTaskWithNothingToSendGivesWay();
+    testOneShotTasks();
+    testContentionIsCountedAsLateness();
+    testTableFull();
+    testSleepIsTheTimeToTheNextTask();
+    testIdleHour(MAX_EVENT_SLEEP_TICKS);
+
+    // once the coprocessor pushes events
+    testIdleHour(PUSHED_EVENT_SLEEP_TICKS);
+
+    return checkFailures;
+}
@@ -0,0 +1,205 @@
+// scratch.c, and a hundred thousand chat count updates run through it the way nuklear_app.c runs
+// them, to show that nothing is left behind on the heap or in the arena. getChatCounts itself
+// draws in to nuklear's windows and can not be built here, so updateCounts below does what it
+// does with the same tokenizer. run with run_tests.sh
+#include <stdlib.h>
+#include <string.h>
+#ifdef __GLIBC__
+    #include <malloc.h>
+#endif
+#include "check.h"
+#include "toolbox_stub.h"
+#include "../coprocessorjs.h"
+#include "../scratch.h"
+
+// the same as nuklear_app.c
+#define MAX_RECEIVE_SIZE 32767
+#define SEND_MESSAGE_ARGUMENTS_SIZE (2048 + 64 + 32)
+#define CALL_SCRATCH_SIZE (MAX_RECEIVE_SIZE + SEND_MESSAGE_ARGUMENTS_SIZE + 64)
+#define MAX_CHATS 10
+#define MAX_FRIENDLY_NAME_LENGTH 64
+
+#define COUNT_UPDATES 100000
+
+static ScratchArena callScratch;
+static char chatFriendlyNames[MAX_CHATS * MAX_FRIENDLY_NAME_LENGTH];
+
+static long heapInUse() {
+
+    #ifdef __GLIBC__
+        return mallinfo2().uordblks;
+    #else
+        return 0;
+    #endif
+}
+
+static void testMarkAndRelease() {
+
+    ScratchArena arena;
+
+    CHECK(initScratchArena(&arena, 64));
+
+    long outer = scratchMark(&arena);
+    char *first = scratchAlloc(&arena, 10);
+    long inner = scratchMark(&arena);
+    char *second = scratchAlloc(&arena, 10);
+
+    // rounded up to keep everything aligned
+    CHECK(second - first == 12);
+    CHECK(arena.used == 24);
+
+    // too big for what is left, and nothing is taken
+    CHECK(scratchAlloc(&arena, 41) == NULL);
+    CHECK(arena.used == 24);
+
+    scratchRelease(&arena, inner);
+    CHECK(arena.used == 12);
+    CHECK(scratchAlloc(&arena, 10) == second);
+
+    scratchRelease(&arena, outer);
+    CHECK(arena.used == 0);
+    CHECK(arena.highWater == 24);
+
+    // releasing to a mark past what is in use does nothing
+    scratchRelease(&arena, 100);
+    CHECK(arena.used == 0);
+
+    scratchAlloc(&arena, 8);
+    resetScratchArena(&arena);
+    CHECK(arena.used == 0);
+
+    free(arena.base);
+}
+
+// the count update from getChatCounts: the response and the call's arguments come out of
+// callScratch, and the NAME:::COUNT pairs are read in place
+static void updateCounts(const char *counts) {
+
+    long mark = scratchMark(&callScratch);
+    char *output = scratchAlloc(&callScratch, 2048);
+    char *response = scratchAlloc(&callScratch, MAX_RECEIVE_SIZE);
+
+    CHECK(output != NULL && response != NULL);
+
+    if (response == NULL) {
+
+        scratchRelease(&callScratch, mark);
+
+        return;
+    }
+
+    strcpy(response, counts);
+
+    CoprocessorTokenizer chats;
+    CoprocessorView chat;
+
+    beginTokenizer(&chats, response, strlen(response), ",");
+
+    while (nextToken(&chats, &chat)) {
+
+        CoprocessorTokenizer fields;
+        CoprocessorView name;
+        CoprocessorView countField;
+        CoprocessorView extraField;
+
+        beginTokenizer(&fields, chat.data, chat.length, ":::");
+
+        if (!nextToken(&fields, &name) || !nextToken(&fields, &countField) || nextToken(&fields, &extraField)) {
+
+            continue;
+        }
+
+        short count = viewToLong(&countField);
+
+        for (int i = 0; i < MAX_CHATS; i++) {
+
+            char *displayedName = &chatFriendlyNames[i * MAX_FRIENDLY_NAME_LENGTH];
+            char *countEnd = strstr(displayedName, " new) ");
+
+            if (countEnd != NULL) {
+
+                displayedName = countEnd + 6;
+            }
+
+            if (!viewStartsWith(&name, displayedName)) {
+
+                continue;
+            }
+
+            if (count == 0) {
+
+                sprintf(&chatFriendlyNames[i * MAX_FRIENDLY_NAME_LENGTH], "%.*s", (int)name.length, name.data);
+            } else {
+
+                sprintf(&chatFriendlyNames[i * MAX_FRIENDLY_NAME_LENGTH], "(%d new) %.*s", count, (int)name.length, name.data);
+            }
+
+            break;
+        }
+    }
+
+    scratchRelease(&callScratch, mark);
+}
+
+static void testCountUpdatesLeaveNothingBehind() {
+
+    char counts[1024];
+
+    CHECK(initScratchArena(&callScratch, CALL_SCRATCH_SIZE));
+
+    for (int i = 0; i < MAX_CHATS; i++) {
+
+        sprintf(&chatFriendlyNames[i * MAX_FRIENDLY_NAME_LENGTH], "friend %d", i);
+    }
+
+    long heapBefore = 0;
+    long highWaterBefore = 0;
+
+    for (long update = 0; update < COUNT_UPDATES; update++) {
+
+        // every update is a change, the way getChatCounts sees them, and a malformed pair now and
+        // then takes the bail out path
+        counts[0] = '\0';
+
+        for (int i = 0; i < MAX_CHATS; i++) {
+
+            sprintf(&counts[strlen(counts)], "%sfriend %d:::%ld", i > 0 ? "," : "", i, (update + i) % 4);
+        }
+
+        if (update % 10 == 0) {
+
+            strcat(counts, ",nobody::1");
+        }
+
+        updateCounts(counts);
+
+        // what mac_main.c does at the top of every event loop
+        resetScratchArena(&callScratch);
+
+        if (update == 0) {
+
+            heapBefore = heapInUse();
+            highWaterBefore = callScratch.highWater;
+        }
+
+        CHECK(callScratch.used == 0);
+    }
+
+    CHECK(!strcmp(&chatFriendlyNames[1 * MAX_FRIENDLY_NAME_LENGTH], "friend 1"));
+    CHECK(!strcmp(&chatFriendlyNames[2 * MAX_FRIENDLY_NAME_LENGTH], "(1 new) friend 2"));
+    CHECK(callScratch.highWater == highWaterBefore);
+    CHECK(heapInUse() == heapBefore);
+
+    printf("  %d count updates, heap in use grew by %ld bytes, scratch high water %ld of %ld\n", COUNT_UPDATES,
+           heapInUse() - heapBefore, callScratch.highWater, callScratch.size);
+
+    free(callScratch.base);
+}
+
+int main() {
+
+    testMarkAndRelease();
+    testCountUpdatesLeaveNothingBehind();
+
+    return checkFailures;
+}
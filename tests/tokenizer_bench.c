@@ -0,0 +1,167 @@
+// times nextToken in coprocessorjs.c against the strtokm it replaced, splitting the kinds of
+// responses the app splits, and checks the two agree on every token. run with run_tests.sh
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "check.h"
+#include "toolbox_stub.h"
+#include "../coprocessorjs.h"
+
+#define MAX_RESPONSE_SIZE 32768
+#define BENCHMARK_CLOCKS (CLOCKS_PER_SEC / 10) // split each response over and over for this long
+
+// strtokm as it was in coprocessorjs.c, a strtok for multi-character delimiters. it writes a NUL
+// over every delimiter it finds and keeps where it got to in statics, so only one string can be
+// split at a time
+static char *strtokm(char *str, const char *delim) {
+
+    static char *tok;
+    static char *next;
+    char *m;
+
+    if (delim == NULL) return NULL;
+
+    tok = (str) ? str : next;
+    if (tok == NULL) return NULL;
+
+    m = strstr(tok, delim);
+
+    if (m) {
+        next = m + strlen(delim);
+        *m = '\0';
+    } else {
+        next = NULL;
+    }
+
+    return tok;
+}
+
+static char response[MAX_RESPONSE_SIZE];
+static char scratch[MAX_RESPONSE_SIZE];
+
+// the test transcript from index.js, over and over, the way getMessages sends it
+static long buildTranscript(short count) {
+
+    static const char *messages[] = {
+        "friend 1: my super fun text message",
+        "me: some cool old thing I said earlier",
+        "friend 2: this message is not relevant to the conversation! not at all :(",
+        "friend 1: i watch star wars in reverse order",
+        "me: https://github.com/CamHenlin/MessagesForMacintosh",
+        "friend 3: old computers are fun"
+    };
+    long length = 0;
+
+    for (short i = 0; i < count; i++) {
+
+        length += sprintf(&response[length], "%s%s", i > 0 ? "ENDLASTMESSAGE" : "", messages[i % 6]);
+    }
+
+    return length;
+}
+
+static long buildChats(short count) {
+
+    long length = 0;
+
+    for (short i = 0; i < count; i++) {
+
+        length += sprintf(&response[length], "%sfriend %d", i > 0 ? "," : "", i);
+    }
+
+    return length;
+}
+
+// a delta with short fields, which is mostly delimiters
+static long buildFields(short count) {
+
+    long length = 0;
+
+    for (short i = 0; i < count; i++) {
+
+        length += sprintf(&response[length], "%s%d", i > 0 ? "&&&" : "", i);
+    }
+
+    return length;
+}
+
+// the response is copied before every pass, because strtokm writes over it. the time the copy
+// takes is measured on its own and taken back off
+static double nanosecondsPerPass(long length, const char *delimiter, Boolean useStrtokm, long *tokens, long *tokenBytes) {
+
+    clock_t start = clock();
+    long passes = 0;
+
+    *tokens = 0;
+    *tokenBytes = 0;
+
+    while (clock() - start < BENCHMARK_CLOCKS) {
+
+        memcpy(scratch, response, length + 1);
+
+        if (useStrtokm) {
+
+            for (char *token = strtokm(scratch, delimiter); token != NULL; token = strtokm(NULL, delimiter)) {
+
+                (*tokens)++;
+                *tokenBytes += strlen(token);
+            }
+        } else {
+
+            CoprocessorTokenizer tokenizer;
+            CoprocessorView token;
+
+            beginTokenizer(&tokenizer, scratch, length, delimiter);
+
+            while (nextToken(&tokenizer, &token)) {
+
+                (*tokens)++;
+                *tokenBytes += token.length;
+            }
+        }
+
+        passes++;
+    }
+
+    double nanoseconds = (double)(clock() - start) * 1000000000 / CLOCKS_PER_SEC / passes;
+
+    *tokens /= passes;
+    *tokenBytes /= passes;
+
+    start = clock();
+
+    for (long i = 0; i < passes; i++) {
+
+        memcpy(scratch, response, length + 1);
+    }
+
+    return nanoseconds - (double)(clock() - start) * 1000000000 / CLOCKS_PER_SEC / passes;
+}
+
+static void benchmark(const char *name, long length, const char *delimiter) {
+
+    long oldTokens;
+    long oldTokenBytes;
+    long newTokens;
+    long newTokenBytes;
+    double old = nanosecondsPerPass(length, delimiter, true, &oldTokens, &oldTokenBytes);
+    double new = nanosecondsPerPass(length, delimiter, false, &newTokens, &newTokenBytes);
+
+    CHECK(newTokens == oldTokens);
+    CHECK(newTokenBytes == oldTokenBytes);
+
+    printf("  %-26s %5ld bytes, %4ld tokens, strtokm: %5.2f ns a byte, nextToken: %5.2f ns a byte\n",
+           name, length, newTokens, old / length, new / length);
+}
+
+int main() {
+
+    printf("splitting responses:\n");
+
+    benchmark("transcript of 200", buildTranscript(200), "ENDLASTMESSAGE");
+    benchmark("transcript of 15", buildTranscript(15), "ENDLASTMESSAGE");
+    benchmark("chat list", buildChats(10), ",");
+    benchmark("short fields", buildFields(500), "&&&");
+
+    return checkFailures;
+}
@@ -0,0 +1,210 @@
+// checks that wrap.c breaks messages in to the rows index.js used to send (see wrap_vectors.js),
+// then times wrapping a thousand of them. run with run_tests.sh
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "check.h"
+#include "toolbox_stub.h"
+#include "../wrap.h"
+
+#define MAX_VECTOR_LINE 4096
+#define MAX_MESSAGES 2048
+#define BENCHMARK_WIDTH 286
+
+static short widths[256];
+static char *messages[MAX_MESSAGES];
+static short messageCount = 0;
+
+static short charWidth(char character) {
+
+    return widths[(unsigned char)character];
+}
+
+// reads a line without its newline, the caller's copy is only good until the next one
+static char *readLine(FILE *file) {
+
+    static char line[MAX_VECTOR_LINE];
+
+    if (fgets(line, sizeof(line), file) == NULL) {
+
+        return NULL;
+    }
+
+    line[strcspn(line, "\n")] = '\0';
+
+    return line;
+}
+
+// messages are stored with a space in front, the way transcript.c keeps them
+static char *storedMessage(const char *message) {
+
+    char *stored = malloc(strlen(message) + 2);
+
+    stored[0] = ' ';
+    strcpy(&stored[1], message);
+
+    return stored;
+}
+
+static Boolean readWidths(const char *directory) {
+
+    char path[1024];
+
+    snprintf(path, sizeof(path), "%s/widths.txt", directory);
+
+    FILE *file = fopen(path, "r");
+
+    if (file == NULL) {
+
+        return false;
+    }
+
+    for (short i = 0; i < 256; i++) {
+
+        char *line = readLine(file);
+
+        widths[i] = line != NULL ? atoi(line) : 0;
+    }
+
+    fclose(file);
+
+    return true;
+}
+
+static void checkMessage(short width, const char *message, char rows[][MAX_VECTOR_LINE], short rowCount) {
+
+    char *text = storedMessage(message);
+    short length = strlen(text);
+    const WrappedText *wrapped = wrapText(text, length, wrapTextHash(text, length), width, charWidth);
+
+    // a message with more lines than wrap.c keeps only has its last ones
+    short skipped = rowCount > WRAP_MAX_LINES ? rowCount - WRAP_MAX_LINES : 0;
+    int failuresBefore = checkFailures;
+
+    CHECK(wrapped->lineCount == rowCount - skipped);
+
+    for (short i = 0; i < wrapped->lineCount && i + skipped < rowCount; i++) {
+
+        const char *row = rows[i + skipped];
+
+        CHECK(wrapped->lines[i].length == (short)strlen(row) && !memcmp(&text[wrapped->lines[i].start], row, wrapped->lines[i].length));
+    }
+
+    if (checkFailures != failuresBefore) {
+
+        printf("  at width %d: \"%s\"\n", width, message);
+    }
+
+    if (width == BENCHMARK_WIDTH && messageCount < MAX_MESSAGES) {
+
+        messages[messageCount++] = text;
+    } else {
+
+        free(text);
+    }
+}
+
+static void testParity(const char *directory) {
+
+    static char rows[WRAP_MAX_LINES * 8][MAX_VECTOR_LINE];
+    static char message[MAX_VECTOR_LINE];
+    char path[1024];
+    long vectorCount = 0;
+
+    snprintf(path, sizeof(path), "%s/vectors.txt", directory);
+
+    FILE *file = fopen(path, "rb");
+
+    CHECK(file != NULL);
+
+    if (file == NULL) {
+
+        return;
+    }
+
+    char *line;
+
+    while ((line = readLine(file)) != NULL) {
+
+        short width = atoi(line);
+
+        strcpy(message, readLine(file));
+
+        short rowCount = atoi(readLine(file));
+
+        for (short i = 0; i < rowCount; i++) {
+
+            strcpy(rows[i], readLine(file));
+        }
+
+        checkMessage(width, message, rows, rowCount);
+        vectorCount++;
+    }
+
+    fclose(file);
+
+    CHECK(vectorCount > 0);
+
+    printf("  %ld messages and widths wrapped the same as shortenText\n", vectorCount);
+}
+
+static double millisecondsSince(clock_t start) {
+
+    return (double)(clock() - start) * 1000 / CLOCKS_PER_SEC;
+}
+
+// a thousand new messages, which all have to be broken, then the ones on screen drawn again, which
+// should all come from the cache
+static void benchmarkWrapping() {
+
+    short count = messageCount < 1000 ? messageCount : 1000;
+    short onScreen = WRAP_CACHE_SIZE - 4;
+    unsigned long hashes[1000];
+    short lengths[1000];
+
+    CHECK(count == 1000);
+
+    for (short i = 0; i < count; i++) {
+
+        lengths[i] = strlen(messages[i]);
+        hashes[i] = wrapTextHash(messages[i], lengths[i]);
+    }
+
+    clearWrapCache();
+    memset(&wrapStats, 0, sizeof(wrapStats));
+
+    clock_t start = clock();
+
+    for (short i = 0; i < count; i++) {
+
+        wrapText(messages[i], lengths[i], hashes[i], BENCHMARK_WIDTH, charWidth);
+    }
+
+    printf("  wrapping %d new messages: %.2f ms, %lu wrapped\n", count, millisecondsSince(start), wrapStats.misses);
+    CHECK(wrapStats.misses == (unsigned long)count);
+
+    memset(&wrapStats, 0, sizeof(wrapStats));
+    start = clock();
+
+    for (short frame = 0; frame < 100; frame++) {
+
+        for (short i = count - onScreen; i < count; i++) {
+
+            wrapText(messages[i], lengths[i], hashes[i], BENCHMARK_WIDTH, charWidth);
+        }
+    }
+
+    printf("  100 frames of the last %d again: %.2f ms, %lu wrapped, %lu from the cache\n", onScreen, millisecondsSince(start), wrapStats.misses, wrapStats.hits);
+    CHECK(wrapStats.misses == 0);
+}
+
+int main(int argc, char **argv) {
+
+    const char *directory = argc > 1 ? argv[1] : ".";
+
+    CHECK(readWidths(directory));
+    testParity(directory);
+    benchmarkWrapping();
+
+    return checkFailures;
+}
@@ -0,0 +1,162 @@
+// wraps messages with shortenText, the wrapper index.js used before wrap.c took over, and writes
+// them out for wrap_test.c, which checks that wrap.c breaks them in to the same rows. run with
+// run_tests.sh:
+//
+//   node wrap_vectors.js <directory>
+//
+// writes widths.txt, the 256 character widths both sides measure with, and vectors.txt, which is a
+// block for each message and width: the width, the message, the number of rows, then the rows
+const fs = require(`fs`)
+const path = require(`path`)
+const vm = require(`vm`)
+
+const WIDTHS = [304, 286, 120] // what index.js wrapped to, the messages window today, and narrow
+const GENERATED_MESSAGES = 1000
+
+// Chicago 12. index.js only had the first 128 widths and measured anything else as 1, so the
+// rest are 1 here too, rather than the real widths the Mac measures them with now
+const widthFor12ptFont = JSON.parse(fs.readFileSync(path.join(__dirname, `..`, `font_metrics.json`), `utf8`))[`Chicago-12`].widths
+  .map((width, character) => character < 128 ? width : 1)
+
+const SPACE_WIDTH = widthFor12ptFont[32]
+
+const getNextWordLength = (word) => {
+
+  let currentWidth = 0
+
+  for (const char of word.split(``)) {
+
+    let currentCharWidth = widthFor12ptFont[char.charCodeAt()]
+
+    if (isNaN(currentCharWidth)) {
+
+      currentCharWidth = 1
+    }
+
+    currentWidth += currentCharWidth
+  }
+
+  return currentWidth
+}
+
+// shortenText from index.js as it was, with MAX_WIDTH made a parameter
+const shortenText = (text, MAX_WIDTH) => {
+
+  let outputText = ``
+  let currentWidth = 0
+
+  for (const word of text.split(` `)) {
+
+    let currentWordWidth = getNextWordLength(word)
+
+    if (currentWidth + currentWordWidth + SPACE_WIDTH > MAX_WIDTH) {
+
+      outputText = `${outputText}ENDLASTMESSAGE`
+      currentWidth = 0
+
+      // okay, but what if the word itself is greater than max width?
+      if (currentWordWidth > MAX_WIDTH) {
+
+        let splitWordWidth = 0
+
+        for (const char of word.split(``)) {
+
+          let currentCharWidth = widthFor12ptFont[char.charCodeAt()]
+
+          if (isNaN(currentCharWidth)) {
+
+            currentCharWidth = 1
+          }
+
+          if (splitWordWidth + currentCharWidth > MAX_WIDTH) {
+
+            outputText = `${outputText}ENDLASTMESSAGE`
+            splitWordWidth = 0
+          }
+
+          splitWordWidth += currentCharWidth
+          outputText = `${outputText}${char}`
+        }
+
+        currentWidth += splitWordWidth
+
+        continue
+      }
+    }
+
+    currentWidth += currentWordWidth + SPACE_WIDTH
+    outputText = `${outputText} ${word}`
+  }
+
+  return outputText
+}
+
+// the test transcript from index.js
+const testMessages = () => {
+
+  const source = fs.readFileSync(path.join(__dirname, `..`, `JS`, `index.js`), `utf8`)
+
+  return vm.runInNewContext(source.match(/let TEST_MESSAGES = (\[[\s\S]*?\n\])/)[1])
+    .map((message) => `${message.chatter}: ${message.text}`)
+}
+
+// messages with the awkward parts in: words too long for a line, runs of spaces, spaces at either
+// end and high bit characters
+const generatedMessages = () => {
+
+  const messages = []
+  let state = 12345
+
+  const random = (limit) => {
+
+    state = (Math.imul(state, 1103515245) + 12345) >>> 0
+
+    return (state >>> 8) % limit
+  }
+
+  for (let i = 0; i < GENERATED_MESSAGES; i++) {
+
+    const words = []
+    const wordCount = 1 + random(40)
+
+    for (let j = 0; j < wordCount; j++) {
+
+      const length = random(10) === 0 ? 20 + random(60) : random(12)
+      let word = ``
+
+      for (let k = 0; k < length; k++) {
+
+        word += String.fromCharCode(random(20) === 0 ? 128 + random(128) : 33 + random(94))
+      }
+
+      words.push(word)
+    }
+
+    messages.push(`friend ${i % 7}: ${words.join(random(8) === 0 ? `  ` : ` `)}${random(10) === 0 ? ` ` : ``}`)
+  }
+
+  return messages
+}
+
+const [directory] = process.argv.slice(2)
+
+if (!directory) {
+
+  console.log(`usage: node wrap_vectors.js <directory>`)
+  process.exit(1)
+}
+
+const blocks = []
+
+for (const message of [...testMessages(), ...generatedMessages()]) {
+
+  for (const width of WIDTHS) {
+
+    const rows = shortenText(message, width).split(`ENDLASTMESSAGE`)
+
+    blocks.push(`${width}\n${message}\n${rows.length}\n${rows.map((row) => `${row}\n`).join(``)}`)
+  }
+}
+
+fs.writeFileSync(path.join(directory, `widths.txt`), `${widthFor12ptFont.join(`\n`)}\n`)
+fs.writeFileSync(path.join(directory, `vectors.txt`), Buffer.from(blocks.join(``), `latin1`))
@@ -0,0 +1,248 @@
+#include <string.h>
+#include "SerialHelper.h"
+#include "transcript.h"
+
+// messages are stored with a space in front, see wrap.c
+static short storedLength(CoprocessorView *message) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: storedLength");
+    #endif
+
+    return 1 + (short)(message->length < TRANSCRIPT_MAX_MESSAGE_LENGTH - 1 ? message->length : TRANSCRIPT_MAX_MESSAGE_LENGTH - 1);
+}
+
+static void storeMessage(Transcript *transcript, short index, short offset, CoprocessorView *message) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: storeMessage");
+    #endif
+
+    TranscriptMessage *stored = &transcript->messages[index];
+
+    stored->offset = offset;
+    stored->length = storedLength(message);
+    stored->lineCount = 0;
+
+    transcript->text[offset] = ' ';
+    memcpy(&transcript->text[offset + 1], message->data, stored->length - 1);
+
+    stored->hash = wrapTextHash(&transcript->text[offset], stored->length);
+}
+
+static void dropOldestMessages(Transcript *transcript, short count) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: dropOldestMessages");
+    #endif
+
+    if (count <= 0) {
+
+        return;
+    }
+
+    short bytes = count < transcript->messageCount ? transcript->messages[count].offset : transcript->textLength;
+
+    memmove(transcript->text, &transcript->text[bytes], transcript->textLength - bytes);
+    memmove(transcript->messages, &transcript->messages[count], sizeof(TranscriptMessage) * (transcript->messageCount - count));
+
+    transcript->messageCount -= count;
+    transcript->textLength -= bytes;
+    transcript->firstSequence += count;
+    transcript->layoutDirty = true;
+
+    for (short i = 0; i < transcript->messageCount; i++) {
+
+        transcript->messages[i].offset -= bytes;
+    }
+}
+
+void clearTranscript(Transcript *transcript, long firstSequence) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: clearTranscript");
+    #endif
+
+    transcript->firstSequence = firstSequence;
+    transcript->messageCount = 0;
+    transcript->textLength = 0;
+    transcript->rowCount = 0;
+    transcript->layoutWidth = -1;
+    transcript->layoutDirty = true;
+}
+
+// adds the newest message, making room by letting the oldest ones go
+void appendTranscriptMessage(Transcript *transcript, CoprocessorView *message) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: appendTranscriptMessage");
+    #endif
+
+    short length = storedLength(message);
+    short drop = 0;
+    short freed = 0;
+
+    while (drop < transcript->messageCount &&
+           (transcript->messageCount - drop >= TRANSCRIPT_MAX_MESSAGES || transcript->textLength - freed + length > TRANSCRIPT_TEXT_SIZE)) {
+
+        freed += transcript->messages[drop].length;
+        drop++;
+    }
+
+    dropOldestMessages(transcript, drop);
+    storeMessage(transcript, transcript->messageCount, transcript->textLength, message);
+
+    transcript->messageCount++;
+    transcript->textLength += length;
+    transcript->layoutDirty = true;
+}
+
+// adds a page of older messages in front of what we have. messages are oldest first. a page is
+// never allowed to push out newer messages, so if it does not fit nothing changes and this returns
+// false
+Boolean prependTranscriptMessages(Transcript *transcript, CoprocessorView *messages, short count) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: prependTranscriptMessages");
+    #endif
+
+    long bytes = 0;
+
+    for (short i = 0; i < count; i++) {
+
+        bytes += storedLength(&messages[i]);
+    }
+
+    if (transcript->messageCount + count > TRANSCRIPT_MAX_MESSAGES || transcript->textLength + bytes > TRANSCRIPT_TEXT_SIZE) {
+
+        return false;
+    }
+
+    memmove(&transcript->text[bytes], transcript->text, transcript->textLength);
+    memmove(&transcript->messages[count], transcript->messages, sizeof(TranscriptMessage) * transcript->messageCount);
+
+    for (short i = count; i < transcript->messageCount + count; i++) {
+
+        transcript->messages[i].offset += bytes;
+    }
+
+    short offset = 0;
+
+    for (short i = 0; i < count; i++) {
+
+        storeMessage(transcript, i, offset, &messages[i]);
+        offset += transcript->messages[i].length;
+    }
+
+    transcript->messageCount += count;
+    transcript->textLength += bytes;
+    transcript->firstSequence -= count;
+    transcript->layoutDirty = true;
+
+    return true;
+}
+
+const WrappedText *wrapTranscriptMessage(Transcript *transcript, short message, WrapCharWidth charWidth) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: wrapTranscriptMessage");
+    #endif
+
+    TranscriptMessage *stored = &transcript->messages[message];
+
+    return wrapText(&transcript->text[stored->offset], stored->length, stored->hash, transcript->layoutWidth, charWidth);
+}
+
+// works out which rows each message covers at width. only messages that have not been wrapped at
+// this width before are wrapped, and nothing at all happens unless the transcript or the width has
+// changed since last time. returns true if the rows moved
+Boolean layoutTranscript(Transcript *transcript, short width, WrapCharWidth charWidth) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: layoutTranscript");
+    #endif
+
+    if (width != transcript->layoutWidth) {
+
+        transcript->layoutWidth = width;
+        transcript->layoutDirty = true;
+
+        for (short i = 0; i < transcript->messageCount; i++) {
+
+            transcript->messages[i].lineCount = 0;
+        }
+    }
+
+    if (!transcript->layoutDirty) {
+
+        return false;
+    }
+
+    short row = 0;
+
+    for (short i = 0; i < transcript->messageCount; i++) {
+
+        TranscriptMessage *stored = &transcript->messages[i];
+
+        if (stored->lineCount == 0) {
+
+            stored->lineCount = wrapTranscriptMessage(transcript, i, charWidth)->lineCount;
+        }
+
+        stored->firstRow = row;
+        row += stored->lineCount;
+    }
+
+    transcript->rowCount = row;
+
+    if (transcript->rowCount > TRANSCRIPT_MAX_ROWS) {
+
+        short drop = 0;
+        short removedRows = 0;
+
+        while (transcript->rowCount - removedRows > TRANSCRIPT_MAX_ROWS) {
+
+            removedRows += transcript->messages[drop].lineCount;
+            drop++;
+        }
+
+        dropOldestMessages(transcript, drop);
+
+        for (short i = 0; i < transcript->messageCount; i++) {
+
+            transcript->messages[i].firstRow -= removedRows;
+        }
+
+        transcript->rowCount -= removedRows;
+    }
+
+    transcript->layoutDirty = false;
+
+    return true;
+}
+
+// the message that row belongs to, the transcript must have been laid out
+short transcriptMessageForRow(Transcript *transcript, short row) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: transcriptMessageForRow");
+    #endif
+
+    short low = 0;
+    short high = transcript->messageCount - 1;
+
+    while (low < high) {
+
+        short middle = (low + high + 1) / 2;
+
+        if (transcript->messages[middle].firstRow <= row) {
+
+            low = middle;
+        } else {
+
+            high = middle - 1;
+        }
+    }
+
+    return low;
+}
@@ -0,0 +1,42 @@
+#ifndef TRANSCRIPT_H
+#define TRANSCRIPT_H
+
+#include <MacTypes.h>
+#include "coprocessorjs.h"
+#include "wrap.h"
+
+// the active chat's messages, packed one after another in text with an index of where each one
+// starts, so memory follows how much has actually been said. when either fills up the oldest
+// messages go to make room for new ones
+#define TRANSCRIPT_TEXT_SIZE 8192
+#define TRANSCRIPT_MAX_MESSAGES 128
+#define TRANSCRIPT_MAX_MESSAGE_LENGTH 1024 // longer messages are cut off
+#define TRANSCRIPT_MAX_ROWS 2000 // keeps the bottom of the list inside nuklear's short scroll offsets
+
+typedef struct TranscriptMessage {
+    short offset;
+    short length;
+    unsigned long hash; // see wrapTextHash
+    short lineCount; // at the transcript's layoutWidth, 0 until it has been wrapped
+    short firstRow;
+} TranscriptMessage;
+
+typedef struct Transcript {
+    long firstSequence; // index.js's sequence number for messages[0], see transcriptDelta there
+    short messageCount;
+    short textLength;
+    short rowCount;
+    short layoutWidth;
+    Boolean layoutDirty;
+    TranscriptMessage messages[TRANSCRIPT_MAX_MESSAGES];
+    char text[TRANSCRIPT_TEXT_SIZE];
+} Transcript;
+
+void clearTranscript(Transcript *transcript, long firstSequence);
+void appendTranscriptMessage(Transcript *transcript, CoprocessorView *message);
+Boolean prependTranscriptMessages(Transcript *transcript, CoprocessorView *messages, short count);
+Boolean layoutTranscript(Transcript *transcript, short width, WrapCharWidth charWidth);
+short transcriptMessageForRow(Transcript *transcript, short row);
+const WrappedText *wrapTranscriptMessage(Transcript *transcript, short message, WrapCharWidth charWidth);
+
+#endif
@@ -0,0 +1,165 @@
+#include <string.h>
+#include "SerialHelper.h"
+#include "wrap.h"
+
+// breaks message text in to lines that fit a given width. this used to happen in index.js, which
+// meant it had to know our window geometry and font. the rules are the ones index.js used, so rows
+// come out the same as they always have:
+//   - the text is split at spaces, and every word is drawn with the space in front of it. callers
+//     put a space at the start of the text so that the first word has one too
+//   - a word moves to the next line if the line, the word and one more space would not fit
+//   - a word that is too wide for a line of its own loses its space and is split between
+//     characters wherever it runs out of room
+WrapStats wrapStats;
+WrappedText wrapCache[WRAP_CACHE_SIZE];
+unsigned short wrapClock = 0;
+
+// djb2, with the multiply done as a shift and add since the 68000 has no 32 bit multiply
+unsigned long wrapTextHash(const char *text, short length) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: wrapTextHash");
+    #endif
+
+    unsigned long hash = 5381;
+
+    for (short i = 0; i < length; i++) {
+
+        hash = (hash << 5) + hash + (unsigned char)text[i];
+    }
+
+    return hash;
+}
+
+void clearWrapCache() {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: clearWrapCache");
+    #endif
+
+    memset(wrapCache, 0, sizeof(wrapCache));
+    wrapClock = 0;
+}
+
+// a full line list keeps the newest lines, the oldest scrolls off the top
+static void addLine(WrappedText *wrapped, short start, short end) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: addLine");
+    #endif
+
+    if (wrapped->lineCount == WRAP_MAX_LINES) {
+
+        memmove(&wrapped->lines[0], &wrapped->lines[1], sizeof(WrapLine) * (WRAP_MAX_LINES - 1));
+        wrapped->lineCount--;
+    }
+
+    wrapped->lines[wrapped->lineCount].start = start;
+    wrapped->lines[wrapped->lineCount].length = end - start;
+    wrapped->lineCount++;
+}
+
+static void breakLines(WrappedText *wrapped, const char *text, short length, short width, WrapCharWidth charWidth) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: breakLines");
+    #endif
+
+    short spaceWidth = charWidth(' ');
+    short lineWidth = 0;
+    short lineStart = 0;
+    short position = 0;
+
+    wrapped->lineCount = 0;
+
+    while (position < length) {
+
+        // the word runs from after its space up to the next one
+        short wordSpace = position;
+        short wordStart = text[position] == ' ' ? position + 1 : position;
+        short wordEnd = wordStart;
+        short wordWidth = 0;
+
+        while (wordEnd < length && text[wordEnd] != ' ') {
+
+            wordWidth += charWidth(text[wordEnd]);
+            wordEnd++;
+        }
+
+        position = wordEnd;
+
+        if (lineWidth + wordWidth + spaceWidth > width) {
+
+            addLine(wrapped, lineStart, wordSpace);
+            lineStart = wordSpace;
+            lineWidth = 0;
+
+            if (wordWidth > width) {
+
+                lineStart = wordStart;
+
+                for (short i = wordStart; i < wordEnd; i++) {
+
+                    short currentCharWidth = charWidth(text[i]);
+
+                    if (lineWidth + currentCharWidth > width) {
+
+                        addLine(wrapped, lineStart, i);
+                        lineStart = i;
+                        lineWidth = 0;
+                    }
+
+                    lineWidth += currentCharWidth;
+                }
+
+                continue;
+            }
+        }
+
+        lineWidth += wordWidth + spaceWidth;
+    }
+
+    addLine(wrapped, lineStart, length);
+}
+
+// returns the lines for text at width, only breaking it again if it is not already in the cache.
+// the result stays valid until WRAP_CACHE_SIZE other messages have been wrapped
+const WrappedText *wrapText(const char *text, short length, unsigned long hash, short width, WrapCharWidth charWidth) {
+
+    #ifdef DEBUG_FUNCTION_CALLS
+        writeSerialPortDebug(boutRefNum, "DEBUG_FUNCTION_CALLS: wrapText");
+    #endif
+
+    WrappedText *oldest = &wrapCache[0];
+
+    wrapClock++;
+
+    for (short i = 0; i < WRAP_CACHE_SIZE; i++) {
+
+        WrappedText *wrapped = &wrapCache[i];
+
+        // lineCount is never 0 for a wrapped message, so this also skips unused entries
+        if (wrapped->lineCount > 0 && wrapped->hash == hash && wrapped->length == length && wrapped->width == width) {
+
+            wrapped->lastUsed = wrapClock;
+            wrapStats.hits++;
+
+            return wrapped;
+        }
+
+        if ((unsigned short)(wrapClock - wrapped->lastUsed) > (unsigned short)(wrapClock - oldest->lastUsed)) {
+
+            oldest = wrapped;
+        }
+    }
+
+    wrapStats.misses++;
+
+    oldest->hash = hash;
+    oldest->length = length;
+    oldest->width = width;
+    oldest->lastUsed = wrapClock;
+    breakLines(oldest, text, length, width, charWidth);
+
+    return oldest;
+}
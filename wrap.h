@@ -0,0 +1,42 @@
+#ifndef WRAP_H
+#define WRAP_H
+
+#include <MacTypes.h>
+
+// line breaks kept per message, which is room for a TRANSCRIPT_MAX_MESSAGE_LENGTH message of
+// ordinary text. a message with more lines than this keeps its last WRAP_MAX_LINES
+#define WRAP_MAX_LINES 32
+
+// how many wrapped messages are remembered, enough for every message on screen and a few more
+#define WRAP_CACHE_SIZE 24
+
+typedef short (*WrapCharWidth)(char character);
+
+typedef struct WrapLine {
+    short start;
+    short length;
+} WrapLine;
+
+// the line breaks for one message at one width. hash and length identify the text, so the same
+// message arriving again, say after index.js resets the transcript, is not wrapped a second time
+typedef struct WrappedText {
+    unsigned long hash;
+    short length;
+    short width;
+    unsigned short lastUsed;
+    short lineCount;
+    WrapLine lines[WRAP_MAX_LINES];
+} WrappedText;
+
+typedef struct WrapStats {
+    unsigned long hits;
+    unsigned long misses;
+} WrapStats;
+
+extern WrapStats wrapStats;
+
+unsigned long wrapTextHash(const char *text, short length);
+const WrappedText *wrapText(const char *text, short length, unsigned long hash, short width, WrapCharWidth charWidth);
+void clearWrapCache();
+
+#endif